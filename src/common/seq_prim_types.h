@@ -26,6 +26,8 @@ enum prim_type_tag {
     P_UINT16T,
     P_INT32T,
     P_UINT32T,
+    P_INT64T,
+    P_UINT64T,
     P_FLOAT,
     P_DOUBLE,
     P_STRING,
@@ -53,6 +55,8 @@ const char *prim_type_name[]
     "epicsUInt16",
     "epicsInt32",
     "epicsUInt32",
+    "long long",
+    "unsigned long long",
     "float",
     "double",
     "string",
@@ -80,6 +84,8 @@ const char *prim_type_tag_name[]
     "P_UINT16T",
     "P_INT32T",
     "P_UINT32T",
+    "P_INT64T",
+    "P_UINT64T",
     "P_FLOAT",
     "P_DOUBLE",
     "P_STRING",
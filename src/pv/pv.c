@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 
 #include "errlog.h"
 #include "cadef.h"
@@ -7,6 +8,25 @@
 #define epicsExportSharedSymbols
 #include "pv.h"
 
+#ifdef PV_DB_PROVIDER
+#include "pvDb.h"
+/* channels to local records are handled by the database access provider */
+#define DISPATCH_DB(var, func, args) if (pvVarIsLocal(*(var))) return pvDb##func args
+#else
+#define DISPATCH_DB(var, func, args)
+#endif
+
+#ifdef PV_PVA_PROVIDER
+#include "pvPva.h"
+/* channels named with a "pva://" prefix are handled by the pvAccess provider */
+#define DISPATCH_PVA(var, func, args) if (pvVarIsPva(*(var))) return pvPva##func args
+#else
+#define DISPATCH_PVA(var, func, args)
+#endif
+
+#define DISPATCH(var, func, args) \
+    DISPATCH_DB(var, func, args); DISPATCH_PVA(var, func, args)
+
 #define INVOKE(x, expr) \
     {\
         int _status = expr;\
@@ -17,14 +37,26 @@
         }\
     }
 
-epicsShareDef const struct pvSystem nullPvSys = {NULL};
-epicsShareDef const struct pvVar nullPvVar = {NULL,NULL,NULL,NULL,NULL,NULL};
+/* CA has no DBR type for 64 bit integers */
+#define CHECK_CA_TYPE(var, type) \
+    if (typeToCA(type) < 0) {\
+        (var)->msg = "64 bit integers are not supported by CA";\
+        errlogSevPrintf(errlogMajor, "%s: %s\n", ca_name((var)->chid), (var)->msg);\
+        return pvStatERROR;\
+    }
+
+epicsShareDef const struct pvSystem nullPvSys = {NULL,NULL,NULL,NULL};
+epicsShareDef const struct pvVar nullPvVar = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+
+epicsShareDef int pvDbProviderEnable = TRUE;
+epicsShareDef int pvPvaQueueSize = 4;
 
 /* utilities */
 static pvSevr sevrFromCA(long status);  /* CA severity as pvSevr */
 static pvStat statFromCA(long status);  /* CA status as pvStat */
 static pvType typeFromCA(long type);    /* DBR type as pvType */
 static chtype typeToCA(pvType type);    /* pvType as DBR type */
+static void pvSysCleanup(pvSystem *pSys); /* destroy parts of a pvSystem */
 
 epicsShareFunc pvStat pvSysCreate(pvSystem *pSys)
 {
@@ -32,9 +64,49 @@ epicsShareFunc pvStat pvSysCreate(pvSystem *pSys)
     assert(!ca_current_context());
     INVOKE(pSys, ca_context_create(ca_enable_preemptive_callback));
     pSys->id = ca_current_context();
+#ifdef PV_DB_PROVIDER
+    if (pvDbSysCreate(pSys) != pvStatOK) {
+        pvSysCleanup(pSys);
+        return pvStatERROR;
+    }
+#endif
+#ifdef PV_PVA_PROVIDER
+    if (pvPvaSysCreate(pSys) != pvStatOK) {
+        pvSysCleanup(pSys);
+        return pvStatERROR;
+    }
+#endif
     return pvStatOK;
 }
 
+epicsShareFunc pvStat pvSysDestroy(pvSystem *pSys)
+{
+    assert(pSys);
+    if (pvSysIsDefined(*pSys) && ca_current_context() != pSys->id) {
+        assert(!ca_current_context());
+        INVOKE(pSys, ca_attach_context(pSys->id));
+    }
+    pvSysCleanup(pSys);
+    pSys->msg = NULL;
+    return pvStatOK;
+}
+
+/* Destroy whatever parts of a pvSystem have been created so far;
+   the CA context must be the current one. Keeps the message. */
+static void pvSysCleanup(pvSystem *pSys)
+{
+#ifdef PV_PVA_PROVIDER
+    pvPvaSysDestroy(pSys);
+#endif
+#ifdef PV_DB_PROVIDER
+    pvDbSysDestroy(pSys);
+#endif
+    if (pSys->id) {
+        ca_context_destroy();
+        pSys->id = NULL;
+    }
+}
+
 epicsShareFunc pvStat pvSysFlush(pvSystem sys)
 {
     INVOKE(&sys, ca_flush_io());
@@ -61,6 +133,23 @@ epicsShareFunc pvStat pvVarCreate(pvSystem sys, const char *name,
     var->conn_handler = conn_func;
     var->event_handler = event_func;
     var->arg = arg;
+    if (strncmp(name, PV_PREFIX_PVA, strlen(PV_PREFIX_PVA)) == 0) {
+#ifdef PV_PVA_PROVIDER
+        return pvPvaVarCreate(sys, name + strlen(PV_PREFIX_PVA), var);
+#else
+        var->msg = "pvAccess is not supported (needs EPICS base 7)";
+        errlogSevPrintf(errlogMajor, "pvVarCreate(%s): %s\n", name, var->msg);
+        return pvStatERROR;
+#endif
+    }
+    if (strncmp(name, PV_PREFIX_CA, strlen(PV_PREFIX_CA)) == 0) {
+        /* explicitly requested CA, even for local records */
+        name += strlen(PV_PREFIX_CA);
+    }
+#ifdef PV_DB_PROVIDER
+    else if (pvDbVarCreate(sys, name, var))
+        return pvStatOK;
+#endif
     INVOKE(var, ca_create_channel(name, pvCaConnectionHandler, var, CA_PRIORITY_DEFAULT, &var->chid));
     return pvStatOK;
 }
@@ -68,6 +157,7 @@ epicsShareFunc pvStat pvVarCreate(pvSystem sys, const char *name,
 epicsShareFunc pvStat pvVarDestroy(pvVar *var)
 {
     assert(var);
+    DISPATCH(var, VarDestroy, (var));
     INVOKE(var, ca_clear_channel(var->chid));
     *var = nullPvVar;
     return pvStatOK;
@@ -102,6 +192,8 @@ epicsShareFunc pvStat pvVarGetCallback(pvVar *var, pvType type, unsigned count,
 {
     assert(var);
     assert(pv_is_valid_type(type));
+    DISPATCH(var, VarGetCallback, (var, type, count, arg));
+    CHECK_CA_TYPE(var, type);
     INVOKE(var, ca_array_get_callback(
         typeToCA(type), count, var->chid, pvCaGetHandler, arg));
     return pvStatOK;
@@ -111,6 +203,8 @@ epicsShareFunc pvStat pvVarPutNoBlock(pvVar *var, pvType type, unsigned count, p
 {
     assert(var);
     assert(pv_is_simple_type(type));
+    DISPATCH(var, VarPutNoBlock, (var, type, count, value));
+    CHECK_CA_TYPE(var, type);
     INVOKE(var, ca_array_put(typeToCA(type), count, var->chid, value));
     return pvStatOK;
 }
@@ -119,6 +213,8 @@ epicsShareFunc pvStat pvVarPutCallback(pvVar *var, pvType type, unsigned count,
 {
     assert(var);
     assert(pv_is_simple_type(type));
+    DISPATCH(var, VarPutCallback, (var, type, count, value, arg));
+    CHECK_CA_TYPE(var, type);
     INVOKE(var, ca_array_put_callback(
         typeToCA(type), count, var->chid, value, pvCaPutHandler, arg));
     return pvStatOK;
@@ -128,6 +224,8 @@ epicsShareFunc pvStat pvVarMonitorOn(pvVar *var, pvType type, unsigned count, vo
 {
     assert(var);
     assert(pv_is_valid_type(type));
+    DISPATCH(var, VarMonitorOn, (var, type, count, arg));
+    CHECK_CA_TYPE(var, type);
     if (var->monid == NULL) {
         INVOKE(var, ca_create_subscription(typeToCA(type), count, var->chid,
             DBE_VALUE | DBE_ALARM, pvCaMonitorHandler, arg, &var->monid));
@@ -138,6 +236,7 @@ epicsShareFunc pvStat pvVarMonitorOn(pvVar *var, pvType type, unsigned count, vo
 epicsShareFunc pvStat pvVarMonitorOff(pvVar *var)
 {
     assert(var);
+    DISPATCH(var, VarMonitorOff, (var));
     if (var->monid != NULL) {
         INVOKE(var, ca_clear_event(var->monid));
         var->monid = NULL;
@@ -147,7 +246,9 @@ epicsShareFunc pvStat pvVarMonitorOff(pvVar *var)
 
 epicsShareFunc unsigned pvVarGetCount(pvVar *var)
 {
-    unsigned long c = ca_element_count(var->chid);
+    unsigned long c;
+    DISPATCH(var, VarGetCount, (var));
+    c = ca_element_count(var->chid);
     assert(c <= UINT_MAX);
     return (unsigned)c;
 }
@@ -235,6 +336,14 @@ typedef struct dbr_time_float   pvTimeFloat;
 typedef struct dbr_time_double  pvTimeDouble;
 typedef struct dbr_time_string  pvTimeString;
 
+/* there is no DBR type for 64 bit integers */
+typedef struct {
+    dbr_short_t     status;
+    dbr_short_t     severity;
+    epicsTimeStamp  stamp;
+    pvInt64         value;
+} pvTimeInt64;
+
 epicsShareDef const size_t pv_sizes[] = {
     sizeof(pvChar      ),
     sizeof(pvShort     ),
@@ -248,6 +357,8 @@ epicsShareDef const size_t pv_sizes[] = {
     sizeof(pvTimeFloat ),
     sizeof(pvTimeDouble),
     sizeof(pvTimeString),
+    sizeof(pvInt64     ),
+    sizeof(pvTimeInt64 ),
 };
 
 epicsShareDef const size_t pv_value_sizes[] = {
@@ -263,6 +374,8 @@ epicsShareDef const size_t pv_value_sizes[] = {
     sizeof(pvFloat ),
     sizeof(pvDouble),
     sizeof(pvString),
+    sizeof(pvInt64 ),
+    sizeof(pvInt64 ),
 };
 
 epicsShareDef const size_t pv_value_offsets[] = {
@@ -278,6 +391,8 @@ epicsShareDef const size_t pv_value_offsets[] = {
     offsetof(pvTimeFloat , value),
     offsetof(pvTimeDouble, value),
     offsetof(pvTimeString, value),
+    0,
+    offsetof(pvTimeInt64 , value),
 };
 
 epicsShareDef const size_t pv_status_offsets[] = {
@@ -287,6 +402,7 @@ epicsShareDef const size_t pv_status_offsets[] = {
     offsetof(pvTimeFloat , status),
     offsetof(pvTimeDouble, status),
     offsetof(pvTimeString, status),
+    offsetof(pvTimeInt64 , status),
 };
 
 epicsShareDef const size_t pv_severity_offsets[] = {
@@ -296,6 +412,7 @@ epicsShareDef const size_t pv_severity_offsets[] = {
     offsetof(pvTimeFloat , severity),
     offsetof(pvTimeDouble, severity),
     offsetof(pvTimeString, severity),
+    offsetof(pvTimeInt64 , severity),
 };
 
 epicsShareDef const size_t pv_stamp_offsets[] = {
@@ -305,4 +422,5 @@ epicsShareDef const size_t pv_stamp_offsets[] = {
     offsetof(pvTimeFloat , stamp),
     offsetof(pvTimeDouble, stamp),
     offsetof(pvTimeString, stamp),
+    offsetof(pvTimeInt64 , stamp),
 };
@@ -43,6 +43,8 @@ typedef void pvEventFunc(pvEventType evt, void *arg, pvType type, unsigned count
 struct pvSystem {
     struct ca_client_context *id;
     const char *msg;
+    struct pvDbSystem *dbid;            /* database access (local records) */
+    struct pvPvaSystem *pvaid;          /* pvAccess client */
 };
 
 struct pvVar {
@@ -52,16 +54,35 @@ struct pvVar {
     pvEventFunc *event_handler;
     void *arg;
     const char *msg;
+    struct pvDbVar *dbid;               /* local record, used instead of chid */
+    void *dbmonid;                      /* db event subscription */
+    struct pvPvaVar *pvaid;             /* pvAccess channel, used instead of chid */
+    void *pvamonid;                     /* pvAccess monitor */
 };
 
 #define pvSysIsDefined(x) ((x).id != NULL)
-#define pvVarIsDefined(x) ((x).chid != NULL)
-#define pvMonIsDefined(x) ((x).monid != NULL)
+#define pvVarIsDefined(x) ((x).chid != NULL || (x).dbid != NULL || (x).pvaid != NULL)
+#define pvMonIsDefined(x) ((x).monid != NULL || (x).dbmonid != NULL || (x).pvamonid != NULL)
+#define pvVarIsLocal(x) ((x).dbid != NULL)
+#define pvVarIsPva(x) ((x).pvaid != NULL)
+
+/* PV name prefixes that select a specific provider */
+#define PV_PREFIX_CA "ca://"
+#define PV_PREFIX_PVA "pva://"
 
 epicsShareExtern const struct pvSystem nullPvSys;
 epicsShareExtern const struct pvVar nullPvVar;
 
+/* If non-zero (the default), channels that name a record in the same
+   IOC are accessed directly through the database, not via CA. */
+epicsShareExtern int pvDbProviderEnable;
+
+/* Number of monitor updates the pvAccess server may send ahead
+   (i.e. before we have processed earlier ones). */
+epicsShareExtern int pvPvaQueueSize;
+
 epicsShareFunc pvStat pvSysCreate(pvSystem *pSys);
+epicsShareFunc pvStat pvSysDestroy(pvSystem *pSys);
 epicsShareFunc pvStat pvSysFlush(pvSystem sys);
 epicsShareFunc pvStat pvSysAttach(pvSystem sys);
 
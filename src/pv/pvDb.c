@@ -0,0 +1,521 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Database access provider for the pv library.
+ *
+ * Channels to records in the same IOC bypass CA completely: gets and
+ * puts go directly to the database via dbChannel and dbProcessNotify,
+ * monitors are db event subscriptions. Callbacks are delivered to the
+ * client through the same pvConnFunc and pvEventFunc as for CA, with
+ * values and meta data (status, severity, time stamp) in the usual
+ * pvType (i.e. DBR_TIME_XXX) layout.
+ *
+ * Note that the CA header files (cadef.h, db_access.h) must not be
+ * included here because they define DBR_XXX differently.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "epicsMutex.h"
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "alarm.h"
+#include "dbAccess.h"
+#include "dbChannel.h"
+#include "dbEvent.h"
+#include "dbLock.h"
+#include "dbNotify.h"
+#include "db_field_log.h"
+
+#define epicsExportSharedSymbols
+#include "pvDb.h"
+
+struct pvDbVar;
+
+struct pvDbSystem {
+    epicsMutexId    lock;           /* protects the members below */
+    dbEventCtx      evctx;          /* created on first use */
+    struct pvDbVar  *connecting;    /* vars waiting for connection callback */
+    struct pvDbVar  *active;        /* var whose connection callback runs */
+    epicsEventId    idle;           /* signalled after each connection callback */
+};
+
+struct pvDbPut {
+    processNotify   pn;
+    struct pvDbVar  *dbvar;
+    struct pvDbPut  *next;          /* list of pending puts */
+    pvType          type;
+    long            count;
+    void            *value;         /* private copy of the value to put */
+    void            *arg;
+};
+
+struct pvDbVar {
+    pvVar           *var;           /* back pointer to client's pvVar */
+    struct pvDbSystem *sys;
+    dbChannel       *chan;
+    struct pvDbVar  *nextConnecting;
+    epicsMutexId    lock;           /* protects puts */
+    struct pvDbPut  *puts;          /* pending put requests */
+    pvType          monType;        /* monitor request type */
+    unsigned        monCount;       /* monitor request count */
+    void            *monArg;        /* monitor user arg */
+    pvValue         *monBuf;        /* buffer for monitored values */
+};
+
+static short dbrFromPv(pvType type)
+{
+    switch (type) {
+        case pvTypeCHAR:
+        case pvTypeTIME_CHAR:   return DBR_UCHAR;
+        case pvTypeSHORT:
+        case pvTypeTIME_SHORT:  return DBR_SHORT;
+        case pvTypeLONG:
+        case pvTypeTIME_LONG:   return DBR_LONG;
+        case pvTypeFLOAT:
+        case pvTypeTIME_FLOAT:  return DBR_FLOAT;
+        case pvTypeDOUBLE:
+        case pvTypeTIME_DOUBLE: return DBR_DOUBLE;
+        case pvTypeSTRING:
+        case pvTypeTIME_STRING: return DBR_STRING;
+#ifdef DBR_INT64
+        case pvTypeINT64:
+        case pvTypeTIME_INT64:  return DBR_INT64;
+#endif
+        default:                return -1;
+    }
+}
+
+static long clampCount(struct pvDbVar *dbvar, unsigned count)
+{
+    long avail = dbChannelFinalElements(dbvar->chan);
+    return (count == 0 || (long)count > avail) ? avail : (long)count;
+}
+
+static const char *alarmMessage(epicsUInt16 stat)
+{
+    return stat < ALARM_NSTATUS ? epicsAlarmConditionStrings[stat] : "unknown";
+}
+
+/* Read value and meta data from the database; pfl is non-NULL for monitors */
+static pvStat pvDbGet(struct pvDbVar *dbvar, pvType type, unsigned *pCount,
+    pvValue *value, db_field_log *pfl)
+{
+    dbChannel *chan = dbvar->chan;
+    struct dbCommon *prec = dbChannelRecord(chan);
+    long options = 0;
+    long nRequest = clampCount(dbvar, *pCount);
+    long status;
+    epicsUInt16 stat, sevr;
+    epicsTimeStamp stamp;
+
+    dbScanLock(prec);
+    status = dbChannelGet(chan, dbrFromPv(type), pv_value_ptr(value, type),
+        &options, &nRequest, pfl);
+    if (pfl) {
+        stat = pfl->stat;
+        sevr = pfl->sevr;
+        stamp = pfl->time;
+    } else {
+        stat = prec->stat;
+        sevr = prec->sevr;
+        stamp = prec->time;
+    }
+    dbScanUnlock(prec);
+
+    if (pv_is_time_type(type)) {
+        char *base = (char *)value;
+        unsigned n = pv_time_index(type);
+
+        *(epicsInt16 *)(base + pv_status_offsets[n]) = (epicsInt16)stat;
+        *(epicsInt16 *)(base + pv_severity_offsets[n]) = (epicsInt16)sevr;
+        *(epicsTimeStamp *)(base + pv_stamp_offsets[n]) = stamp;
+    }
+    *pCount = (unsigned)nRequest;
+    if (status) {
+        dbvar->var->msg = "dbChannelGet failed";
+        return pvStatERROR;
+    }
+    dbvar->var->msg = alarmMessage(stat);
+    return pvStatOK;
+}
+
+/* Runs in the db event task: deliver connection callbacks */
+static void pvDbConnectLabor(void *arg)
+{
+    struct pvDbSystem *sys = (struct pvDbSystem *)arg;
+
+    epicsMutexMustLock(sys->lock);
+    while (sys->connecting) {
+        struct pvDbVar *dbvar = sys->connecting;
+        pvVar *var = dbvar->var;
+
+        sys->connecting = dbvar->nextConnecting;
+        sys->active = dbvar;
+        epicsMutexUnlock(sys->lock);
+
+        var->conn_handler(TRUE, var->arg);
+
+        epicsMutexMustLock(sys->lock);
+        sys->active = NULL;
+        epicsEventSignal(sys->idle);
+    }
+    epicsMutexUnlock(sys->lock);
+}
+
+pvStat pvDbSysCreate(pvSystem *pSys)
+{
+    struct pvDbSystem *sys = (struct pvDbSystem *)calloc(1, sizeof(struct pvDbSystem));
+
+    if (!sys) {
+        pSys->msg = "pvDbSysCreate: out of memory";
+        return pvStatERROR;
+    }
+    sys->lock = epicsMutexCreate();
+    sys->idle = epicsEventCreate(epicsEventEmpty);
+    if (!sys->lock || !sys->idle) {
+        if (sys->lock) epicsMutexDestroy(sys->lock);
+        if (sys->idle) epicsEventDestroy(sys->idle);
+        free(sys);
+        pSys->msg = "pvDbSysCreate: cannot create mutex or event";
+        return pvStatERROR;
+    }
+    pSys->dbid = sys;
+    return pvStatOK;
+}
+
+pvStat pvDbSysDestroy(pvSystem *pSys)
+{
+    struct pvDbSystem *sys = pSys->dbid;
+
+    if (!sys)
+        return pvStatOK;
+    /* all channels must have been destroyed */
+    assert(!sys->connecting && !sys->active);
+    /* waits for the event task to exit */
+    if (sys->evctx)
+        db_close_events(sys->evctx);
+    epicsMutexDestroy(sys->lock);
+    epicsEventDestroy(sys->idle);
+    free(sys);
+    pSys->dbid = NULL;
+    return pvStatOK;
+}
+
+/* Must be called with sys->lock held */
+static int pvDbStartEvents(struct pvDbSystem *sys)
+{
+    if (sys->evctx)
+        return TRUE;
+    sys->evctx = db_init_events();
+    if (!sys->evctx)
+        return FALSE;
+    if (db_add_extra_labor_event(sys->evctx, pvDbConnectLabor, sys) ||
+        db_start_events(sys->evctx, "seqDbEvent", NULL, NULL,
+            epicsThreadPriorityMedium)) {
+        db_close_events(sys->evctx);
+        sys->evctx = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int pvDbVarCreate(pvSystem sys, const char *name, pvVar *var)
+{
+    struct pvDbSystem *dbsys = sys.dbid;
+    struct pvDbVar *dbvar;
+    dbChannel *chan;
+
+    /* the database must be loaded and running */
+    if (!pvDbProviderEnable || !dbsys || !pdbbase || !interruptAccept)
+        return FALSE;
+    if (dbChannelTest(name) != 0)
+        return FALSE;
+
+    epicsMutexMustLock(dbsys->lock);
+    if (!pvDbStartEvents(dbsys)) {
+        epicsMutexUnlock(dbsys->lock);
+        return FALSE;
+    }
+    epicsMutexUnlock(dbsys->lock);
+
+    chan = dbChannelCreate(name);
+    if (!chan)
+        return FALSE;
+    if (dbChannelOpen(chan) != 0) {
+        dbChannelDelete(chan);
+        return FALSE;
+    }
+    dbvar = (struct pvDbVar *)calloc(1, sizeof(struct pvDbVar));
+    if (dbvar)
+        dbvar->lock = epicsMutexCreate();
+    if (!dbvar || !dbvar->lock) {
+        free(dbvar);
+        dbChannelDelete(chan);
+        return FALSE;
+    }
+    dbvar->var = var;
+    dbvar->sys = dbsys;
+    dbvar->chan = chan;
+    var->dbid = dbvar;
+    var->msg = NULL;
+
+    /* local records are always connected; like CA, report this
+       asynchronously, i.e. from the event task */
+    epicsMutexMustLock(dbsys->lock);
+    dbvar->nextConnecting = dbsys->connecting;
+    dbsys->connecting = dbvar;
+    epicsMutexUnlock(dbsys->lock);
+    db_post_extra_labor(dbsys->evctx);
+    return TRUE;
+}
+
+pvStat pvDbVarDestroy(pvVar *var)
+{
+    struct pvDbVar *dbvar = var->dbid;
+    struct pvDbSystem *dbsys = dbvar->sys;
+    struct pvDbVar **pp;
+    struct pvDbPut *rq;
+
+    pvDbVarMonitorOff(var);
+
+    /* cancel pending connection callback, or wait for it to finish */
+    epicsMutexMustLock(dbsys->lock);
+    for (pp = &dbsys->connecting; *pp; pp = &(*pp)->nextConnecting) {
+        if (*pp == dbvar) {
+            *pp = dbvar->nextConnecting;
+            break;
+        }
+    }
+    while (dbsys->active == dbvar) {
+        epicsMutexUnlock(dbsys->lock);
+        epicsEventWait(dbsys->idle);
+        epicsMutexMustLock(dbsys->lock);
+    }
+    epicsMutexUnlock(dbsys->lock);
+
+    /* take over pending puts; pvDbPutDone ignores requests not on the list */
+    epicsMutexMustLock(dbvar->lock);
+    rq = dbvar->puts;
+    dbvar->puts = NULL;
+    epicsMutexUnlock(dbvar->lock);
+    while (rq) {
+        struct pvDbPut *next = rq->next;
+        dbNotifyCancel(&rq->pn);
+        free(rq->value);
+        free(rq);
+        rq = next;
+    }
+
+    dbChannelDelete(dbvar->chan);
+    epicsMutexDestroy(dbvar->lock);
+    free(dbvar);
+    *var = nullPvVar;
+    return pvStatOK;
+}
+
+pvStat pvDbVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    struct pvDbVar *dbvar = var->dbid;
+    pvValue *value;
+    pvStat status;
+
+    count = (unsigned)clampCount(dbvar, count);
+    value = malloc(pv_size_n(type, count));
+    if (!value) {
+        var->msg = "pvDbVarGetCallback: out of memory";
+        return pvStatERROR;
+    }
+    /* the value is immediately available, so complete right away */
+    status = pvDbGet(dbvar, type, &count, value, NULL);
+    var->event_handler(pvEventGet, arg, type, count, value, status);
+    free(value);
+    return pvStatOK;
+}
+
+pvStat pvDbVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
+{
+    struct pvDbVar *dbvar = var->dbid;
+
+    if (dbChannelPutField(dbvar->chan, dbrFromPv(type), value,
+            clampCount(dbvar, count))) {
+        var->msg = "dbChannelPutField failed";
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+/* Called by dbProcessNotify with the record locked */
+static int pvDbPutCallback(processNotify *pn, notifyPutType which)
+{
+    struct pvDbPut *rq = (struct pvDbPut *)pn->usrPvt;
+    long status;
+
+    if (pn->status == notifyCanceled)
+        return 0;
+    switch (which) {
+    case putDisabledType:
+        pn->status = notifyError;
+        return 0;
+    case putFieldType:
+        status = dbChannelPutField(pn->chan, dbrFromPv(rq->type), rq->value, rq->count);
+        break;
+    case putType:
+    default:
+        status = dbChannelPut(pn->chan, dbrFromPv(rq->type), rq->value, rq->count);
+        break;
+    }
+    if (status)
+        pn->status = notifyError;
+    return 1;
+}
+
+static void pvDbPutDone(processNotify *pn)
+{
+    struct pvDbPut *rq = (struct pvDbPut *)pn->usrPvt;
+    struct pvDbVar *dbvar = rq->dbvar;
+    pvVar *var = dbvar->var;
+    struct pvDbPut **pp;
+    int owned = FALSE;
+    pvStat status;
+
+    epicsMutexMustLock(dbvar->lock);
+    for (pp = &dbvar->puts; *pp; pp = &(*pp)->next) {
+        if (*pp == rq) {
+            *pp = rq->next;
+            owned = TRUE;
+            break;
+        }
+    }
+    epicsMutexUnlock(dbvar->lock);
+    if (!owned)
+        return;     /* pvDbVarDestroy is cancelling it */
+
+    switch (pn->status) {
+    case notifyOK:
+        status = pvStatOK;
+        var->msg = NULL;
+        break;
+    case notifyCanceled:
+        status = pvStatERROR;
+        var->msg = "put canceled";
+        break;
+    case notifyTimeout:
+        status = pvStatTIMEOUT;
+        var->msg = "put timed out";
+        break;
+    default:
+        status = pvStatERROR;
+        var->msg = "put failed";
+        break;
+    }
+    /* like CA, put completion always has NULL value pointer */
+    var->event_handler(pvEventPut, rq->arg, rq->type, (unsigned)rq->count, NULL, status);
+    free(rq->value);
+    free(rq);
+}
+
+pvStat pvDbVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
+{
+    struct pvDbVar *dbvar = var->dbid;
+    struct pvDbPut *rq = (struct pvDbPut *)calloc(1, sizeof(struct pvDbPut));
+    size_t size;
+
+    if (!rq) {
+        var->msg = "pvDbVarPutCallback: out of memory";
+        return pvStatERROR;
+    }
+    rq->count = clampCount(dbvar, count);
+    size = pv_size_n(type, rq->count);
+    rq->value = malloc(size);
+    if (!rq->value) {
+        free(rq);
+        var->msg = "pvDbVarPutCallback: out of memory";
+        return pvStatERROR;
+    }
+    /* the put may complete later, so we need a private copy */
+    memcpy(rq->value, value, size);
+    rq->dbvar = dbvar;
+    rq->type = type;
+    rq->arg = arg;
+    rq->pn.usrPvt = rq;
+    rq->pn.chan = dbvar->chan;
+    rq->pn.requestType = putProcessRequest;
+    rq->pn.putCallback = pvDbPutCallback;
+    rq->pn.doneCallback = pvDbPutDone;
+
+    epicsMutexMustLock(dbvar->lock);
+    rq->next = dbvar->puts;
+    dbvar->puts = rq;
+    epicsMutexUnlock(dbvar->lock);
+
+    dbProcessNotify(&rq->pn);
+    return pvStatOK;
+}
+
+/* Runs in the db event task */
+static void pvDbMonitorHandler(void *arg, struct dbChannel *chan,
+    int eventsRemaining, struct db_field_log *pfl)
+{
+    struct pvDbVar *dbvar = (struct pvDbVar *)arg;
+    pvVar *var = dbvar->var;
+    unsigned count = dbvar->monCount;
+    pvStat status;
+
+    status = pvDbGet(dbvar, dbvar->monType, &count, dbvar->monBuf, pfl);
+    var->event_handler(pvEventMonitor, dbvar->monArg, dbvar->monType,
+        count, dbvar->monBuf, status);
+}
+
+pvStat pvDbVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    struct pvDbVar *dbvar = var->dbid;
+
+    if (var->dbmonid != NULL)
+        return pvStatOK;
+    dbvar->monType = type;
+    dbvar->monCount = (unsigned)clampCount(dbvar, count);
+    dbvar->monArg = arg;
+    dbvar->monBuf = malloc(pv_size_n(type, dbvar->monCount));
+    if (!dbvar->monBuf) {
+        var->msg = "pvDbVarMonitorOn: out of memory";
+        return pvStatERROR;
+    }
+    var->dbmonid = db_add_event(dbvar->sys->evctx, dbvar->chan,
+        pvDbMonitorHandler, dbvar, DBE_VALUE | DBE_ALARM);
+    if (!var->dbmonid) {
+        free(dbvar->monBuf);
+        dbvar->monBuf = NULL;
+        var->msg = "db_add_event failed";
+        return pvStatERROR;
+    }
+    db_event_enable(var->dbmonid);
+    /* like CA, send the current value as the first monitor event */
+    db_post_single_event(var->dbmonid);
+    return pvStatOK;
+}
+
+pvStat pvDbVarMonitorOff(pvVar *var)
+{
+    struct pvDbVar *dbvar = var->dbid;
+
+    if (var->dbmonid != NULL) {
+        /* waits until a running monitor callback has finished */
+        db_cancel_event(var->dbmonid);
+        var->dbmonid = NULL;
+        free(dbvar->monBuf);
+        dbvar->monBuf = NULL;
+    }
+    return pvStatOK;
+}
+
+unsigned pvDbVarGetCount(pvVar *var)
+{
+    struct pvDbVar *dbvar = var->dbid;
+    long c = dbChannelFinalElements(dbvar->chan);
+
+    assert(c >= 0);
+    return (unsigned)c;
+}
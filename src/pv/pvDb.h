@@ -0,0 +1,35 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Private definitions for the database access provider of the pv library.
+ *
+ * Channels whose name refers to a record in the same IOC are served
+ * directly by the database (dbChannel, dbProcessNotify, db events)
+ * instead of going through a CA client/server round trip. This
+ * header is not installed; it is only used by pv.c and pvDb.c.
+ */
+#ifndef INCLpvDbh
+#define INCLpvDbh
+
+#include "pv.h"
+
+/* Create the (lazily initialized) database access part of a pvSystem */
+pvStat pvDbSysCreate(pvSystem *pSys);
+
+/* Destroy it again, closing the db event context if it was started */
+pvStat pvDbSysDestroy(pvSystem *pSys);
+
+/* Try to create a local database channel; returns FALSE if the name
+   does not refer to a local record, in which case var is untouched */
+int pvDbVarCreate(pvSystem sys, const char *name, pvVar *var);
+
+pvStat pvDbVarDestroy(pvVar *var);
+pvStat pvDbVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg);
+pvStat pvDbVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value);
+pvStat pvDbVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg);
+pvStat pvDbVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg);
+pvStat pvDbVarMonitorOff(pvVar *var);
+unsigned pvDbVarGetCount(pvVar *var);
+
+#endif /* INCLpvDbh */
@@ -0,0 +1,581 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* pvAccess provider for the pv library.
+ *
+ * Channels named "pva://<name>" are accessed with the pvAccess client
+ * API (pvac). Values are converted to and from the requested pvType, and
+ * the meta data of normative types (alarm, timeStamp) is delivered in the
+ * usual pvType (i.e. DBR_TIME_XXX) layout. Arrays are transferred without
+ * the size restrictions of CA, and 64 bit integers are supported.
+ *
+ * Monitors are pipelined; the number of updates the server may send
+ * ahead is configured with pvPvaQueueSize.
+ */
+#include <algorithm>
+#include <list>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <string.h>
+#include <limits.h>
+
+#include <epicsMutex.h>
+#include <epicsGuard.h>
+#include <epicsTime.h>
+#include <errlog.h>
+
+#include <pv/pvData.h>
+#include <pv/createRequest.h>
+#include <pva/client.h>
+
+#define epicsExportSharedSymbols
+#include "pvPva.h"
+
+namespace pvd = epics::pvData;
+
+typedef epicsGuard<epicsMutex> Guard;
+
+/* seconds between POSIX epoch (pvAccess) and EPICS epoch (pvType) */
+#define POSIX_TIME_AT_EPICS_EPOCH 631152000LL
+
+struct pvPvaSystem {
+    epicsMutex lock;
+    pvac::ClientProvider *provider;     /* created on first use */
+
+    pvPvaSystem() : provider(NULL) {}
+};
+
+struct pvPvaRequest;
+
+struct pvPvaVar : public pvac::ConnectCallback, public pvac::MonitorCallback {
+    pvVar               *var;           /* back pointer to client's pvVar */
+    pvac::ClientChannel channel;
+    epicsMutex          lock;           /* protects the members below */
+    std::list<pvPvaRequest *> pending;  /* outstanding get and put requests */
+    std::list<pvPvaRequest *> done;     /* completed, to be deleted */
+    pvac::Monitor       monitor;
+    pvType              monType;        /* monitor request type */
+    unsigned            monCount;       /* monitor request count */
+    void                *monArg;        /* monitor user arg */
+    std::vector<char>   monBuf;         /* buffer for monitored values */
+
+    explicit pvPvaVar(pvVar *v) : var(v), monType(pvTypeERROR), monCount(0), monArg(NULL) {}
+    virtual ~pvPvaVar() {}
+
+    virtual void connectEvent(const pvac::ConnectEvent& evt);
+    virtual void monitorEvent(const pvac::MonitorEvent& evt);
+
+    void purge();
+};
+
+struct pvPvaRequest : public pvac::GetCallback, public pvac::PutCallback {
+    pvPvaVar            *pvar;
+    pvac::Operation     op;
+    pvType              type;
+    unsigned            count;
+    void                *arg;
+    bool                notify;         /* FALSE for pvVarPutNoBlock */
+    std::vector<char>   value;          /* buffer for get, private copy for put */
+
+    pvPvaRequest(pvPvaVar *pv, pvType t, unsigned c, void *a, bool n)
+        : pvar(pv), type(t), count(c), arg(a), notify(n), value(pv_size_n(t, c)) {}
+    virtual ~pvPvaRequest() {}
+
+    virtual void getDone(const pvac::GetEvent& evt);
+    virtual void putBuild(const pvd::StructureConstPtr& build, pvac::PutCallback::Args& args);
+    virtual void putDone(const pvac::PutEvent& evt);
+
+    void finish();
+};
+
+/* simple (i.e. non-time) type corresponding to a pvType */
+static pvType simpleType(pvType type)
+{
+    return pv_is_time_type(type) ? pv_simple_type(type) : type;
+}
+
+/* The value field can be a scalar, a scalar array, or an enum structure */
+static pvd::PVField::const_shared_pointer valueField(const pvd::PVStructure& root)
+{
+    pvd::PVStructure::const_shared_pointer e = root.getSubField<pvd::PVStructure>("value");
+    if (e) {
+        pvd::PVField::const_shared_pointer index = e->getSubField("index");
+        if (index)
+            return index;
+    }
+    return root.getSubField("value");
+}
+
+template<typename PV, typename T>
+static unsigned getArray(const pvd::PVScalarArray& arr, void *buf, unsigned count)
+{
+    pvd::shared_vector<const T> data;
+    PV *out = static_cast<PV *>(buf);
+    unsigned n;
+
+    arr.getAs<T>(data);
+    n = data.size() < count ? (unsigned)data.size() : count;
+    for (unsigned i = 0; i < n; i++)
+        out[i] = (PV)data[i];
+    return n;
+}
+
+static unsigned getStringArray(const pvd::PVScalarArray& arr, void *buf, unsigned count)
+{
+    pvd::shared_vector<const std::string> data;
+    pvString *out = static_cast<pvString *>(buf);
+    unsigned n;
+
+    arr.getAs<std::string>(data);
+    n = data.size() < count ? (unsigned)data.size() : count;
+    for (unsigned i = 0; i < n; i++) {
+        strncpy(out[i], data[i].c_str(), sizeof(pvString) - 1);
+        out[i][sizeof(pvString) - 1] = 0;
+    }
+    return n;
+}
+
+static unsigned getScalar(pvType type, const pvd::PVScalar& sca, void *buf)
+{
+    switch (type) {
+    case pvTypeCHAR:   *(pvChar *)buf   = sca.getAs<pvd::uint8>(); break;
+    case pvTypeSHORT:  *(pvShort *)buf  = sca.getAs<pvd::int16>(); break;
+    case pvTypeLONG:   *(pvLong *)buf   = sca.getAs<pvd::int32>(); break;
+    case pvTypeFLOAT:  *(pvFloat *)buf  = sca.getAs<pvd::float32>(); break;
+    case pvTypeDOUBLE: *(pvDouble *)buf = sca.getAs<pvd::float64>(); break;
+    case pvTypeINT64:  *(pvInt64 *)buf  = sca.getAs<pvd::int64>(); break;
+    case pvTypeSTRING: {
+        std::string s = sca.getAs<std::string>();
+        pvString *out = static_cast<pvString *>(buf);
+        strncpy(*out, s.c_str(), sizeof(pvString) - 1);
+        (*out)[sizeof(pvString) - 1] = 0;
+        break;
+    }
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+static unsigned getValue(pvType type, const pvd::PVField& fld, void *buf, unsigned count)
+{
+    if (fld.getField()->getType() == pvd::scalar) {
+        return count ? getScalar(type, static_cast<const pvd::PVScalar&>(fld), buf) : 0;
+    } else if (fld.getField()->getType() == pvd::scalarArray) {
+        const pvd::PVScalarArray& arr = static_cast<const pvd::PVScalarArray&>(fld);
+        switch (type) {
+        case pvTypeCHAR:   return getArray<pvChar, pvd::uint8>(arr, buf, count);
+        case pvTypeSHORT:  return getArray<pvShort, pvd::int16>(arr, buf, count);
+        case pvTypeLONG:   return getArray<pvLong, pvd::int32>(arr, buf, count);
+        case pvTypeFLOAT:  return getArray<pvFloat, pvd::float32>(arr, buf, count);
+        case pvTypeDOUBLE: return getArray<pvDouble, pvd::float64>(arr, buf, count);
+        case pvTypeINT64:  return getArray<pvInt64, pvd::int64>(arr, buf, count);
+        case pvTypeSTRING: return getStringArray(arr, buf, count);
+        default:           return 0;
+        }
+    }
+    return 0;
+}
+
+/* Convert the value and meta data of a pvAccess structure */
+static pvStat getRoot(pvPvaVar *pvar, pvType type, const pvd::PVStructure& root,
+    pvValue *value, unsigned *pCount)
+{
+    pvd::PVField::const_shared_pointer fld = valueField(root);
+
+    if (!fld) {
+        pvar->var->msg = "pvAccess: structure has no value field";
+        *pCount = 0;
+        return pvStatERROR;
+    }
+    try {
+        *pCount = getValue(simpleType(type), *fld, pv_value_ptr(value, type), *pCount);
+    } catch (std::exception&) {
+        pvar->var->msg = "pvAccess: value conversion failed";
+        *pCount = 0;
+        return pvStatERROR;
+    }
+    pvar->var->msg = NULL;
+    if (pv_is_time_type(type)) {
+        char *base = (char *)value;
+        unsigned n = pv_time_index(type);
+        pvd::PVInt::const_shared_pointer sevr = root.getSubField<pvd::PVInt>("alarm.severity");
+        pvd::PVLong::const_shared_pointer secs = root.getSubField<pvd::PVLong>("timeStamp.secondsPastEpoch");
+        pvd::PVInt::const_shared_pointer nsec = root.getSubField<pvd::PVInt>("timeStamp.nanoseconds");
+        epicsTimeStamp stamp = {0, 0};
+        epicsInt16 severity = sevr ? (epicsInt16)sevr->get() : 0;
+
+        if (secs && nsec && secs->get() > POSIX_TIME_AT_EPICS_EPOCH) {
+            stamp.secPastEpoch = (epicsUInt32)(secs->get() - POSIX_TIME_AT_EPICS_EPOCH);
+            stamp.nsec = (epicsUInt32)nsec->get();
+        }
+        /* pvAccess alarm.status is not an EPICS alarm condition, so we
+           can only tell whether there is an alarm or not */
+        *(epicsInt16 *)(base + pv_status_offsets[n]) = severity ? pvStatSOFT : pvStatOK;
+        *(epicsInt16 *)(base + pv_severity_offsets[n]) = severity;
+        *(epicsTimeStamp *)(base + pv_stamp_offsets[n]) = stamp;
+        if (severity)
+            pvar->var->msg = "pvAccess: alarm";
+    }
+    return pvStatOK;
+}
+
+/* pvString need not be nul terminated */
+static std::string fromPvString(const pvString& str)
+{
+    const char *end = (const char *)memchr(str, 0, sizeof(pvString));
+    return std::string(str, end ? end - str : sizeof(pvString));
+}
+
+template<typename PV, typename T>
+static void putArray(pvd::PVScalarArray& arr, const void *buf, unsigned count)
+{
+    pvd::shared_vector<T> data(count);
+    const PV *in = static_cast<const PV *>(buf);
+
+    for (unsigned i = 0; i < count; i++)
+        data[i] = (T)in[i];
+    arr.putFrom<T>(pvd::freeze(data));
+}
+
+static void putStringArray(pvd::PVScalarArray& arr, const void *buf, unsigned count)
+{
+    pvd::shared_vector<std::string> data(count);
+    const pvString *in = static_cast<const pvString *>(buf);
+
+    for (unsigned i = 0; i < count; i++)
+        data[i] = fromPvString(in[i]);
+    arr.putFrom<std::string>(pvd::freeze(data));
+}
+
+static void putScalar(pvType type, pvd::PVScalar& sca, const void *buf)
+{
+    switch (type) {
+    case pvTypeCHAR:   sca.putFrom<pvd::uint8>(*(const pvChar *)buf); break;
+    case pvTypeSHORT:  sca.putFrom<pvd::int16>(*(const pvShort *)buf); break;
+    case pvTypeLONG:   sca.putFrom<pvd::int32>(*(const pvLong *)buf); break;
+    case pvTypeFLOAT:  sca.putFrom<pvd::float32>(*(const pvFloat *)buf); break;
+    case pvTypeDOUBLE: sca.putFrom<pvd::float64>(*(const pvDouble *)buf); break;
+    case pvTypeINT64:  sca.putFrom<pvd::int64>(*(const pvInt64 *)buf); break;
+    case pvTypeSTRING: {
+        const pvString *in = static_cast<const pvString *>(buf);
+        sca.putFrom<std::string>(fromPvString(*in));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void putValue(pvType type, pvd::PVField& fld, const void *buf, unsigned count)
+{
+    if (fld.getField()->getType() == pvd::scalar) {
+        putScalar(type, static_cast<pvd::PVScalar&>(fld), buf);
+    } else if (fld.getField()->getType() == pvd::scalarArray) {
+        pvd::PVScalarArray& arr = static_cast<pvd::PVScalarArray&>(fld);
+        switch (type) {
+        case pvTypeCHAR:   putArray<pvChar, pvd::uint8>(arr, buf, count); break;
+        case pvTypeSHORT:  putArray<pvShort, pvd::int16>(arr, buf, count); break;
+        case pvTypeLONG:   putArray<pvLong, pvd::int32>(arr, buf, count); break;
+        case pvTypeFLOAT:  putArray<pvFloat, pvd::float32>(arr, buf, count); break;
+        case pvTypeDOUBLE: putArray<pvDouble, pvd::float64>(arr, buf, count); break;
+        case pvTypeINT64:  putArray<pvInt64, pvd::int64>(arr, buf, count); break;
+        case pvTypeSTRING: putStringArray(arr, buf, count); break;
+        default:           break;
+        }
+    }
+}
+
+void pvPvaVar::connectEvent(const pvac::ConnectEvent& evt)
+{
+    var->conn_handler(evt.connected, var->arg);
+}
+
+void pvPvaVar::monitorEvent(const pvac::MonitorEvent& evt)
+{
+    pvac::Monitor mon;
+
+    if (evt.event != pvac::MonitorEvent::Data)
+        return;     /* disconnects are reported via connectEvent */
+    {
+        /* wait until pvPvaVarMonitorOn has stored the handle */
+        Guard G(lock);
+        mon = monitor;
+    }
+    while (mon.poll()) {
+        unsigned count = monCount;
+        pvStat status = getRoot(this, monType, *mon.root, &monBuf[0], &count);
+        var->event_handler(pvEventMonitor, monArg, monType, count, &monBuf[0], status);
+    }
+}
+
+/* Delete completed requests; must not be called from a callback */
+void pvPvaVar::purge()
+{
+    std::list<pvPvaRequest *> old;
+    {
+        Guard G(lock);
+        old.swap(done);
+    }
+    for (std::list<pvPvaRequest *>::iterator it = old.begin(); it != old.end(); ++it)
+        delete *it;
+}
+
+/* Called at the end of a completion callback */
+void pvPvaRequest::finish()
+{
+    Guard G(pvar->lock);
+    std::list<pvPvaRequest *>::iterator it =
+        std::find(pvar->pending.begin(), pvar->pending.end(), this);
+
+    /* if it is no longer pending, pvPvaVarDestroy owns and deletes it */
+    if (it != pvar->pending.end()) {
+        pvar->pending.erase(it);
+        pvar->done.push_back(this);
+    }
+}
+
+void pvPvaRequest::getDone(const pvac::GetEvent& evt)
+{
+    pvVar *var = pvar->var;
+    unsigned n = count;
+    pvStat status = pvStatERROR;
+
+    if (evt.event == pvac::GetEvent::Success) {
+        status = getRoot(pvar, type, *evt.value, &value[0], &n);
+    } else {
+        var->msg = evt.event == pvac::GetEvent::Cancel ?
+            "pvAccess: get canceled" : "pvAccess: get failed";
+        n = 0;
+    }
+    var->event_handler(pvEventGet, arg, type, n, &value[0], status);
+    finish();
+}
+
+void pvPvaRequest::putBuild(const pvd::StructureConstPtr& build, pvac::PutCallback::Args& args)
+{
+    pvd::PVStructurePtr root(pvd::getPVDataCreate()->createPVStructure(build));
+    pvd::PVStructurePtr e = root->getSubField<pvd::PVStructure>("value");
+    pvd::PVFieldPtr fld = e ? e->getSubField("index") : root->getSubField("value");
+
+    if (!fld)
+        throw std::runtime_error("structure has no value field");
+    putValue(type, *fld, &value[0], count);
+    args.root = root;
+    args.tosend.set(fld->getFieldOffset());
+}
+
+void pvPvaRequest::putDone(const pvac::PutEvent& evt)
+{
+    pvVar *var = pvar->var;
+    pvStat status = pvStatOK;
+
+    if (evt.event != pvac::PutEvent::Success) {
+        status = pvStatERROR;
+        var->msg = evt.event == pvac::PutEvent::Cancel ?
+            "pvAccess: put canceled" : "pvAccess: put failed";
+    }
+    if (notify) {
+        /* like CA, put completion always has NULL value pointer */
+        var->event_handler(pvEventPut, arg, type, count, NULL, status);
+    } else if (status != pvStatOK) {
+        errlogSevPrintf(errlogMajor, "pvPut(%s): %s: %s\n",
+            pvar->channel.name().c_str(), var->msg, evt.message.c_str());
+    }
+    finish();
+}
+
+pvStat pvPvaSysCreate(pvSystem *pSys)
+{
+    pSys->pvaid = new (std::nothrow) pvPvaSystem;
+    if (!pSys->pvaid) {
+        pSys->msg = "pvPvaSysCreate: out of memory";
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+pvStat pvPvaSysDestroy(pvSystem *pSys)
+{
+    pvPvaSystem *pvasys = pSys->pvaid;
+
+    if (pvasys) {
+        /* all channels must have been destroyed */
+        delete pvasys->provider;
+        delete pvasys;
+        pSys->pvaid = NULL;
+    }
+    return pvStatOK;
+}
+
+pvStat pvPvaVarCreate(pvSystem sys, const char *name, pvVar *var)
+{
+    pvPvaSystem *pvasys = sys.pvaid;
+    pvPvaVar *pvar = NULL;
+
+    try {
+        {
+            Guard G(pvasys->lock);
+            if (!pvasys->provider)
+                pvasys->provider = new pvac::ClientProvider("pva");
+        }
+        pvar = new pvPvaVar(var);
+        pvar->channel = pvasys->provider->connect(name);
+        var->pvaid = pvar;
+        var->msg = NULL;
+        /* may call connectEvent immediately */
+        pvar->channel.addConnectListener(pvar);
+    } catch (std::exception& e) {
+        errlogSevPrintf(errlogMajor, "pvVarCreate(pva://%s): %s\n", name, e.what());
+        var->pvaid = NULL;
+        delete pvar;
+        var->msg = "pvAccess: cannot create channel";
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+pvStat pvPvaVarDestroy(pvVar *var)
+{
+    pvPvaVar *pvar = var->pvaid;
+    std::list<pvPvaRequest *> reqs;
+
+    /* waits for a running connection callback to finish */
+    pvar->channel.removeConnectListener(pvar);
+    pvPvaVarMonitorOff(var);
+    {
+        Guard G(pvar->lock);
+        reqs.swap(pvar->pending);
+    }
+    /* the completion callbacks no longer find these on the pending list,
+       so they will not move them to the done list */
+    for (std::list<pvPvaRequest *>::iterator it = reqs.begin(); it != reqs.end(); ++it) {
+        /* waits for a running completion callback to finish */
+        (*it)->op.cancel();
+        delete *it;
+    }
+    pvar->purge();
+    delete pvar;
+    *var = nullPvVar;
+    return pvStatOK;
+}
+
+static pvStat startRequest(pvVar *var, pvPvaRequest *req, bool put)
+{
+    pvPvaVar *pvar = var->pvaid;
+
+    pvar->purge();
+    try {
+        Guard G(pvar->lock);
+        /* add to pending first, the callback could happen immediately */
+        pvar->pending.push_back(req);
+        if (put)
+            req->op = pvar->channel.put(req);
+        else
+            req->op = pvar->channel.get(req);
+    } catch (std::exception& e) {
+        {
+            Guard G(pvar->lock);
+            pvar->pending.remove(req);
+        }
+        delete req;
+        var->msg = put ? "pvAccess: put failed" : "pvAccess: get failed";
+        errlogSevPrintf(errlogMajor, "%s(%s): %s\n", put ? "pvPut" : "pvGet",
+            pvar->channel.name().c_str(), e.what());
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+pvStat pvPvaVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    pvPvaRequest *req;
+
+    try {
+        req = new pvPvaRequest(var->pvaid, type, count, arg, true);
+    } catch (std::bad_alloc&) {
+        var->msg = "pvPvaVarGetCallback: out of memory";
+        return pvStatERROR;
+    }
+    return startRequest(var, req, false);
+}
+
+static pvStat putRequest(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg, bool notify)
+{
+    pvPvaRequest *req;
+
+    try {
+        req = new pvPvaRequest(var->pvaid, type, count, arg, notify);
+    } catch (std::bad_alloc&) {
+        var->msg = "pvVarPut: out of memory";
+        return pvStatERROR;
+    }
+    /* the put completes later, so we need a private copy */
+    memcpy(&req->value[0], value, req->value.size());
+    return startRequest(var, req, true);
+}
+
+pvStat pvPvaVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value)
+{
+    return putRequest(var, type, count, value, NULL, false);
+}
+
+pvStat pvPvaVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg)
+{
+    return putRequest(var, type, count, value, arg, true);
+}
+
+pvStat pvPvaVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg)
+{
+    pvPvaVar *pvar = var->pvaid;
+    std::ostringstream req;
+
+    if (var->pvamonid != NULL)
+        return pvStatOK;
+    req << "record[queueSize=" << (pvPvaQueueSize > 1 ? pvPvaQueueSize : 2)
+        << ",pipeline=true]field(value,alarm,timeStamp)";
+    try {
+        Guard G(pvar->lock);
+        pvar->monType = type;
+        pvar->monCount = count;
+        pvar->monArg = arg;
+        pvar->monBuf.assign(pv_size_n(type, count), 0);
+        pvar->monitor = pvar->channel.monitor(pvar, pvd::createRequest(req.str()));
+        var->pvamonid = pvar;
+    } catch (std::exception& e) {
+        var->msg = "pvAccess: monitor failed";
+        errlogSevPrintf(errlogMajor, "pvMonitor(%s): %s\n",
+            pvar->channel.name().c_str(), e.what());
+        return pvStatERROR;
+    }
+    return pvStatOK;
+}
+
+pvStat pvPvaVarMonitorOff(pvVar *var)
+{
+    pvPvaVar *pvar = var->pvaid;
+    pvac::Monitor mon;
+
+    if (var->pvamonid == NULL)
+        return pvStatOK;
+    {
+        Guard G(pvar->lock);
+        mon = pvar->monitor;
+        pvar->monitor = pvac::Monitor();
+    }
+    /* waits until a running monitor callback has finished */
+    mon.cancel();
+    var->pvamonid = NULL;
+    return pvStatOK;
+}
+
+unsigned pvPvaVarGetCount(pvVar *var)
+{
+    /* pvAccess arrays have no fixed size; the client's count is the limit */
+    return UINT_MAX;
+}
@@ -0,0 +1,41 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Private definitions for the pvAccess provider of the pv library.
+ *
+ * Channels whose name starts with "pva://" are served by the pvAccess
+ * client (pvac) instead of CA. This header is not installed; it is only
+ * used by pv.c and pvPva.cpp.
+ */
+#ifndef INCLpvPvah
+#define INCLpvPvah
+
+#include "pv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Create the (lazily initialized) pvAccess part of a pvSystem */
+pvStat pvPvaSysCreate(pvSystem *pSys);
+
+/* Destroy it again, including the pvAccess client provider */
+pvStat pvPvaSysDestroy(pvSystem *pSys);
+
+/* Create a pvAccess channel (name without the "pva://" prefix) */
+pvStat pvPvaVarCreate(pvSystem sys, const char *name, pvVar *var);
+
+pvStat pvPvaVarDestroy(pvVar *var);
+pvStat pvPvaVarGetCallback(pvVar *var, pvType type, unsigned count, void *arg);
+pvStat pvPvaVarPutNoBlock(pvVar *var, pvType type, unsigned count, pvValue *value);
+pvStat pvPvaVarPutCallback(pvVar *var, pvType type, unsigned count, pvValue *value, void *arg);
+pvStat pvPvaVarMonitorOn(pvVar *var, pvType type, unsigned count, void *arg);
+pvStat pvPvaVarMonitorOff(pvVar *var);
+unsigned pvPvaVarGetCount(pvVar *var);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLpvPvah */
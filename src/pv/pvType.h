@@ -13,6 +13,7 @@ in the file LICENSE that is included with this distribution.
 
 #include "epicsTime.h"		/* for time stamps */
 #include "epicsTypes.h"
+#include "epicsVersion.h"
 
 #include "pvAlarm.h"		/* status and severity definitions */
 
@@ -32,7 +33,10 @@ typedef enum {
     pvTypeTIME_LONG   = 8,
     pvTypeTIME_FLOAT  = 9,
     pvTypeTIME_DOUBLE = 10,
-    pvTypeTIME_STRING = 11
+    pvTypeTIME_STRING = 11,
+    /* appended so that the numbers above stay compatible */
+    pvTypeINT64       = 12,
+    pvTypeTIME_INT64  = 13
 } pvType;
 
 /* these must correspond to corresponding types in db_access.h */
@@ -42,25 +46,37 @@ typedef epicsInt32      pvLong;     /* dbr_long_t   */
 typedef epicsFloat32    pvFloat;    /* dbr_float_t  */
 typedef epicsFloat64    pvDouble;   /* dbr_double_t */
 typedef epicsOldString  pvString;   /* dbr_string_t */
+#if EPICS_VERSION > 3 || (EPICS_VERSION == 3 && EPICS_REVISION >= 15)
+typedef epicsInt64      pvInt64;    /* no CA type, needs pvAccess or db */
+#else
+typedef long long       pvInt64;    /* epicsInt64 needs base 3.15 */
+#endif
 
 typedef void            pvValue;    /* abstract */
 
 #define pv_is_simple_type(type)\
-    ((type)>=pvTypeCHAR&&(type)<=pvTypeSTRING)
+    (((type)>=pvTypeCHAR&&(type)<=pvTypeSTRING)||(type)==pvTypeINT64)
 #define pv_is_time_type(type)\
-    ((type)>=pvTypeTIME_CHAR&&(type)<=pvTypeTIME_STRING)
+    (((type)>=pvTypeTIME_CHAR&&(type)<=pvTypeTIME_STRING)||(type)==pvTypeTIME_INT64)
 #define pv_is_valid_type(type)\
-    ((type)>=pvTypeCHAR&&(type)<=pvTypeTIME_STRING)
+    ((type)>=pvTypeCHAR&&(type)<=pvTypeTIME_INT64)
+
+/* simple type corresponding to a time type */
+#define pv_simple_type(type)\
+    ((type)==pvTypeTIME_INT64?pvTypeINT64:(pvType)((type)-pvTypeTIME_CHAR))
+/* index into pv_status_offsets etc. for a time type */
+#define pv_time_index(type)\
+    ((type)==pvTypeTIME_INT64?6:(type)-pvTypeTIME_CHAR)
 
 #define pv_status(pv,type)\
     (assert(pv_is_time_type(type)),\
-    (pvStat)*(epicsInt16 *)(((char *)pv)+pv_status_offsets[(type)-pvTypeTIME_CHAR]))
+    (pvStat)*(epicsInt16 *)(((char *)pv)+pv_status_offsets[pv_time_index(type)]))
 #define pv_severity(pv,type)\
     (assert(pv_is_time_type(type)),\
-    (pvSevr)*(epicsInt16 *)(((char *)pv)+pv_severity_offsets[(type)-pvTypeTIME_CHAR]))
+    (pvSevr)*(epicsInt16 *)(((char *)pv)+pv_severity_offsets[pv_time_index(type)]))
 #define pv_stamp(pv,type)\
     (assert(pv_is_time_type(type)),\
-    *(epicsTimeStamp *)(((char *)pv)+pv_stamp_offsets[(type)-pvTypeTIME_CHAR]))
+    *(epicsTimeStamp *)(((char *)pv)+pv_stamp_offsets[pv_time_index(type)]))
 
 #define pv_value_ptr(pv,type)\
     (assert(pv_is_valid_type(type)),(void *)(((char *)pv)+pv_value_offsets[type]))
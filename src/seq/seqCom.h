@@ -123,6 +123,12 @@ epicsShareFunc void epicsShareAPI seqChanShow(epicsThreadId, const char *);
 epicsShareFunc void epicsShareAPI seqcar(int level);
 epicsShareFunc void epicsShareAPI seqQueueShow(epicsThreadId);
 epicsShareFunc void epicsShareAPI seqStop(epicsThreadId);
+epicsShareFunc void epicsShareAPI seqTrace(int on);
+epicsShareFunc void epicsShareAPI seqTraceDump(epicsThreadId, const char *file);
+epicsShareFunc void epicsShareAPI seqStatsShow(epicsThreadId, int level);
+epicsShareFunc void epicsShareAPI seqLatency(epicsThreadId, const char *pattern, int on);
+epicsShareFunc void epicsShareAPI seqLatencyShow(epicsThreadId, const char *pattern);
+epicsShareFunc void epicsShareAPI seqLatencyDump(epicsThreadId, const char *file);
 epicsShareFunc epicsThreadId epicsShareAPI seq(seqProgram *, const char *, unsigned);
 
 /* backwards compatibility macros */
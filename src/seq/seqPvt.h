@@ -42,9 +42,18 @@ in the file LICENSE that is included with this distribution.
 #define valPtr(ch,ss)		((char*)(ss)->var+(ch)->offset)
 #define bufPtr(ch)		((char*)(ch)->prog->var+(ch)->offset)
 
+/* Maximum number of (striped) locks for channel buffers */
+#define MAX_VAR_LOCKS		64
+
+/* Assumed size of a cache line */
+#define CACHE_LINE_SIZE		64
+
 #define ssNum(ss)		((ss)-(ss)->prog->ss)
 #define chNum(ch)		((ch)-(ch)->prog->chan)
 
+/* whether state set ss uses channel number nch (safe mode only) */
+#define ssUsesChan(ss,nch)	(!(ss)->chanMask || bitTest((ss)->chanMask, nch))
+
 #define metaPtr(ch,ss) (			\
 	(ch)->dbch				\
 	?(optTest((ch)->prog,OPT_SAFE)		\
@@ -53,6 +62,11 @@ in the file LICENSE that is included with this distribution.
 	:0					\
 )
 
+/* Monotonic time in nanoseconds, see seq_time.c */
+typedef unsigned long long seqTime;
+#define SEQ_TIME_INF		(~(seqTime)0)
+#define seq_time_to_sec(t)	((double)(t) * 1e-9)
+
 #define optTest(sp,opt)		(((sp)->options & (opt)) != 0)
 					/* test if opt is set in program instance sp */
 
@@ -83,6 +97,12 @@ typedef struct program_instance	PROG;
 typedef struct pvreq		PVREQ;
 typedef const struct pv_type	PVTYPE;
 typedef struct pv_meta_data	PVMETA;
+typedef struct trace_rec	TRACE_REC;
+typedef struct timing		TIMING;
+typedef struct trans_stats	TRANS_STATS;
+typedef struct ss_stats		SS_STATS;
+typedef struct latency		LATENCY;
+typedef struct report		REPORT;
 
 typedef struct seqg_vars        SEQ_VARS;
 
@@ -105,7 +125,11 @@ struct channel
 	boolean		monitored;	/* whether channel is monitored */
 	/* buffer access, only used in safe mode */
 	epicsMutexId	varLock;	/* mutex for locking access to shared
-					   var buffer and meta data */
+					   var buffer and meta data (one of
+					   prog->varLocks) */
+	char		*varNames;	/* names of all elements of a compact
+					   array entry (first element only) */
+	LATENCY		*latency;	/* monitor latency, NULL if never enabled */
 };
 
 struct pv_type
@@ -136,6 +160,52 @@ struct db_channel
 	PVMETA		metaData;	/* meta data (shared buffer) */
 };
 
+/* Number of histogram buckets; bucket n > 0 counts durations
+   in [2^(n-1),2^n) microseconds, the last one all longer ones */
+#define STATS_BUCKETS		20
+/* Transitions per state that are accounted separately */
+#define STATS_TRANS		16
+
+/* Accumulated durations of some activity */
+struct timing
+{
+	unsigned long	count;		/* number of times */
+	double		total;		/* total time (seconds) */
+	double		max;		/* maximum time (seconds) */
+	unsigned long	hist[STATS_BUCKETS];	/* log2 histogram */
+};
+
+/* Accumulated duration of the action of one transition */
+struct trans_stats
+{
+	unsigned long	count;		/* number of times triggered */
+	double		total;		/* total action time (seconds) */
+};
+
+/* Run-time statistics of a state set, see seq_stats.c */
+struct ss_stats
+{
+	unsigned long	entries;	/* number of state entries */
+	unsigned long	wakeups;	/* number of wakeups (after entry) */
+	unsigned long	idleWakeups;	/* wakeups that triggered no transition */
+	TIMING		event;		/* evaluation of when conditions */
+	TIMING		action;		/* transition actions */
+	TIMING		sync;		/* blocked in synchronous pvGet/pvPut */
+	TRANS_STATS	*trans;		/* per state and transition number */
+	unsigned long	spinWakeups;	/* woken while busy-polling */
+	unsigned long	spinMisses;	/* busy-polled in vain, then blocked */
+	double		cpuTime;	/* thread CPU time (seconds), <0 if unknown */
+};
+
+/* Monitor latency of a channel, see seq_stats.c */
+struct latency
+{
+	boolean		on;		/* whether currently measuring */
+	TIMING		callback;	/* time stamp to monitor arrival */
+	TIMING		wakeup;		/* arrival to state set wakeup */
+	TIMING		reaction;	/* arrival to end of transition */
+};
+
 struct state_set
 {
 	SEQ_VARS	*var;		/* variable value block */
@@ -143,6 +213,9 @@ struct state_set
 	/* static state set data (assigned once on startup) */
 	const char	*ssName;	/* state set name (for debugging) */
 	epicsThreadId	threadId;	/* thread id */
+	unsigned	threadPriority;	/* thread priority */
+	unsigned	stackSize;	/* stack size */
+	const char	*affinity;	/* CPU list, or NULL for any CPU */
 	unsigned	numStates;	/* number of states */
 	STATE		*states;	/* ptr to array of state blocks */
 	PROG		*prog;		/* ptr back to state program block */
@@ -152,20 +225,57 @@ struct state_set
 	int		nextState;	/* next state index, -1 if none */
 	int		prevState;	/* previous state index, -1 if none */
 	const bitMask	*mask;		/* current event mask */
-	double		timeEntered;	/* time that current state was entered */
-	double		wakeupTime;	/* next time state set should wake up */
+	bitMask		*dynMask;	/* run-time computed event mask and
+					   scratch space (NULL if not needed) */
+	seqTime		timeEntered;	/* time that current state was entered */
+	seqTime		wakeupTime;	/* next time state set should wake up */
+	seqTime		evalTime;	/* time when conditions are evaluated */
 	epicsEventId	syncSem;	/* semaphore for event sync */
+	seqTime		spinTime;	/* max. busy-poll before blocking, or 0 */
+	int		wakeFlag;	/* set by ss_signal (atomic, spin mode) */
+	int		spinning;	/* busy-polling wakeFlag (atomic) */
+	int		connPending;	/* woken for connection change (atomic) */
 	epicsEventId	dead;		/* event to signal state set exit done */
 	/* these are arrays, one for each channel */
-	PVREQ		**getReq;	/* currently pending get requests */
-	PVREQ		**putReq;	/* currently pending put requests */
+	PVREQ		**getReq;	/* currently pending get requests (atomic) */
+	PVREQ		**putReq;	/* currently pending put requests (atomic) */
 	PVMETA		*metaData;	/* meta data (safe mode) */
 	/* safe mode */
 	boolean		*dirty;		/* array of flags, one for each channel */
+	const seqMask	*chanMask;	/* channels used by this state set
+					   (NULL if it may use any) */
+	/* tracing */
+	TRACE_REC	*trace;		/* ring buffer of trace records */
+	unsigned	traceSize;	/* number of records (a power of 2) */
+	int		traceNext;	/* running number of next record */
+	/* statistics */
+	SS_STATS	stats;
+	/* monitor latency (protected by prog->latLock) */
+	CHAN		*latChan;	/* instrumented channel that woke us */
+	seqTime		latArrival;	/* time its monitor arrived */
+	boolean		latWoken;	/* wakeup already accounted */
 };
 
 STATIC_ASSERT(offsetof(struct state_set,var)==0);
 
+/* Places that report run-time errors rate-limited, see seq_report.c */
+enum report_site {
+	REPORT_QUEUE_OVERFLOW,		/* monitor found syncq queue full */
+	REPORT_ANON_QUEUE_OVERFLOW,	/* anonymous pvPut found queue full */
+	REPORT_DISCONNECT_TWICE,	/* disconnect while disconnected */
+	REPORT_CONNECT_TWICE,		/* connect while connected */
+	REPORT_PENDING_TIMEOUT,		/* sync request waited for pending one */
+	REPORT_ALREADY_PENDING,		/* async request while one is pending */
+	NUM_REPORT_SITES
+};
+
+struct report
+{
+	int		count;		/* events since last summary (atomic) */
+	int		total;		/* events since program start (atomic) */
+	void		*last;		/* name of object of last event */
+};
+
 struct program_instance
 {
 	SEQ_VARS	*var;		/* user variable area (shared buffer) */
@@ -173,9 +283,10 @@ struct program_instance
 	/* static program data (assigned once on startup) */
 	const char	*progName;	/* program name (for messages) */
 	int		instance;	/* program instance number */
-	unsigned	threadPriority;	/* thread priority (all threads) */
-	unsigned	stackSize;	/* stack size (all threads) */
+	unsigned	threadPriority;	/* default thread priority */
+	unsigned	stackSize;	/* default stack size */
 	pvSystem	pvSys;		/* pv system handle */
+	unsigned	pvSysNum;	/* which of the CA contexts it is */
 	CHAN		*chan;		/* table of channels */
 	unsigned	numChans;	/* number of channels */
 	QUEUE		*queues;	/* array of syncQ queues */
@@ -183,6 +294,8 @@ struct program_instance
 	SSCB		*ss;		/* array of state set control blocks */
 	unsigned	numSS;		/* number of state sets */
 	size_t		varSize;	/* size of user variable area */
+	size_t		sharedSize;	/* size of shared buffer sp->var (may be
+					   less than varSize in safe mode) */
 	MACRO		*macros;	/* ptr to macro table */
 	char		*params;	/* program parameters */
 	unsigned	options;	/* options (bit-encoded) */
@@ -190,22 +303,29 @@ struct program_instance
 	SEQ_SS_FUNC	*entryFunc;	/* entry function */
 	SEQ_SS_FUNC	*exitFunc;	/* exit function */
 	unsigned	numEvFlags;	/* number of event flags */
+	epicsMutexId	*varLocks;	/* striped locks for channel buffers */
+	unsigned	numVarLocks;	/* number of varLocks */
 
 	/* dynamic program data (assigned at runtime) */
-	epicsMutexId	lock;	/* mutex for locking dynamic program data */
-	/* the following five members must always be protected by lock */
+	epicsMutexId	lock;	/* mutex for structural changes (pvAssign,
+				   pvSync, connection state of channels) */
+	epicsMutexId	latLock;	/* mutex for monitor latency data */
+	CHAN		**syncedChans;	/* for each event flag, start of synced
+					   list (changed and read holding lock) */
+	/* the following members are accessed with seq_atomic/seq_mask
+	   operations (see seq_atomic.c) */
 	bitMask		*evFlags;	/* event bits for event flags & channels */
-	CHAN		**syncedChans;	/* for each event flag, start of synced list */
-	unsigned	assignCount;	/* number of channels assigned to ext. pv */
-	unsigned	connectCount;	/* number of channels connected */
-	unsigned	monitorCount;	/* number of channels monitored */
-	unsigned	gotMonitorCount;/* number of monitored channels that got
+	int		assignCount;	/* number of channels assigned to ext. pv */
+	int		connectCount;	/* number of channels connected */
+	int		monitorCount;	/* number of channels monitored */
+	int		gotMonitorCount;/* number of monitored channels that got
 					   a monitor event */
 
 	void		*pvReqPool;	/* freeList for pv requests (has own lock) */
 	boolean		die;		/* flag set when seqStop is called */
 	epicsEventId	ready;		/* all channels connected & got 1st monitor */
 	epicsEventId	dead;		/* event to signal exit of main thread done */
+	REPORT		report[NUM_REPORT_SITES];	/* error reports */
 	PROG		*next;		/* next element in program list */
 };
 
@@ -218,6 +338,35 @@ struct pvreq
 	SSCB		*ss;		/* state set that made the request */
 };
 
+/* Types of trace records */
+enum trace_type {
+	TRACE_STATE,		/* state entered; arg=previous state */
+	TRACE_TRANS,		/* transition triggered; arg=transNum */
+	TRACE_WAKEUP,		/* woken up; arg=event number,
+				   aux=1 for connection change */
+	TRACE_TIMEOUT,		/* woken up by delay timeout */
+	TRACE_GET,		/* get request; arg=channel, aux=compType */
+	TRACE_GET_DONE,		/* get completed; arg=channel, aux=status */
+	TRACE_PUT,		/* put request; arg=channel, aux=compType */
+	TRACE_PUT_DONE		/* put completed; arg=channel, aux=status */
+};
+
+/* Trace record, see seq_trace.c */
+struct trace_rec
+{
+	epicsTimeStamp	stamp;		/* time of the event */
+	unsigned	seqNo;		/* running number */
+	epicsUInt8	type;		/* enum trace_type */
+	epicsUInt8	aux;		/* type specific */
+	epicsUInt16	state;		/* current state */
+	unsigned	arg;		/* type specific */
+};
+
+/* Record a trace event; costs only a test if tracing is off */
+#define ssTrace(ss,type,aux,arg) \
+	if (!seqTraceEnabled || !(ss)->trace) ; \
+	else seq_trace_rec(ss, type, aux, arg)
+
 /* Thread parameters */
 #define THREAD_NAME_SIZE	32
 #define THREAD_STACK_SIZE	epicsThreadStackBig
@@ -227,10 +376,56 @@ struct pvreq
 
 /* seq_task.c */
 void sequencer(void *arg);
-void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify);
+void ss_write_buffer(CHAN *ch, DBCHAN *dbch, void *val, PVMETA *meta,
+	boolean dirtify);
 void ss_read_buffer(SSCB *ss, CHAN *ch, boolean dirty_only);
 void ss_read_buffer_selective(PROG *sp, SSCB *ss, EF_ID ev_flag);
 void ss_wakeup(PROG *sp, unsigned eventNum);
+void ss_wakeup_chan(PROG *sp, CHAN *ch, boolean chanEvent, EF_ID ev_flag);
+void ss_wakeup_conn(PROG *sp);
+void ss_signal(SSCB *ss);
+
+/* seq_trace.c */
+extern int seqTraceEnabled;
+extern int seqTraceSize;
+boolean seq_trace_init(SSCB *ss);
+void seq_trace_rec(SSCB *ss, unsigned type, unsigned aux, unsigned arg);
+
+/* seq_stats.c */
+boolean seq_stats_init(SSCB *ss);
+void seq_stats_time(TIMING *t, double dt);
+void seq_stats_trans(SSCB *ss, int transNum, double dt);
+void seq_stats_cpu(SSCB *ss);
+void seq_latency_arrival(CHAN *ch, pvType type, pvValue *value);
+void seq_latency_wakeup(SSCB *ss, seqTime woken, boolean triggered);
+void seq_latency_reaction(SSCB *ss, seqTime done);
+
+/* seq_report.c */
+epicsShareExtern double seqReportInterval;
+epicsShareFunc boolean seq_report(PROG *sp, int site, const char *name);
+epicsShareFunc void seq_report_flush(PROG *sp);
+void seq_report_show(PROG *sp);
+
+/* seq_time.c */
+seqTime seq_time_now(void);
+seqTime seq_time_from_sec(double sec);
+seqTime seq_time_add(seqTime t, seqTime d);
+
+/* seq_atomic.c */
+int seq_atomic_add(int *p, int delta);
+int seq_atomic_get(int *p);
+int seq_atomic_cas(int *p, int oldVal, int newVal);
+void *seq_atomic_get_ptr(void **p);
+void seq_atomic_set_ptr(void **p, void *val);
+void *seq_atomic_cas_ptr(void **p, void *oldVal, void *newVal);
+void *seq_atomic_swap_ptr(void **p, void *newVal);
+void seq_mask_set(bitMask *words, unsigned bitnum);
+boolean seq_mask_clear(bitMask *words, unsigned bitnum);
+boolean seq_mask_test(bitMask *words, unsigned bitnum);
+void seq_mask_clear_all(bitMask *words, const bitMask *mask, unsigned nwords);
+
+/* seq_affinity.c */
+void seq_set_affinity(SSCB *ss);
 
 /* seq_mac.c */
 void seqMacParse(PROG *sp, const char *macStr);
@@ -244,6 +439,8 @@ pvEventFunc seq_event_handler;
 pvStat seq_connect(PROG *sp, boolean wait);
 void seq_disconnect(PROG *sp);
 pvStat seq_camonitor(CHAN *ch, boolean on);
+boolean seq_check_type(CHAN *ch, DBCHAN *dbch, const char *what);
+void seq_drop_channel(CHAN *ch, DBCHAN *dbch);
 
 /* seq_prog.c */
 typedef int seqTraversee(PROG *prog, void *param);
@@ -256,6 +453,7 @@ void seqAddProg(PROG *sp);
 /* seqCommands.c */
 typedef int sequencerProgramTraversee(PROG **prog, seqProgram *pseq, void *param);
 int traverseSequencerPrograms(sequencerProgramTraversee *traversee, void *param);
+extern int seqCaContexts;
 void createOrAttachPvSystem(PROG *sp);
 
 /* seq_main.c */
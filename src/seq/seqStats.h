@@ -13,6 +13,31 @@ epicsShareFunc void seqGatherStats(
     unsigned *num_connected
 );
 
+/* Run-time statistics, summed over all state sets of all programs */
+typedef struct seqTimingStats {
+    unsigned long entries;      /* number of state entries */
+    unsigned long wakeups;      /* number of state set wakeups (after entry) */
+    unsigned long idleWakeups;  /* wakeups that triggered no transition */
+    unsigned long transitions;  /* number of transitions */
+    double eventTime;           /* seconds spent in when conditions */
+    double actionTime;          /* seconds spent in transition actions */
+    double syncTime;            /* seconds blocked in synchronous pvGet/pvPut */
+    double cpuTime;             /* thread CPU time (where the OS reports it) */
+} seqTimingStats;
+
+epicsShareFunc void seqGatherTimingStats(seqTimingStats *stats);
+
+/* syncQ counters, summed over all queues of all programs */
+typedef struct seqQueueStats {
+    unsigned numQueues;         /* number of queues */
+    unsigned numOverflowed;     /* queues that dropped elements */
+    unsigned long puts;         /* elements put */
+    unsigned long gets;         /* elements taken */
+    unsigned long drops;        /* elements lost due to overflow */
+} seqQueueStats;
+
+epicsShareFunc void seqGatherQueueStats(seqQueueStats *stats);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,96 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                CPU affinity for state set threads
+\*************************************************************************/
+/*
+ * EPICS base has no portable interface for binding a thread to a set of
+ * CPUs, so this is done directly with sched_setaffinity on Linux. On
+ * other targets a configured affinity is reported and otherwise ignored.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "seq.h"
+
+#if defined(__linux__) && defined(CPU_SETSIZE)
+#define HAVE_AFFINITY
+#endif
+
+#ifdef HAVE_AFFINITY
+/*
+ * Parse a CPU list like "2", "0-3" or "0,2,4-7" into a cpu set.
+ */
+static boolean parse_cpu_list(const char *str, cpu_set_t *cpus)
+{
+	CPU_ZERO(cpus);
+	for (;;)
+	{
+		char		*end;
+		unsigned long	first, last, n;
+
+		first = last = strtoul(str, &end, 10);
+		if (end == str)
+			return FALSE;
+		str = end;
+		if (*str == '-')
+		{
+			str++;
+			last = strtoul(str, &end, 10);
+			if (end == str || last < first)
+				return FALSE;
+			str = end;
+		}
+		if (last >= CPU_SETSIZE)
+			return FALSE;
+		for (n = first; n <= last; n++)
+			CPU_SET(n, cpus);
+		if (*str == '\0')
+			return TRUE;
+		if (*str != ',')
+			return FALSE;
+		str++;
+	}
+}
+#endif
+
+/*
+ * seq_set_affinity() - Bind the calling state set thread to the CPUs
+ * configured for its state set (if any).
+ */
+void seq_set_affinity(SSCB *ss)
+{
+#ifdef HAVE_AFFINITY
+	cpu_set_t	cpus;
+
+	if (!ss->affinity)
+		return;
+	if (!parse_cpu_list(ss->affinity, &cpus))
+	{
+		errlogSevPrintf(errlogMajor,
+			"seq_set_affinity(ss %s): invalid CPU list \"%s\" (ignored)\n",
+			ss->ssName, ss->affinity);
+		return;
+	}
+	if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+	{
+		errlogSevPrintf(errlogMajor,
+			"seq_set_affinity(ss %s): sched_setaffinity failed: %s\n",
+			ss->ssName, strerror(errno));
+	}
+#else
+	if (ss->affinity)
+		errlogSevPrintf(errlogMinor,
+			"seq_set_affinity(ss %s): not supported on this target (ignored)\n",
+			ss->ssName);
+#endif
+}
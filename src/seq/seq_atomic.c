@@ -0,0 +1,207 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Atomic operations on shared program data
+\*************************************************************************/
+/*
+ * Event flags, the channel counters and the pending request slots of
+ * the state sets are used by pv callbacks and all state sets at the
+ * same time. They are accessed through the functions below instead of
+ * being protected by the program lock, so that a burst of callbacks for
+ * one channel does not stall unrelated state sets.
+ *
+ * With EPICS base 3.15 or later these are epicsAtomic operations. Older
+ * versions of base have no atomics, so they are emulated with a single
+ * global mutex that is held only for the operation itself.
+ */
+#include "seq.h"
+
+#include "epicsVersion.h"
+
+#if EPICS_VERSION > 3 || (EPICS_VERSION == 3 && EPICS_REVISION >= 15)
+#include "epicsAtomic.h"
+#define HAVE_ATOMIC
+#else
+static epicsThreadOnceId atomicOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId atomicLock;
+
+static void atomic_init(void *arg)
+{
+	atomicLock = epicsMutexMustCreate();
+}
+
+static void atomic_lock(void)
+{
+	epicsThreadOnce(&atomicOnce, atomic_init, NULL);
+	epicsMutexMustLock(atomicLock);
+}
+
+#define atomic_unlock() epicsMutexUnlock(atomicLock)
+#endif
+
+/* Add delta to *p and return the new value */
+int seq_atomic_add(int *p, int delta)
+{
+#ifdef HAVE_ATOMIC
+	return epicsAtomicAddIntT(p, delta);
+#else
+	int result;
+
+	atomic_lock();
+	result = *p += delta;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+int seq_atomic_get(int *p)
+{
+#ifdef HAVE_ATOMIC
+	return epicsAtomicGetIntT(p);
+#else
+	int result;
+
+	atomic_lock();
+	result = *p;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+/* Set *p to newVal if it is oldVal; return the previous value */
+int seq_atomic_cas(int *p, int oldVal, int newVal)
+{
+#ifdef HAVE_ATOMIC
+	return epicsAtomicCmpAndSwapIntT(p, oldVal, newVal);
+#else
+	int result;
+
+	atomic_lock();
+	result = *p;
+	if (result == oldVal)
+		*p = newVal;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+void *seq_atomic_get_ptr(void **p)
+{
+#ifdef HAVE_ATOMIC
+	return epicsAtomicGetPtrT(p);
+#else
+	void *result;
+
+	atomic_lock();
+	result = *p;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+void seq_atomic_set_ptr(void **p, void *val)
+{
+#ifdef HAVE_ATOMIC
+	epicsAtomicSetPtrT(p, val);
+#else
+	atomic_lock();
+	*p = val;
+	atomic_unlock();
+#endif
+}
+
+/* Set *p to newVal if it is oldVal; return the previous value */
+void *seq_atomic_cas_ptr(void **p, void *oldVal, void *newVal)
+{
+#ifdef HAVE_ATOMIC
+	return epicsAtomicCmpAndSwapPtrT(p, oldVal, newVal);
+#else
+	void *result;
+
+	atomic_lock();
+	result = *p;
+	if (result == oldVal)
+		*p = newVal;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+/* Set *p to newVal; return the previous value */
+void *seq_atomic_swap_ptr(void **p, void *newVal)
+{
+#ifdef HAVE_ATOMIC
+	void *result;
+
+	do {
+		result = epicsAtomicGetPtrT(p);
+	} while (epicsAtomicCmpAndSwapPtrT(p, result, newVal) != result);
+	return result;
+#else
+	void *result;
+
+	atomic_lock();
+	result = *p;
+	*p = newVal;
+	atomic_unlock();
+	return result;
+#endif
+}
+
+/*
+ * Event bits: a word is updated with compare-and-swap, so concurrent
+ * changes of other bits in the same word are not lost.
+ */
+static int *mask_word(bitMask *words, unsigned bitnum)
+{
+	return (int *)(words + bitnum/NBITS);
+}
+
+void seq_mask_set(bitMask *words, unsigned bitnum)
+{
+	int	*p = mask_word(words, bitnum);
+	int	bit = (int)(1u<<(bitnum%NBITS));
+	int	old;
+
+	do {
+		old = seq_atomic_get(p);
+	} while ((old & bit) == 0 && seq_atomic_cas(p, old, old | bit) != old);
+}
+
+/* Clear a bit and return whether it was set */
+boolean seq_mask_clear(bitMask *words, unsigned bitnum)
+{
+	int	*p = mask_word(words, bitnum);
+	int	bit = (int)(1u<<(bitnum%NBITS));
+	int	old;
+
+	do {
+		old = seq_atomic_get(p);
+	} while ((old & bit) != 0 && seq_atomic_cas(p, old, old & ~bit) != old);
+	return (old & bit) != 0;
+}
+
+boolean seq_mask_test(bitMask *words, unsigned bitnum)
+{
+	return (seq_atomic_get(mask_word(words, bitnum))
+		& (int)(1u<<(bitnum%NBITS))) != 0;
+}
+
+/* Clear all bits of words that are set in mask */
+void seq_mask_clear_all(bitMask *words, const bitMask *mask, unsigned nwords)
+{
+	unsigned i;
+
+	for (i = 0; i < nwords; i++)
+	{
+		int	*p = (int *)(words + i);
+		int	bits = (int)mask[i];
+		int	old;
+
+		do {
+			old = seq_atomic_get(p);
+		} while ((old & bits) != 0 && seq_atomic_cas(p, old, old & ~bits) != old);
+	}
+}
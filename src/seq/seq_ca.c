@@ -37,10 +37,11 @@ static void proc_db_events(
 	pvValue		*value,	/* ptr to value */
 	pvType		type,	/* type of value */
 	CHAN		*ch,	/* channel object */
-	SSCB		*ss,	/* originator, for put and get, else 0 */
+	PVREQ		*rq,	/* request, for put and get, else 0 */
 	pvEventType	evtype,	/* put, get, or monitor */
 	pvStat		status	/* status from pv layer */
 );
+static void check_ready(PROG *sp);
 
 /*
  * seq_connect() - Initiate connect & monitor requests to PVs.
@@ -81,6 +82,10 @@ pvStat seq_connect(PROG *sp, boolean wait)
 			free(ch->dbch);
 			continue;
 		}
+		if (!seq_check_type(ch, dbch, "seq_connect"))
+		{
+			seq_drop_channel(ch, dbch);
+		}
 	}
 	pvSysFlush(sp->pvSys);
 
@@ -97,12 +102,10 @@ pvStat seq_connect(PROG *sp, boolean wait)
 			if (sp->die)
 				return pvStatERROR;
 
-			epicsMutexMustLock(sp->lock);
-			ac = sp->assignCount;
-			mc = sp->monitorCount;
-			cc = sp->connectCount;
-			gmc = sp->gotMonitorCount;
-			epicsMutexUnlock(sp->lock);
+			ac = seq_atomic_get(&sp->assignCount);
+			mc = seq_atomic_get(&sp->monitorCount);
+			cc = seq_atomic_get(&sp->connectCount);
+			gmc = seq_atomic_get(&sp->gotMonitorCount);
 
 			ready = ac == cc && mc == gmc;
 			if (!ready)
@@ -150,10 +153,13 @@ static void seq_get_handler(
 	SSCB	*ss = rq->ss;
 	PROG	*sp = ch->prog;
 
-	freeListFree(sp->pvReqPool, arg);
+	ssTrace(ss, TRACE_GET_DONE, (unsigned)status, (unsigned)chNum(ch));
 	/* ignore callback if not expected, e.g. already timed out */
-	if (ss->getReq[chNum(ch)] == rq)
-		proc_db_events(value, type, ch, ss, pvEventGet, status);
+	if (seq_atomic_get_ptr((void **)(ss->getReq + chNum(ch))) == rq)
+		proc_db_events(value, type, ch, rq, pvEventGet, status);
+	/* free only now, so that a new request cannot reuse its address
+	   while the slot is still compared against it */
+	freeListFree(sp->pvReqPool, arg);
 }
 
 /*
@@ -168,10 +174,11 @@ static void seq_put_handler(
 	SSCB	*ss = rq->ss;
 	PROG	*sp = ch->prog;
 
-	freeListFree(sp->pvReqPool, arg);
+	ssTrace(ss, TRACE_PUT_DONE, (unsigned)status, (unsigned)chNum(ch));
 	/* ignore callback if not expected, e.g. already timed out */
-	if (ss->putReq[chNum(ch)] == rq)
-		proc_db_events(value, type, ch, ss, pvEventPut, status);
+	if (seq_atomic_get_ptr((void **)(ss->putReq + chNum(ch))) == rq)
+		proc_db_events(value, type, ch, rq, pvEventPut, status);
+	freeListFree(sp->pvReqPool, arg);
 }
 
 /*
@@ -182,20 +189,32 @@ static void seq_mon_handler(
 {
 	CHAN	*ch = (CHAN *)arg;
 	PROG	*sp = ch->prog;
+	DBCHAN	*dbch;
 
+	if (ch->latency && ch->latency->on)
+		seq_latency_arrival(ch, type, status == pvStatOK ? value : NULL);
 	proc_db_events(value, type, ch, 0, pvEventMonitor, status);
-	epicsMutexMustLock(sp->lock);
-	if (ch->dbch && !ch->dbch->gotMonitor)
+	dbch = (DBCHAN *)seq_atomic_get_ptr((void **)&ch->dbch);
+	if (dbch && seq_atomic_cas(&dbch->gotMonitor, FALSE, TRUE) == FALSE)
 	{
-		ch->dbch->gotMonitor = TRUE;
-		sp->gotMonitorCount++;
-		if (sp->gotMonitorCount == sp->monitorCount
-			&& sp->connectCount == sp->assignCount)
-		{
-			epicsEventSignal(sp->ready);
-		}
+		seq_atomic_add(&sp->gotMonitorCount, 1);
+		check_ready(sp);
+	}
+}
+
+/*
+ * check_ready() - Signal sp->ready if all channels are connected and
+ * all monitored ones got their first monitor event. Called after each
+ * change of the counters; of two concurrent changes, at least one of
+ * the callers sees the effect of the other.
+ */
+static void check_ready(PROG *sp)
+{
+	if (seq_atomic_get(&sp->gotMonitorCount) == seq_atomic_get(&sp->monitorCount)
+		&& seq_atomic_get(&sp->connectCount) == seq_atomic_get(&sp->assignCount))
+	{
+		epicsEventSignal(sp->ready);
 	}
-	epicsMutexUnlock(sp->lock);
 }
 
 /*
@@ -226,10 +245,19 @@ struct putq_cp_arg {
 static void *putq_cp(void *dest, const void *src, size_t elemSize)
 {
 	struct putq_cp_arg *arg = (struct putq_cp_arg *)src;
-	CHAN *ch = arg->ch;
 
-	return memcpy(dest, arg->value,
-		pv_size_n(ch->type->getType, ch->dbch->dbCount));
+	return memcpy(dest, arg->value, elemSize);
+}
+
+/*
+ * Clear the slot of a completed request, unless the request has been
+ * cancelled (and maybe replaced by a new one) in the meantime, then
+ * wake up the state set that is waiting for it.
+ */
+static void complete_request(PVREQ **slot, PVREQ *rq)
+{
+	seq_atomic_cas_ptr((void **)slot, rq, NULL);
+	ss_signal(rq->ss);
 }
 
 /* Common code for completion and monitor handling */
@@ -237,23 +265,26 @@ static void proc_db_events(
 	pvValue		*value,
 	pvType		type,
 	CHAN		*ch,
-	SSCB		*ss,
+	PVREQ		*rq,
 	pvEventType	evtype,
 	pvStat		status
 )
 {
 	PROG	*sp = ch->prog;
+	EF_ID	ev_flag = ch->syncedTo;
+	boolean	wakeChan = FALSE;
+	DBCHAN	*dbch;
 	static const char *event_type_name[] = {"get","put","mon"};
 
-	epicsMutexMustLock(sp->lock);
-
-	if (!ch->dbch) {
-		epicsMutexUnlock(sp->lock);
+	/* No lock needed: pvAssign resets ch->dbch before it destroys the
+	   pv, which waits for callbacks that are in progress. Read it only
+	   once, it may be reset any time. */
+	dbch = (DBCHAN *)seq_atomic_get_ptr((void **)&ch->dbch);
+	if (!dbch)
 		return;
-	}
 
 	DEBUG("proc_db_events: var=%s, pv=%s, type=%s, status=%d\n", ch->varName,
-		ch->dbch->dbName, event_type_name[evtype], status);
+		dbch->dbName, event_type_name[evtype], status);
 
 	/* monitor on var queued via syncQ */
 	if (ch->queue && evtype == pvEventMonitor)
@@ -262,17 +293,19 @@ static void proc_db_events(
 		struct putq_cp_arg arg = {ch, value};
 
 		DEBUG("proc_db_events: var=%s, pv=%s, queue=%p, used(max)=%d(%d)\n",
-			ch->varName, ch->dbch->dbName,
+			ch->varName, dbch->dbName,
 			ch->queue, seqQueueUsed(ch->queue), seqQueueNumElems(ch->queue));
 		/* Copy whole message into queue; no need to lock against other
 		   writers, because named and anonymous PVs are disjoint. */
-		full = seqQueuePutF(ch->queue, putq_cp, &arg);
-		if (full)
+		full = seqQueuePutSizeF(ch->queue,
+			pv_size_n(ch->type->getType, dbch->dbCount), putq_cp, &arg);
+		if (full && seq_report(sp, REPORT_QUEUE_OVERFLOW, ch->varName))
 		{
 			errlogSevPrintf(errlogMinor,
 			  "monitor event for variable '%s' (pv '%s'): "
-			  "last queue element overwritten (queue is full)\n",
-			  ch->varName, ch->dbch->dbName
+			  "queue is full (policy %s)\n",
+			  ch->varName, dbch->dbName,
+			  seqQueuePolicyName(seqQueueGetPolicy(ch->queue))
 			);
 		}
 	}
@@ -293,42 +326,40 @@ static void proc_db_events(
 		/* Set error message only when severity indicates error */
 		if (meta.severity != pvSevrNONE)
 		{
-			const char *pmsg = pvVarGetMess(ch->dbch->pvid);
+			const char *pmsg = pvVarGetMess(dbch->pvid);
 			if (!pmsg) pmsg = "unknown";
 			meta.message = pmsg;
 		}
 
 		/* Write value and meta data to shared buffers.
 		   Set the dirty flag only if this was a monitor event. */
-		ss_write_buffer(ch, val, &meta, evtype == pvEventMonitor);
+		ss_write_buffer(ch, dbch, val, &meta, evtype == pvEventMonitor);
 	}
 
 	/* Signal completion */
 	switch (evtype)
 	{
 	case pvEventPut:
-		ss->putReq[chNum(ch)] = NULL;
-		epicsEventSignal(ss->syncSem);
+		complete_request(rq->ss->putReq + chNum(ch), rq);
 		break;
 	case pvEventGet:
-		ss->getReq[chNum(ch)] = NULL;
-		epicsEventSignal(ss->syncSem);
-		if (optTest(sp, OPT_SAFE))
-			break;
-		/* else: fall through */
+		complete_request(rq->ss->getReq + chNum(ch), rq);
+		/* In safe mode the effects of get events are local to the
+		   state set, so no other state set needs to be woken. */
+		wakeChan = !optTest(sp, OPT_SAFE);
+		break;
 	case pvEventMonitor:
-		/* Wake up each state set that uses this channel in a when condition. */
-		/* In safe mode this is only necessary for monitor events, since the
-		   effects of get events are local to the state set. */
-		ss_wakeup(sp, ch->eventNum);
+		wakeChan = TRUE;
 		break;
 	}
 
-	/* If there's an event flag associated with this channel, set it */
-	if (ch->syncedTo)
-		seq_efSet(sp->ss, ch->syncedTo);
-
-	epicsMutexUnlock(sp->lock);
+	/* Set the event flag associated with this channel (if any), then
+	   wake up each state set that uses this channel in a when condition
+	   or waits for the event flag, in a single pass. */
+	if (ev_flag)
+		seq_mask_set(sp->evFlags, ev_flag);
+	if (wakeChan || ev_flag)
+		ss_wakeup_chan(sp, ch, wakeChan, ev_flag);
 }
 
 /* Disconnect all database channels */
@@ -377,7 +408,7 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 	dbch = ch->dbch;
 	assert(dbch);
 	done = turn_on == pvMonIsDefined(dbch->pvid);
-	dbch->gotMonitor = FALSE;
+	seq_atomic_cas(&dbch->gotMonitor, TRUE, FALSE);
 	epicsMutexUnlock(sp->lock);
 
 	if (done)
@@ -395,9 +426,7 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 	else
 	{
 		status = pvVarMonitorOff(&dbch->pvid);
-		epicsMutexMustLock(sp->lock);
-		sp->gotMonitorCount -= 1;
-		epicsMutexUnlock(sp->lock);
+		seq_atomic_add(&sp->gotMonitorCount, -1);
 	}
 	if (status != pvStatOK)
 		errlogSevPrintf(errlogFatal, "seq_camonitor: pvVarMonitor%s(var '%s', pv '%s') failure: %s\n",
@@ -405,6 +434,51 @@ pvStat seq_camonitor(CHAN *ch, boolean turn_on)
 	return status;
 }
 
+/*
+ * seq_check_type() - Check that the pv layer can transfer values of
+ * the channel's type. CA has no 64 bit integer type, so (u)int64_t
+ * variables must be assigned to a local record or a "pva://" channel.
+ */
+boolean seq_check_type(CHAN *ch, DBCHAN *dbch, const char *what)
+{
+	if (ch->type->putType != pvTypeINT64
+		|| pvVarIsLocal(dbch->pvid) || pvVarIsPva(dbch->pvid))
+		return TRUE;
+	errlogSevPrintf(errlogFatal, "%s(var '%s', pv '%s'): 64 bit integers "
+		"are not supported by CA, use a local record or the prefix "
+		PV_PREFIX_PVA "\n", what, ch->varName, dbch->dbName);
+	return FALSE;
+}
+
+/*
+ * seq_drop_channel() - Destroy a channel that was just created and
+ * leave the variable unassigned. Must be called without sp->lock held.
+ */
+void seq_drop_channel(CHAN *ch, DBCHAN *dbch)
+{
+	PROG	*sp = ch->prog;
+	boolean	connected;
+
+	seq_atomic_set_ptr((void **)&ch->dbch, NULL);
+	/* waits for a running connection callback */
+	pvVarDestroy(&dbch->pvid);
+
+	epicsMutexMustLock(sp->lock);
+	seq_atomic_add(&sp->assignCount, -1);
+	connected = dbch->connected;
+	if (connected)
+	{
+		dbch->connected = FALSE;
+		seq_atomic_add(&sp->connectCount, -1);
+	}
+	epicsMutexUnlock(sp->lock);
+
+	free(dbch->dbName);
+	free(dbch);
+	if (connected)
+		ss_wakeup_conn(sp);
+}
+
 /*
  * seq_conn_handler() - Sequencer connection handler.
  * Called each time a connection is established or broken.
@@ -431,24 +505,32 @@ void seq_conn_handler(int connected, void *arg)
 			unsigned nss;
 
 			dbch->connected = FALSE;
-			sp->connectCount--;
+			seq_atomic_add(&sp->connectCount, -1);
 
 			if (ch->monitored)
 			{
 				seq_camonitor(ch, FALSE);
 			}
-			/* terminate outstanding requests that wait for completion */
-			/* TODO: can there be a race condition with pvPut/pvGet? */
+			/* Terminate outstanding requests that wait for completion,
+			   and wake up the state sets that made them. The others
+			   are woken by ss_wakeup_conn (below) if they wait for
+			   connection changes. The exchange makes sure that each
+			   request is cancelled only once, even if a completion
+			   callback or pvGetCancel/pvPutCancel runs concurrently. */
 			for (nss = 0; nss < sp->numSS; nss++)
 			{
-				SSCB *ss = sp->ss + nss;
-
-				ss->getReq[chNum(ch)] = NULL;
-				ss->putReq[chNum(ch)] = NULL;
-				epicsEventSignal(ss->syncSem);
+				SSCB	*ss = sp->ss + nss;
+				boolean	pending = FALSE;
+
+				if (seq_atomic_swap_ptr((void **)(ss->getReq + chNum(ch)), NULL))
+					pending = TRUE;
+				if (seq_atomic_swap_ptr((void **)(ss->putReq + chNum(ch)), NULL))
+					pending = TRUE;
+				if (pending)
+					ss_signal(ss);
 			}
 		}
-		else
+		else if (seq_report(sp, REPORT_DISCONNECT_TWICE, ch->varName))
 		{
 			errlogSevPrintf(errlogMinor,
 				"seq_conn_handler(var '%s', pv '%s'): "
@@ -463,12 +545,8 @@ void seq_conn_handler(int connected, void *arg)
 		{
 			unsigned dbCount;
 			dbch->connected = TRUE;
-			sp->connectCount++;
-			if (sp->gotMonitorCount == sp->monitorCount
-				&& sp->connectCount == sp->assignCount)
-			{
-				epicsEventSignal(sp->ready);
-			}
+			seq_atomic_add(&sp->connectCount, 1);
+			check_ready(sp);
 			assert(pvVarIsDefined(dbch->pvid));
 			dbCount = pvVarGetCount(&dbch->pvid);
 			assert(dbCount >= 0);
@@ -479,7 +557,7 @@ void seq_conn_handler(int connected, void *arg)
 				seq_camonitor(ch, TRUE);
 			}
 		}
-		else
+		else if (seq_report(sp, REPORT_CONNECT_TWICE, ch->varName))
 		{
 			errlogSevPrintf(errlogMinor,
 				"seq_conn_handler: var '%s', pv '%s': "
@@ -489,10 +567,9 @@ void seq_conn_handler(int connected, void *arg)
 	}
 	epicsMutexUnlock(sp->lock);
 
-	/* Wake up each state set that is waiting for event processing.
-	   Why each one? Because pvConnectCount and pvMonitorCount should
-	   act like monitored anonymous channels. Any state set might be
-	   using these functions inside a when-condition and it is expected
-	   that such conditions get checked whenever these counts change. */
-	ss_wakeup(sp, 0);
+	/* Wake up the state sets that wait for connection changes.
+	   pvConnectCount etc. should act like monitored anonymous
+	   channels: conditions using them are expected to get checked
+	   whenever these counts change. */
+	ss_wakeup_conn(sp);
 }
@@ -25,14 +25,20 @@ struct sequencerProgram {
     struct sequencerProgram *next;
 };
 
+/* Maximum number of CA client contexts */
+#define MAX_PV_SYSTEMS 64
+
 /* These are the only global variables in the whole seq library. */
 static struct
 {
     epicsMutexId lock;
     struct sequencerProgram *programs;
-    pvSystem pvSys;
+    pvSystem pvSys[MAX_PV_SYSTEMS];
 } globals;
 
+/* Number of CA client contexts that programs are distributed over */
+int seqCaContexts = 1;
+
 static void seqInitPvt(void *arg)
 {
     globals.lock = epicsMutexCreate();
@@ -48,19 +54,56 @@ static void seqLazyInit()
     epicsThreadOnce(&seqOnceFlag, seqInitPvt, NULL);
 }
 
+/*
+ * Choose the CA client context for a program: the one given by the
+ * program parameter "ca_context", or else one that depends on the
+ * program name and instance number, so that different programs (and
+ * different instances of the same program) are spread evenly.
+ */
+static unsigned choosePvSystem(struct program_instance *sp)
+{
+    unsigned num = (unsigned)seqCaContexts;
+    unsigned hash = 2166136261u;
+    const char *str, *p;
+
+    if (num < 1)
+        num = 1;
+    if (num > MAX_PV_SYSTEMS)
+        num = MAX_PV_SYSTEMS;
+    str = seqMacValGet(sp, "ca_context");
+    if (str && str[0] != '\0') {
+        unsigned n = 0;
+        sscanf(str, "%u", &n);
+        return n % num;
+    }
+    /* FNV-1a */
+    for (p = sp->progName; *p; p++)
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    hash = (hash ^ (unsigned)sp->instance) * 16777619u;
+    return hash % num;
+}
+
+/*
+ * Attach the calling thread to the CA client context of the program,
+ * creating it if this is the first thread that uses it. The context is
+ * chosen by the first state set thread of the program.
+ */
 void createOrAttachPvSystem(struct program_instance *sp)
 {
     seqLazyInit();
     epicsMutexMustLock(globals.lock);
-    if (!pvSysIsDefined(globals.pvSys)) {
-        pvStat status = pvSysCreate(&globals.pvSys);
+    if (!pvSysIsDefined(sp->pvSys)) {
+        sp->pvSysNum = choosePvSystem(sp);
+    }
+    if (!pvSysIsDefined(globals.pvSys[sp->pvSysNum])) {
+        pvStat status = pvSysCreate(&globals.pvSys[sp->pvSysNum]);
         if (status != pvStatOK) {
             errlogPrintf("getPvSystem: pvSysCreate() failure\n");
         }
     } else {
-        pvSysAttach(globals.pvSys);
+        pvSysAttach(globals.pvSys[sp->pvSysNum]);
     }
-    sp->pvSys = globals.pvSys;
+    sp->pvSys = globals.pvSys[sp->pvSysNum];
     epicsMutexUnlock(globals.lock);
 }
 
@@ -240,6 +283,115 @@ static void seqcarCallFunc(const iocshArgBuf *args)
     seqcar(args[0].ival);
 }
 
+/* seqTrace */
+static const iocshArg seqTraceArg0 = { "on/off",iocshArgInt};
+static const iocshArg * const seqTraceArgs[1] = {&seqTraceArg0};
+static const iocshFuncDef seqTraceFuncDef = {"seqTrace",1,seqTraceArgs};
+static void seqTraceCallFunc(const iocshArgBuf *args)
+{
+    seqTrace(args[0].ival);
+}
+
+/* seqTraceDump */
+static const iocshArg seqTraceDumpArg0 = { "program/threadID",iocshArgString};
+static const iocshArg seqTraceDumpArg1 = { "file",iocshArgString};
+static const iocshArg * const seqTraceDumpArgs[2] = {&seqTraceDumpArg0,&seqTraceDumpArg1};
+static const iocshFuncDef seqTraceDumpFuncDef = {"seqTraceDump",2,seqTraceDumpArgs};
+static void seqTraceDumpCallFunc(const iocshArgBuf *args)
+{
+    epicsThreadId id;
+    char *name = args[0].sval;
+    char *file = args[1].sval;
+
+    if ((name != NULL) && ((id = findThread(name)) != NULL))
+        seqTraceDump(id, file);
+    else {
+        printf("No sequencer task specified.\n");
+        seqShow(NULL);
+    }
+}
+
+/* seqStatsShow */
+static const iocshArg seqStatsShowArg0 = { "program/threadID",iocshArgString};
+static const iocshArg seqStatsShowArg1 = { "level",iocshArgInt};
+static const iocshArg * const seqStatsShowArgs[2] = {&seqStatsShowArg0,&seqStatsShowArg1};
+static const iocshFuncDef seqStatsShowFuncDef = {"seqStatsShow",2,seqStatsShowArgs};
+static void seqStatsShowCallFunc(const iocshArgBuf *args)
+{
+    epicsThreadId id;
+    char *name = args[0].sval;
+
+    if (name == NULL)
+        seqStatsShow(NULL, args[1].ival);
+    else if ((id = findThread(name)) != NULL)
+        seqStatsShow(id, args[1].ival);
+}
+
+/* seqLatency */
+static const iocshArg seqLatencyArg0 = { "program/threadID",iocshArgString};
+static const iocshArg seqLatencyArg1 = { "pattern",iocshArgString};
+static const iocshArg seqLatencyArg2 = { "on",iocshArgInt};
+static const iocshArg * const seqLatencyArgs[3] = {&seqLatencyArg0,&seqLatencyArg1,&seqLatencyArg2};
+static const iocshFuncDef seqLatencyFuncDef = {"seqLatency",3,seqLatencyArgs};
+static void seqLatencyCallFunc(const iocshArgBuf *args)
+{
+    epicsThreadId id;
+    char *name = args[0].sval;
+
+    if ((name != NULL) && ((id = findThread(name)) != NULL))
+        seqLatency(id, args[1].sval, args[2].ival);
+    else {
+        printf("No sequencer task specified.\n");
+        seqShow(NULL);
+    }
+}
+
+/* seqLatencyShow */
+static const iocshArg seqLatencyShowArg0 = { "program/threadID",iocshArgString};
+static const iocshArg seqLatencyShowArg1 = { "pattern",iocshArgString};
+static const iocshArg * const seqLatencyShowArgs[2] = {&seqLatencyShowArg0,&seqLatencyShowArg1};
+static const iocshFuncDef seqLatencyShowFuncDef = {"seqLatencyShow",2,seqLatencyShowArgs};
+static void seqLatencyShowCallFunc(const iocshArgBuf *args)
+{
+    epicsThreadId id;
+    char *name = args[0].sval;
+
+    if ((name != NULL) && ((id = findThread(name)) != NULL))
+        seqLatencyShow(id, args[1].sval);
+    else {
+        printf("No sequencer task specified.\n");
+        seqShow(NULL);
+    }
+}
+
+/* seqLatencyDump */
+static const iocshArg seqLatencyDumpArg0 = { "program/threadID",iocshArgString};
+static const iocshArg seqLatencyDumpArg1 = { "file",iocshArgString};
+static const iocshArg * const seqLatencyDumpArgs[2] = {&seqLatencyDumpArg0,&seqLatencyDumpArg1};
+static const iocshFuncDef seqLatencyDumpFuncDef = {"seqLatencyDump",2,seqLatencyDumpArgs};
+static void seqLatencyDumpCallFunc(const iocshArgBuf *args)
+{
+    epicsThreadId id;
+    char *name = args[0].sval;
+
+    if ((name != NULL) && ((id = findThread(name)) != NULL))
+        seqLatencyDump(id, args[1].sval);
+    else {
+        printf("No sequencer task specified.\n");
+        seqShow(NULL);
+    }
+}
+
+/* Variables */
+static const iocshVarDef seqVarDefs[] = {
+    {"seqDbProvider", iocshArgInt, &pvDbProviderEnable},
+    {"seqPvaQueueSize", iocshArgInt, &pvPvaQueueSize},
+    {"seqTraceSize", iocshArgInt, &seqTraceSize},
+    {"seqCaContexts", iocshArgInt, &seqCaContexts},
+    {"seqReportInterval", iocshArgDouble, &seqReportInterval},
+    {NULL, iocshArgInt, NULL}
+};
+
 /*
  * This routine is called before multitasking has started, so there's
  * no race condition in the test/set of firstTime.
@@ -255,5 +407,12 @@ epicsShareFunc void seqRegisterSequencerCommands(void)
         iocshRegister(&seqStopFuncDef,seqStopCallFunc);
         iocshRegister(&seqChanShowFuncDef,seqChanShowCallFunc);
         iocshRegister(&seqcarFuncDef,seqcarCallFunc);
+        iocshRegister(&seqTraceFuncDef,seqTraceCallFunc);
+        iocshRegister(&seqTraceDumpFuncDef,seqTraceDumpCallFunc);
+        iocshRegister(&seqStatsShowFuncDef,seqStatsShowCallFunc);
+        iocshRegister(&seqLatencyFuncDef,seqLatencyCallFunc);
+        iocshRegister(&seqLatencyShowFuncDef,seqLatencyShowCallFunc);
+        iocshRegister(&seqLatencyDumpFuncDef,seqLatencyDumpCallFunc);
+        iocshRegisterVariable(seqVarDefs);
     }
 }
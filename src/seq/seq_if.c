@@ -91,30 +91,31 @@ static pvStat check_pending(
 				call, varName, tmo);
 			return pvStatERROR;
 		}
-		while (*req)
+		while (seq_atomic_get_ptr((void **)req))
 		{
 			/* a request is already pending (must be an async request) */
-			double before, after;
+			seqTime before, after;
 			pvStat status;
 
-			pvTimeGetCurrentDouble(&before);
+			before = seq_time_now();
 			switch (epicsEventWaitWithTimeout(ss->syncSem, tmo))
 			{
 			case epicsEventWaitOK:
 				status = check_connected(dbch, meta);
 				if (status != pvStatOK)
 					return status;
-				pvTimeGetCurrentDouble(&after);
-				tmo -= (after - before);
+				after = seq_time_now();
+				tmo -= seq_time_to_sec(after - before);
 				if (tmo > 0.0)
 					break;
 				/* else: fall through to timeout */
 			case epicsEventWaitTimeout:
-				errlogSevPrintf(errlogMajor,
-					"%s(ss %s, var %s, pv %s): failed (timeout "
-					"waiting for other %s requests to finish)\n",
-					call, ss->ssName, varName, dbch->dbName, call
-				);
+				if (seq_report(ss->prog, REPORT_PENDING_TIMEOUT, varName))
+					errlogSevPrintf(errlogMajor,
+						"%s(ss %s, var %s, pv %s): failed (timeout "
+						"waiting for other %s requests to finish)\n",
+						call, ss->ssName, varName, dbch->dbName, call
+					);
 				completion_timeout(evtype, meta);
 				return meta->status;
 			case epicsEventWaitError:
@@ -127,13 +128,14 @@ static pvStat check_pending(
 	}
 	else if (compType == ASYNC)
 	{
-		if (*req) {
-			errlogSevPrintf(errlogMajor,
-				"%s(ss %s, var %s, pv %s): user error "
-				"(there is already a %s pending for this channel/"
-				"state set combination)\n",
-				call, ss->ssName, varName, dbch->dbName, call
-			);
+		if (seq_atomic_get_ptr((void **)req)) {
+			if (seq_report(ss->prog, REPORT_ALREADY_PENDING, varName))
+				errlogSevPrintf(errlogMajor,
+					"%s(ss %s, var %s, pv %s): user error "
+					"(there is already a %s pending for this channel/"
+					"state set combination)\n",
+					call, ss->ssName, varName, dbch->dbName, call
+				);
 			return pvStatERROR;
 		}
 	}
@@ -149,24 +151,34 @@ static pvStat wait_complete(
 	double tmo)
 {
 	const char *call = evtype == pvEventGet ? "pvGet" : "pvPut";
-	while (*req)
+	pvStat status = pvStatOK;
+	seqTime start, end;
+
+	start = seq_time_now();
+	while (seq_atomic_get_ptr((void **)req))
 	{
 		switch (epicsEventWaitWithTimeout(ss->syncSem, tmo))
 		{
 		case epicsEventWaitOK:
 			break;
 		case epicsEventWaitTimeout:
-			*req = NULL;			/* cancel the request */
+			seq_atomic_set_ptr((void **)req, NULL);	/* cancel the request */
 			completion_timeout(evtype, meta);
-			return meta->status;
+			status = meta->status;
+			break;
 		case epicsEventWaitError:
 			errlogSevPrintf(errlogFatal,
 				"%s: epicsEventWaitWithTimeout() failure\n", call);
-			*req = NULL;			/* cancel the request */
+			seq_atomic_set_ptr((void **)req, NULL);	/* cancel the request */
 			completion_failure(evtype, meta);
-			return meta->status;
+			status = meta->status;
+			break;
 		}
 	}
+	end = seq_time_now();
+	seq_stats_time(&ss->stats.sync, seq_time_to_sec(end - start));
+	if (status != pvStatOK)
+		return status;
 	return check_connected(dbch, meta);
 }
 
@@ -225,7 +237,9 @@ epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType,
 	req->ch = ch;
 
 	assert(ss->getReq[chId] == NULL);
-	ss->getReq[chId] = req;
+	seq_atomic_set_ptr((void **)(ss->getReq + chId), req);
+
+	ssTrace(ss, TRACE_GET, compType, chId);
 
 	/* Perform the PV get operation with a callback routine specified.
 	   Requesting more than db channel has available is ok. */
@@ -240,7 +254,7 @@ epicsShareFunc pvStat seq_pvGetTmo(SS_ID ss, CH_ID chId, enum compType compType,
 		errlogSevPrintf(errlogFatal,
 			"pvGet(var %s, pv %s): pvVarGetCallback() failure: %s\n",
 			ch->varName, dbch->dbName, pvVarGetMess(dbch->pvid));
-		ss->getReq[chId] = NULL;	/* cancel the request */
+		seq_atomic_set_ptr((void **)(ss->getReq + chId), NULL);	/* cancel the request */
 		freeListFree(sp->pvReqPool, req);
 		check_connected(dbch, meta);
 		return status;
@@ -281,7 +295,7 @@ epicsShareFunc boolean seq_pvGetComplete(
 				ch->varName);
 		return TRUE;
 	}
-	else if (!ss->getReq[chId])
+	else if (!seq_atomic_get_ptr((void **)(ss->getReq + chId)))
 	{
 		pvStat status = check_connected(ch->dbch, metaPtr(ch,ss));
 		if (status == pvStatOK && optTest(sp, OPT_SAFE))
@@ -351,7 +365,7 @@ epicsShareFunc void seq_pvGetCancel(
 	}
 	else
 	{
-		ss->getReq[chId] = NULL;	/* cancel the request */
+		seq_atomic_set_ptr((void **)(ss->getReq + chId), NULL);	/* cancel the request */
 	}
 }
 
@@ -406,13 +420,13 @@ static void anonymous_put(SS_ID ss, CHAN *ch)
 		   callbacks, because anonymous and named PVs are disjoint. */
 		epicsMutexMustLock(ch->varLock);
 
-		full = seqQueuePutF(queue, putq_cp, &arg);
-		if (full)
+		full = seqQueuePutSizeF(queue, pv_size_n(type, ch->count), putq_cp, &arg);
+		if (full && seq_report(ss->prog, REPORT_ANON_QUEUE_OVERFLOW, ch->varName))
 		{
 			errlogSevPrintf(errlogMinor,
 			  "pvPut on queued channel '%s' (anonymous): "
-			  "last queue element overwritten (queue is full)\n",
-			  ch->varName
+			  "queue is full (policy %s)\n",
+			  ch->varName, seqQueuePolicyName(seqQueueGetPolicy(queue))
 			);
 		}
 
@@ -421,7 +435,7 @@ static void anonymous_put(SS_ID ss, CHAN *ch)
 	else
 	{
 		/* Set dirty flag only if monitored */
-		ss_write_buffer(ch, var, 0, ch->monitored);
+		ss_write_buffer(ch, NULL, var, 0, ch->monitored);
 	}
 	/* If there's an event flag associated with this channel, set it */
 	if (ch->syncedTo)
@@ -485,6 +499,8 @@ epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType,
 	   than db count) */
 	count = dbch->dbCount;
 
+	ssTrace(ss, TRACE_PUT, compType, chId);
+
 	/* Perform the PV put operation (either non-blocking or with a
 	   callback routine specified) */
 	if (compType == DEFAULT)
@@ -510,7 +526,7 @@ epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType,
 		req->ch = ch;
 
 		assert(ss->putReq[chId] == NULL);
-		ss->putReq[chId] = req;
+		seq_atomic_set_ptr((void **)(ss->putReq + chId), req);
 
 		status = pvVarPutCallback(
 				&dbch->pvid,		/* PV id */
@@ -523,7 +539,7 @@ epicsShareFunc pvStat seq_pvPutTmo(SS_ID ss, CH_ID chId, enum compType compType,
 			pv_call_failure(dbch, meta, status);
 			errlogSevPrintf(errlogFatal, "pvPut(var %s, pv %s): pvVarPutCallback() failure: %s\n",
 				ch->varName, dbch->dbName, pvVarGetMess(dbch->pvid));
-			ss->putReq[chId] = NULL;	/* cancel the request */
+			seq_atomic_set_ptr((void **)(ss->putReq + chId), NULL);	/* cancel the request */
 			freeListFree(sp->pvReqPool, req);
 			check_connected(dbch, meta);
 			return status;
@@ -572,7 +588,7 @@ static boolean seq_pvSinglePutComplete(
 				ch->varName);
 		return TRUE;
 	}
-	else if (!ss->putReq[chId])
+	else if (!seq_atomic_get_ptr((void **)(ss->putReq + chId)))
 	{
 		check_connected(ch->dbch, metaPtr(ch,ss));
 		return TRUE;
@@ -636,7 +652,7 @@ epicsShareFunc void seq_pvPutCancel(
 	}
 	else
 	{
-		ss->putReq[chId] = NULL;	/* cancel the request */
+		seq_atomic_set_ptr((void **)(ss->putReq + chId), NULL);	/* cancel the request */
 	}
 }
 
@@ -680,6 +696,7 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 	CHAN	*ch = sp->chan + chId;
 	pvStat	status = pvStatOK;
 	DBCHAN	*dbch;
+	boolean	disconnected = FALSE;
 
 	if (!pvName) pvName = "";
 
@@ -691,7 +708,7 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 
 	if (dbch)	/* was assigned to a named PV */
 	{
-		ch->dbch = 0;
+		seq_atomic_set_ptr((void **)&ch->dbch, NULL);
 
 		epicsMutexUnlock(sp->lock);
 
@@ -699,12 +716,13 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 
 		epicsMutexMustLock(sp->lock);
 
-		sp->assignCount--;
+		seq_atomic_add(&sp->assignCount, -1);
 
 		if (dbch->connected)	/* see connection handler */
 		{
 			dbch->connected = FALSE;
-			sp->connectCount--;
+			seq_atomic_add(&sp->connectCount, -1);
+			disconnected = TRUE;
 
 			/* Must not call seq_camonitor(ch, FALSE), it would give an
 			error because channel is already dead. pvVarDestroy takes
@@ -751,7 +769,7 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 			epicsMutexUnlock(sp->lock);
 			return pvStatERROR;
 		}
-		ch->dbch = dbch;
+		seq_atomic_set_ptr((void **)&ch->dbch, dbch);
 
 		status = pvVarCreate(
 			sp->pvSys,		/* PV system context */
@@ -769,12 +787,26 @@ epicsShareFunc pvStat seq_pvAssign(SS_ID ss, CH_ID chId, const char *pvName)
 		}
 		else
 		{
-			sp->assignCount++;
+			seq_atomic_add(&sp->assignCount, 1);
+			if (!seq_check_type(ch, dbch, "pvAssign"))
+			{
+				/* no other pvAssign must find it */
+				seq_atomic_set_ptr((void **)&ch->dbch, NULL);
+				epicsMutexUnlock(sp->lock);
+				seq_drop_channel(ch, dbch);
+				if (disconnected)
+					ss_wakeup_conn(sp);
+				return pvStatERROR;
+			}
 		}
 	}
 
 	epicsMutexUnlock(sp->lock);
 
+	/* the connection handler is not called for the destroyed channel */
+	if (disconnected)
+		ss_wakeup_conn(sp);
+
 	return status;
 }
 
@@ -877,6 +909,9 @@ epicsShareFunc void seq_pvArraySync(SS_ID ss, CH_ID chId, unsigned length, EF_ID
 
 	assert(new_ev_flag >= 0 && new_ev_flag <= sp->numEvFlags);
 
+	/* Readers of the lists hold the lock, too (see ss_read_buffer_selective):
+	   one that is at a channel while it moves would continue in the new
+	   list and miss the rest of the old one. */
 	epicsMutexMustLock(sp->lock);
 	for (n=0; n<length; n++)
 	{
@@ -893,7 +928,6 @@ epicsShareFunc void seq_pvArraySync(SS_ID ss, CH_ID chId, unsigned length, EF_ID
 				if (ch == this_ch)		/* first in list */
 				{
 					sp->syncedChans[old_ev_flag] = this_ch->nextSynced;
-					ch->nextSynced = 0;
 				}
 				else
 				{
@@ -911,8 +945,8 @@ epicsShareFunc void seq_pvArraySync(SS_ID ss, CH_ID chId, unsigned length, EF_ID
 			{
 				/* insert it into the new list */
 				CHAN *ch = sp->syncedChans[new_ev_flag];
-				sp->syncedChans[new_ev_flag] = this_ch;
 				this_ch->nextSynced = ch;
+				sp->syncedChans[new_ev_flag] = this_ch;
 			}
 		}
 	}
@@ -932,7 +966,7 @@ epicsShareFunc unsigned seq_pvChannelCount(SS_ID ss)
  */
 epicsShareFunc unsigned seq_pvConnectCount(SS_ID ss)
 {
-	return ss->prog->connectCount;
+	return (unsigned)seq_atomic_get(&ss->prog->connectCount);
 }
 
 /*
@@ -940,7 +974,7 @@ epicsShareFunc unsigned seq_pvConnectCount(SS_ID ss)
  */
 epicsShareFunc unsigned seq_pvAssignCount(SS_ID ss)
 {
-	return ss->prog->assignCount;
+	return (unsigned)seq_atomic_get(&ss->prog->assignCount);
 }
 
 /* Flush outstanding PV requests */
@@ -1063,15 +1097,11 @@ epicsShareFunc void seq_efSet(SS_ID ss, EF_ID ev_flag)
 	DEBUG("efSet: sp=%p, ev_flag=%d\n", sp, ev_flag);
 	assert(ev_flag > 0 && ev_flag <= sp->numEvFlags);
 
-	epicsMutexMustLock(sp->lock);
-
 	/* Set this bit */
-	bitSet(sp->evFlags, ev_flag);
+	seq_mask_set(sp->evFlags, ev_flag);
 
 	/* Wake up state sets that are waiting for this event flag */
 	ss_wakeup(sp, ev_flag);
-
-	epicsMutexUnlock(sp->lock);
 }
 
 /*
@@ -1081,12 +1111,10 @@ epicsShareFunc void seq_efInit(PROG_ID sp, EF_ID ev_flag, unsigned val)
 {
 	assert(ev_flag > 0 && ev_flag <= sp->numEvFlags);
 
-	epicsMutexMustLock(sp->lock);
 	if (val)
-		bitSet(sp->evFlags, ev_flag);
+		seq_mask_set(sp->evFlags, ev_flag);
 	else
-		bitClear(sp->evFlags, ev_flag);
-	epicsMutexUnlock(sp->lock);
+		seq_mask_clear(sp->evFlags, ev_flag);
 }
 
 /*
@@ -1099,17 +1127,14 @@ epicsShareFunc boolean seq_efTest(SS_ID ss, EF_ID ev_flag)
 	boolean	isSet;
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
 
-	isSet = bitTest(sp->evFlags, ev_flag);
+	isSet = seq_mask_test(sp->evFlags, ev_flag);
 
 	DEBUG("efTest: ev_flag=%d, isSet=%d\n", ev_flag, isSet);
 
 	if (optTest(sp, OPT_SAFE))
 		ss_read_buffer_selective(sp, ss, ev_flag);
 
-	epicsMutexUnlock(sp->lock);
-
 	return isSet;
 }
 
@@ -1122,16 +1147,12 @@ epicsShareFunc boolean seq_efClear(SS_ID ss, EF_ID ev_flag)
 	boolean	isSet;
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
 
-	isSet = bitTest(sp->evFlags, ev_flag);
-	bitClear(sp->evFlags, ev_flag);
+	isSet = seq_mask_clear(sp->evFlags, ev_flag);
 
 	/* Wake up state sets that are waiting for this event flag */
 	ss_wakeup(sp, ev_flag);
 
-	epicsMutexUnlock(sp->lock);
-
 	return isSet;
 }
 
@@ -1145,10 +1166,8 @@ epicsShareFunc boolean seq_efTestAndClear(SS_ID ss, EF_ID ev_flag)
 	boolean	isSet;
 
 	assert(ev_flag > 0 && ev_flag <= ss->prog->numEvFlags);
-	epicsMutexMustLock(sp->lock);
 
-	isSet = bitTest(sp->evFlags, ev_flag);
-	bitClear(sp->evFlags, ev_flag);
+	isSet = seq_mask_clear(sp->evFlags, ev_flag);
 
 	DEBUG("efTestAndClear: ev_flag=%d, isSet=%d, ss=%d\n", ev_flag, isSet,
 		(int)ssNum(ss));
@@ -1156,8 +1175,6 @@ epicsShareFunc boolean seq_efTestAndClear(SS_ID ss, EF_ID ev_flag)
 	if (optTest(sp, OPT_SAFE))
 		ss_read_buffer_selective(sp, ss, ev_flag);
 
-	epicsMutexUnlock(sp->lock);
-
 	return isSet;
 }
 
@@ -1185,6 +1202,9 @@ static void *getq_cp(void *dest, const void *value, size_t elemSize)
 		meta->timeStamp = pv_stamp(value,type);
 		count = ch->dbch->dbCount;
 	}
+	/* the element may hold fewer values (variable size queue elements) */
+	if (elemSize < pv_size_n(type, count))
+		count = 1 + (elemSize - pv_size_n(type, 1)) / pv_value_sizes[type];
 	return memcpy(var, pv_value_ptr(value,type), ch->type->size * count);
 }
 
@@ -1214,13 +1234,11 @@ epicsShareFunc boolean seq_pvGetQ(SS_ID ss, CH_ID chId)
 
 	if (ev_flag)
 	{
-		epicsMutexMustLock(sp->lock);
 		/* If queue is now empty, clear the event flag */
 		if (seqQueueIsEmpty(ch->queue))
 		{
-			bitClear(sp->evFlags, ev_flag);
+			seq_mask_clear(sp->evFlags, ev_flag);
 		}
-		epicsMutexUnlock(sp->lock);
 	}
 
 	return (!was_empty);
@@ -1251,10 +1269,8 @@ epicsShareFunc void seq_pvFlushQ(SS_ID ss, CH_ID chId)
 
 	if (ev_flag)
 	{
-		epicsMutexMustLock(sp->lock);
 		/* Clear event flag */
-		bitClear(sp->evFlags, ev_flag);
-		epicsMutexUnlock(sp->lock);
+		seq_mask_clear(sp->evFlags, ev_flag);
 	}
 }
 
@@ -1267,17 +1283,18 @@ epicsShareFunc void seq_pvFlushQ(SS_ID ss, CH_ID chId)
 epicsShareFunc boolean seq_delay(SS_ID ss, double delay)
 {
 	boolean	expired;
-	double	now, timeExpired;
+	seqTime	timeExpired;
 
-	pvTimeGetCurrentDouble(&now);
-	timeExpired = ss->timeEntered + delay;
-	expired = timeExpired <= now;
+	/* ss->evalTime is set by the state set before evaluating conditions */
+	timeExpired = seq_time_add(ss->timeEntered, seq_time_from_sec(delay));
+	expired = timeExpired <= ss->evalTime;
 	if (!expired && timeExpired < ss->wakeupTime)
 		ss->wakeupTime = timeExpired;
 
-	DEBUG("delay(%s/%s,%.10f): entered=%.10f, diff=%.10f, %s\n", ss->ssName,
-		ss->states[ss->currentState].stateName, delay, ss->timeEntered,
-		timeExpired - now, expired ? "expired": "unexpired");
+	DEBUG("delay(%s/%s,%.10f): remaining=%.10f, %s\n", ss->ssName,
+		ss->states[ss->currentState].stateName, delay,
+		expired ? 0.0 : seq_time_to_sec(timeExpired - ss->evalTime),
+		expired ? "expired": "unexpired");
 	return expired;
 }
 
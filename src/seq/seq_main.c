@@ -13,7 +13,12 @@ in the file LICENSE that is included with this distribution.
 
 static boolean init_sprog(PROG *sp, seqProgram *seqProg);
 static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS);
-static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan);
+static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan, unsigned elem);
+static boolean init_elem_names(CHAN *ch, seqChan *seqChan);
+static char *mac_val_get_for(PROG *sp, const char *name, const char *what,
+	size_t len);
+static void init_spin_time(PROG *sp, SSCB *ss);
+static void init_thread_params(PROG *sp, SSCB *ss);
 
 /*
  * types for DB put/get, element size based on user variable type.
@@ -36,6 +41,8 @@ static PVTYPE pv_type_map[] =
 	{ P_UINT16T,	pvTypeSHORT,	pvTypeTIME_SHORT,	sizeof(epicsUInt16)	},
 	{ P_INT32T,	pvTypeLONG,	pvTypeTIME_LONG,	sizeof(epicsInt32)	},
 	{ P_UINT32T,	pvTypeLONG,	pvTypeTIME_LONG,	sizeof(epicsUInt32)	},
+	{ P_INT64T,	pvTypeINT64,	pvTypeTIME_INT64,	sizeof(pvInt64)		},
+	{ P_UINT64T,	pvTypeINT64,	pvTypeTIME_INT64,	sizeof(pvInt64)		},
 	{ P_FLOAT,	pvTypeFLOAT,	pvTypeTIME_FLOAT,	sizeof(float)		},
 	{ P_DOUBLE,	pvTypeDOUBLE,	pvTypeTIME_DOUBLE,	sizeof(double)		},
 	{ P_STRING,	pvTypeSTRING,	pvTypeTIME_STRING,	sizeof(string)		},
@@ -58,7 +65,6 @@ epicsShareFunc epicsThreadId epicsShareAPI seq(
 	PROG		*sp;
 	char		*str;
 	const char	*threadName;
-	unsigned int	smallStack;
 
 	/* Register this program (if not yet done) */
 	seqRegisterSequencerProgram(seqProg);
@@ -95,11 +101,7 @@ epicsShareFunc epicsThreadId epicsShareAPI seq(
 	/* Parse the macro definitions from the command line */
 	seqMacParse(sp, macroDef);
 
-	/* Initialize program struct */
-	if (!init_sprog(sp, seqProg))
-		return 0;
-
-	/* Specify stack size */
+	/* Specify default stack size */
 	if (stackSize == 0)
 		stackSize = epicsThreadGetStackSize(THREAD_STACK_SIZE);
 	str = seqMacValGet(sp, "stack");
@@ -107,30 +109,32 @@ epicsShareFunc epicsThreadId epicsShareAPI seq(
 	{
 		sscanf(str, "%ud", &stackSize);
 	}
-	smallStack = epicsThreadGetStackSize(epicsThreadStackSmall);
-	if (stackSize < smallStack)
-		stackSize = smallStack;
 	sp->stackSize = stackSize;
 
-	/* Specify thread name */
-	str = seqMacValGet(sp, "name");
-	if (str && str[0] != '\0')
-		threadName = str;
-	else
-		threadName = sp->progName;
-
-	/* Specify thread priority */
+	/* Specify default thread priority */
 	sp->threadPriority = THREAD_PRIORITY;
 	str = seqMacValGet(sp, "priority");
 	if (str && str[0] != '\0')
 	{
 		sscanf(str, "%ud", &(sp->threadPriority));
 	}
-	if (sp->threadPriority > THREAD_PRIORITY)
-		sp->threadPriority = THREAD_PRIORITY;
+	if (sp->threadPriority > epicsThreadPriorityMax)
+		sp->threadPriority = epicsThreadPriorityMax;
 
-	tid = epicsThreadCreate(threadName, sp->threadPriority,
-		sp->stackSize, sequencer, sp);
+	/* Initialize program struct */
+	if (!init_sprog(sp, seqProg))
+		return 0;
+
+	/* Specify thread name */
+	str = seqMacValGet(sp, "name");
+	if (str && str[0] != '\0')
+		threadName = str;
+	else
+		threadName = sp->progName;
+
+	/* The program thread runs the first state set */
+	tid = epicsThreadCreate(threadName, sp->ss->threadPriority,
+		sp->ss->stackSize, sequencer, sp);
 	if (!tid)
 	{
 		errlogSevPrintf(errlogFatal, "seq: epicsThreadCreate failed");
@@ -150,7 +154,8 @@ epicsShareFunc epicsThreadId epicsShareAPI seq(
  */
 static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 {
-	unsigned nss, nch;
+	unsigned nss, nch, n;
+	seqChan *seqChan;
 
 	/* Copy information for state program */
 	sp->numSS = seqProg->numSS;
@@ -162,6 +167,7 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 	sp->entryFunc = seqProg->entryFunc;
 	sp->exitFunc = seqProg->exitFunc;
 	sp->varSize = seqProg->varSize;
+	sp->sharedSize = sp->varSize;
 	sp->numQueues = seqProg->numQueues;
 
 	/* Allocate user variable area if reentrant option (+r) is set */
@@ -186,6 +192,12 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 		errlogSevPrintf(errlogFatal, "init_sprog: epicsMutexCreate failed\n");
 		return FALSE;
 	}
+	sp->latLock = epicsMutexCreate();
+	if (!sp->latLock)
+	{
+		errlogSevPrintf(errlogFatal, "init_sprog: epicsMutexCreate failed\n");
+		return FALSE;
+	}
 	sp->ready = epicsEventCreate(epicsEventEmpty);
 	if (!sp->ready)
 	{
@@ -255,31 +267,152 @@ static boolean init_sprog(PROG *sp, seqProgram *seqProg)
 			errlogSevPrintf(errlogFatal, "init_sprog: calloc failed\n");
 			return FALSE;
 		}
+		/* Channels share a limited number of locks */
+		sp->numVarLocks = min(sp->numChans, MAX_VAR_LOCKS);
+		sp->varLocks = newArray(epicsMutexId, sp->numVarLocks);
+		if (!sp->varLocks)
+		{
+			errlogSevPrintf(errlogFatal, "init_sprog: calloc failed\n");
+			return FALSE;
+		}
+		for (n = 0; n < sp->numVarLocks; n++)
+		{
+			sp->varLocks[n] = epicsMutexCreate();
+			if (!sp->varLocks[n])
+			{
+				errlogSevPrintf(errlogFatal, "init_sprog: epicsMutexCreate failed\n");
+				return FALSE;
+			}
+		}
 	}
-	for (nch = 0; nch < sp->numChans; nch++)
+	/* A compact entry in the channel table stands for several channels */
+	for (nch = 0, seqChan = seqProg->chan; nch < sp->numChans; seqChan++)
 	{
-		if (!init_chan(sp, sp->chan + nch, seqProg->chan + nch))
+		unsigned numElems = max(seqChan->numElems, 1u);
+
+		if (numElems > 1 && !init_elem_names(sp->chan + nch, seqChan))
 			return FALSE;
+		for (n = 0; n < numElems && nch < sp->numChans; n++, nch++)
+		{
+			if (!init_chan(sp, sp->chan + nch, seqChan, n))
+				return FALSE;
+		}
 	}
 	return TRUE;
 }
 
+/*
+ * Create the variable names ("name[index]") for all elements
+ * of a compact channel table entry in a single buffer.
+ */
+static boolean init_elem_names(CHAN *ch, seqChan *seqChan)
+{
+	/* room for the brackets, up to 10 digits, and the terminator */
+	size_t	elemLen = strlen(seqChan->varName) + 13;
+	char	*buf = newArray(char, seqChan->numElems * elemLen);
+	char	*name = buf;
+	unsigned n;
+
+	if (!buf)
+	{
+		errlogSevPrintf(errlogFatal, "init_elem_names: calloc failed\n");
+		return FALSE;
+	}
+	ch->varNames = buf;
+	for (n = 0; n < seqChan->numElems; n++, ch++)
+	{
+		ch->varName = name;
+		name += sprintf(name, "%s[%u]", seqChan->varName,
+			seqChan->firstElem + n) + 1;
+	}
+	return TRUE;
+}
+
+/*
+ * Value of the macro "<name>_<what>", or else of "<name>", where <what>
+ * is the name of a state set or variable (only its first len characters)
+ */
+static char *mac_val_get_for(PROG *sp, const char *name, const char *what,
+	size_t len)
+{
+	char	*fullName = newArray(char, strlen(name) + len + 2);
+	char	*str = 0;
+
+	if (fullName)
+	{
+		sprintf(fullName, "%s_%.*s", name, (int)len, what);
+		str = seqMacValGet(sp, fullName);
+		free(fullName);
+	}
+	if (!str || str[0] == '\0')
+		str = seqMacValGet(sp, name);
+	if (str && str[0] == '\0')
+		str = 0;
+	return str;
+}
+
+/*
+ * Busy-poll time before blocking, in microseconds, from the macro
+ * "spin_<state set name>", or else "spin" (default 0: don't spin)
+ */
+static void init_spin_time(PROG *sp, SSCB *ss)
+{
+	char	*str = mac_val_get_for(sp, "spin", ss->ssName, strlen(ss->ssName));
+	double	us = 0.0;
+
+	if (str)
+		sscanf(str, "%lf", &us);
+	ss->spinTime = seq_time_from_sec(us * 1e-6);
+}
+
+/*
+ * Thread priority, stack size and CPU affinity of a state set, from the
+ * macros "priority_<state set name>" etc., or else from the program's
+ * defaults
+ */
+static void init_thread_params(PROG *sp, SSCB *ss)
+{
+	char		*str;
+	unsigned	smallStack = epicsThreadGetStackSize(epicsThreadStackSmall);
+
+	ss->threadPriority = sp->threadPriority;
+	str = mac_val_get_for(sp, "priority", ss->ssName, strlen(ss->ssName));
+	if (str)
+		sscanf(str, "%ud", &ss->threadPriority);
+	if (ss->threadPriority > epicsThreadPriorityMax)
+		ss->threadPriority = epicsThreadPriorityMax;
+
+	ss->stackSize = sp->stackSize;
+	str = mac_val_get_for(sp, "stack", ss->ssName, strlen(ss->ssName));
+	if (str)
+		sscanf(str, "%ud", &ss->stackSize);
+	if (ss->stackSize < smallStack)
+		ss->stackSize = smallStack;
+
+	ss->affinity = mac_val_get_for(sp, "affinity", ss->ssName, strlen(ss->ssName));
+}
+
 /*
  * Initialize a state set control block
  */
 static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 {
+	unsigned nst;
+
 	/* Fill in SSCB */
 	ss->ssName = seqSS->ssName;
 	ss->numStates = seqSS->numStates;
+	ss->chanMask = seqSS->chanMask;
 
 	ss->currentState = 0; /* initial state */
 	ss->nextState = 0;
 	ss->prevState = 0;
 	ss->threadId = 0;
-	ss->timeEntered = epicsINF;
-	ss->wakeupTime = epicsINF;
+	ss->timeEntered = SEQ_TIME_INF;
+	ss->wakeupTime = SEQ_TIME_INF;
 	ss->prog = sp;
+	init_spin_time(sp, ss);
+	init_thread_params(sp, ss);
 
 	ss->syncSem = epicsEventCreate(epicsEventEmpty);
 	if (!ss->syncSem)
@@ -313,6 +446,11 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 		}
 	}
 	/* note: do not pre-allocate request structures */
+	if (!seq_trace_init(ss) || !seq_stats_init(ss))
+	{
+		errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
+		return FALSE;
+	}
 	ss->dead = epicsEventCreate(epicsEventEmpty);
 	if (!ss->dead)
 	{
@@ -324,6 +462,23 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 	   because nothing gets mutated. */
 	ss->states = seqSS->states;
 
+	/* States with subscripts that are evaluated at run-time need a
+	   writable copy of their event mask, plus scratch space */
+	for (nst = 0; nst < ss->numStates; nst++)
+	{
+		if (ss->states[nst].maskFunc)
+		{
+			ss->dynMask = newArray(bitMask,
+				2 * NWORDS(sp->numEvFlags + sp->numChans));
+			if (!ss->dynMask)
+			{
+				errlogSevPrintf(errlogFatal, "init_sscb: calloc failed\n");
+				return FALSE;
+			}
+			break;
+		}
+	}
+
 	/* Allocate separate user variable area if safe mode option (+s) is set */
 	if (optTest(sp, OPT_SAFE))
 	{
@@ -357,12 +512,20 @@ static boolean init_sscb(PROG *sp, SSCB *ss, seqSS *seqSS)
 /*
  * Build the database channel structures.
  */
-static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
+static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan, unsigned elem)
 {
+	const char *chName = seqChan->chName;
+
 	DEBUG("init_chan: ch=%p\n", ch);
 	ch->prog = sp;
-	ch->varName = seqChan->varName;
-	ch->offset = seqChan->offset;
+	if (seqChan->numElems > 1)
+	{
+		/* varName was set by init_elem_names */
+		chName = seqChan->chNames ? seqChan->chNames[elem] : NULL;
+	}
+	else
+		ch->varName = seqChan->varName;
+	ch->offset = seqChan->offset + elem * seqChan->stride;
 	ch->count = seqChan->count;
 	if (ch->count == 0) ch->count = 1;
 	ch->syncedTo = seqChan->efId;
@@ -374,7 +537,7 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 		ch->nextSynced = fst;
 	}
 	ch->monitored = seqChan->monitored;
-	ch->eventNum = seqChan->eventNum;
+	ch->eventNum = seqChan->eventNum + elem;
 
 	/* Fill in request type info */
 	ch->type = pv_type_map + seqChan->varType;
@@ -388,11 +551,11 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 		ch->type, prim_type_tag_name[ch->type->tag],
 		ch->type->putType, ch->type->getType, ch->type->size);
 
-	if (seqChan->chName)	/* skip anonymous PVs */
+	if (chName)	/* skip anonymous PVs */
 	{
 		char name_buffer[100];
 
-		seqMacEval(sp, seqChan->chName, name_buffer, sizeof(name_buffer));
+		seqMacEval(sp, chName, name_buffer, sizeof(name_buffer));
 		if (name_buffer[0])	/* skip anonymous PVs */
 		{
 			DBCHAN	*dbch = new(DBCHAN);
@@ -412,7 +575,7 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 			if (ch->monitored)
 				sp->monitorCount++;
 			DEBUG("  assigned name=%s, expanded name=%s\n",
-				seqChan->chName, ch->dbch->dbName);
+				chName, ch->dbch->dbName);
 		}
 	}
 
@@ -428,15 +591,46 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 		   the message. */
 		size_t size = pv_size_n(ch->type->getType, ch->count);
 		QUEUE *q = sp->queues + seqChan->queueIndex;
+		/* If a byte limit is given, store elements with the actual
+		   number of elements received in a buffer of that size. */
+		char *str = mac_val_get_for(sp, "syncq_bytes", seqChan->varName,
+			strcspn(seqChan->varName, "["));
+		unsigned long numBytes = 0;
+
+		int policy = seqQueueCoalesce;
+
+		if (str)
+			sscanf(str, "%lu", &numBytes);
+		/* What to do if the queue is full */
+		str = mac_val_get_for(sp, "syncq_policy", seqChan->varName,
+			strcspn(seqChan->varName, "["));
+		if (str)
+		{
+			for (policy = seqQueueDropOldest; policy >= seqQueueCoalesce; policy--)
+				if (strcmp(str, seqQueuePolicyName(policy)) == 0)
+					break;
+			if (policy < seqQueueCoalesce)
+			{
+				policy = seqQueueCoalesce;
+				errlogSevPrintf(errlogMinor,
+					"init_chan(varname=%s): invalid syncq_policy '%s', "
+					"using '%s'\n", seqChan->varName, str,
+					seqQueuePolicyName(policy));
+			}
+		}
 
 		if (*q == NULL)
 		{
-			*q = seqQueueCreate(seqChan->queueSize, size);
+			if (numBytes > 0)
+				*q = seqQueueCreateVar(seqChan->queueSize, size, numBytes);
+			else
+				*q = seqQueueCreate(seqChan->queueSize, size);
 			if (!*q)
 			{
 				errlogSevPrintf(errlogFatal, "init_chan: seqQueueCreate failed\n");
 				return FALSE;
 			}
+			seqQueueSetPolicy(*q, policy);
 		}
 		else if (seqQueueNumElems(*q) != seqChan->queueSize ||
 			 seqQueueElemSize(*q) != size)
@@ -452,19 +646,14 @@ static boolean init_chan(PROG *sp, CHAN *ch, seqChan *seqChan)
 		DEBUG("  queue->numElems=%d, queue->elemSize=%d\n",
 			seqQueueNumElems(ch->queue), seqQueueElemSize(ch->queue));
 	}
-	ch->varLock = epicsMutexCreate();
-	if (!ch->varLock)
-	{
-		errlogSevPrintf(errlogFatal, "init_chan: epicsMutexCreate failed\n");
-		return FALSE;
-	}
+	ch->varLock = sp->varLocks[chNum(ch) % sp->numVarLocks];
 	return TRUE;
 }
 
 /* Free all allocated memory in a program structure */
 void seq_free(PROG *sp)
 {
-	unsigned nss, nch, nq;
+	unsigned nss, nch, nq, n;
 
 	/* Delete state sets */
 	for (nss = 0; nss < sp->numSS; nss++)
@@ -475,6 +664,9 @@ void seq_free(PROG *sp)
 		free(ss->metaData);
 
 		epicsEventDestroy(ss->dead);
+		free(ss->trace);
+		free(ss->stats.trans);
+		free(ss->dynMask);
 
 		if (optTest(sp, OPT_SAFE)) free(ss->dirty);
 		if (optTest(sp, OPT_SAFE)) free(ss->var);
@@ -484,6 +676,7 @@ void seq_free(PROG *sp)
 
 	/* Delete program-wide semaphores */
 	epicsMutexDestroy(sp->lock);
+	epicsMutexDestroy(sp->latLock);
 	epicsEventDestroy(sp->ready);
 
 	seqMacFree(sp);
@@ -497,9 +690,15 @@ void seq_free(PROG *sp)
 			free(ch->dbch->dbName);
 			free(ch->dbch);
 		}
+		free(ch->latency);
+		free(ch->varNames);
 	}
 	free(sp->chan);
 
+	for (n = 0; n < sp->numVarLocks; n++)
+		epicsMutexDestroy(sp->varLocks[n]);
+	free(sp->varLocks);
+
 	for (nq = 0; nq < sp->numQueues; nq++)
 		seqQueueDestroy(sp->queues[nq]);
 	free(sp->queues);
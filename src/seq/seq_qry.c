@@ -34,14 +34,16 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 	PROG	*sp;
 	STATE	*st;
 	unsigned nss;
-	double	timeNow;
+	seqTime	timeNow;
 
 	if (ss == NULL) return;
 	sp = ss->prog;
 
 	/* Print info about state program */
 	printf("State Program: \"%s\"\n", sp->progName);
-	printf("  thread priority = %d\n", sp->threadPriority);
+	printf("  thread priority = %u, stack size = %u (defaults)\n",
+		sp->threadPriority, sp->stackSize);
+	printf("  CA client context = %u\n", sp->pvSysNum);
 	printf("  number of state sets = %d\n", sp->numSS);
 	printf("  number of syncQ queues = %d\n", sp->numQueues);
 	if (sp->numQueues > 0)
@@ -57,7 +59,7 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 		optTest(sp, OPT_CONN));
 	if (optTest(sp, OPT_REENT))
 		printf("  user variables: address = %p, length = %u\n",
-			sp->var, (unsigned)sp->varSize);
+			sp->var, (unsigned)sp->sharedSize);
 	printf("\n");
 
 	/* Print state set info */
@@ -76,6 +78,9 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 		}
 
 		printf("  Thread id = %p\n", ss->threadId);
+		printf("  thread priority = %u, stack size = %u, CPU affinity = %s\n",
+			ss->threadPriority, ss->stackSize,
+			ss->affinity ? ss->affinity : "any");
 
 		st = ss->states;
 		printf("  First state = \"%s\"\n", st->stateName);
@@ -87,11 +92,16 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 		printf("  Previous state = \"%s\"\n", ss->prevState >= 0 ?
 			st->stateName : "");
 
-		pvTimeGetCurrentDouble(&timeNow);
-		printf("  Elapsed time since state was entered = %.2f "
-			"seconds\n", timeNow - ss->timeEntered);
-		printf("  Wake up delay = %.2f "
-			"seconds\n", ss->wakeupTime - timeNow);
+		timeNow = seq_time_now();
+		if (ss->timeEntered <= timeNow)
+			printf("  Elapsed time since state was entered = %.2f "
+				"seconds\n", seq_time_to_sec(timeNow - ss->timeEntered));
+		if (ss->wakeupTime == SEQ_TIME_INF)
+			printf("  Wake up delay = none\n");
+		else
+			printf("  Wake up delay = %.2f seconds\n",
+				ss->wakeupTime > timeNow ?
+				seq_time_to_sec(ss->wakeupTime - timeNow) : 0.0);
 
 		printf("  Get in progress = [");
 		for (n = 0; n < sp->numChans; n++)
@@ -107,7 +117,7 @@ epicsShareFunc void epicsShareAPI seqShow(epicsThreadId tid)
 
 		if (optTest(sp, OPT_SAFE))
 			printf("  User variables: address = %p, length = %u\n",
-				sp->var, (unsigned)sp->varSize);
+				ss->var, (unsigned)sp->varSize);
 		printf("\n");
 	}
 }
@@ -309,11 +319,17 @@ epicsShareFunc void epicsShareAPI seqQueueShow(epicsThreadId tid)
 	while (dn && nq >= 0 && (unsigned)nq < sp->numQueues)
 	{
 		QUEUE	queue = sp->queues[nq];
+		seqQueueCounters qc;
 
+		seqQueueGetCounters(queue, &qc);
 		printf("  Queue #%d: numElems=%u, used=%u, elemSize=%u\n", nq,
 			(unsigned)seqQueueNumElems(queue),
 			(unsigned)seqQueueUsed(queue),
 			(unsigned)seqQueueElemSize(queue));
+		printf("    policy=%s, puts=%u, gets=%u, drops=%u (in %u overflows),"
+			" high water=%u\n",
+			seqQueuePolicyName(seqQueueGetPolicy(queue)),
+			qc.puts, qc.gets, qc.drops, qc.overflows, qc.highWater);
 		dn = userInput();
 		nq += dn;
 	}
@@ -353,6 +369,7 @@ static void printValue(pr_fun *pr, void *val, unsigned count, int type)
 	int	*i = (int *)val;
 	float	*f = (float *)val;
 	double	*d = (double *)val;
+	pvInt64	*l = (pvInt64 *)val;
 	typedef char string[MAX_STRING_SIZE];
 	string	*t = (string *)val;
 
@@ -378,6 +395,9 @@ static void printValue(pr_fun *pr, void *val, unsigned count, int type)
 		case pvTypeDOUBLE:
 			pr(" %g", *d++);
 			break;
+		case pvTypeINT64:
+			pr(" %lld", (long long)*l++);
+			break;
 		}
 	}
 	pr("\n");
@@ -15,10 +15,68 @@ struct seqQueue {
     boolean         overflow;
     epicsMutexId    mutex;
     char            *buffer;
+    int             policy;     /* what a put does if full */
+    /* counters (atomic) */
+    int             puts;
+    int             gets;
+    int             drops;
+    int             overflows;
+    int             highWater;
+    /* only for queues with variable size elements */
+    boolean         varSize;
+    size_t          numBytes;   /* size of buffer */
+    size_t          count;      /* number of elements */
+    size_t          last;       /* offset of newest element */
 };
 
+/*
+ * Elements of a queue with variable size elements are stored in a ring
+ * of bytes, each preceded by a header. An element never wraps around;
+ * if it does not fit at the end of the buffer, a header with size
+ * REC_SKIP tells the reader to continue at the start (if there is no
+ * room for that header, the reader knows this too). All offsets are
+ * multiples of REC_ALIGN, so that element data is suitably aligned for
+ * the pv value structures stored in them.
+ */
+typedef struct {
+    size_t          size;       /* size of element data, or REC_SKIP */
+    size_t          prev;       /* offset of previous element */
+} REC_HDR;
+
+#define REC_ALIGN       8
+#define REC_SKIP        ((size_t)-1)
+#define recAlign(n)     (((n) + REC_ALIGN - 1) & ~(size_t)(REC_ALIGN - 1))
+#define recSize(n)      (recAlign(sizeof(REC_HDR)) + recAlign(n))
+#define recHdr(q,pos)   ((REC_HDR *)((q)->buffer + (pos)))
+#define recData(q,pos)  ((q)->buffer + (pos) + recAlign(sizeof(REC_HDR)))
+
+static boolean fixed_get(QUEUE q, seqQueueFunc *get, void *arg);
+static boolean fixed_put(QUEUE q, size_t size, seqQueueFunc *put,
+    const void *arg);
+static boolean var_get(QUEUE q, seqQueueFunc *get, void *arg);
+static size_t used(const QUEUE q);
+
+/* Count a successful put and update the high water mark */
+static void count_put(QUEUE q)
+{
+    int n = (int)used(q);
+    int hw;
+
+    seq_atomic_add(&q->puts, 1);
+    do {
+        hw = seq_atomic_get(&q->highWater);
+    } while (n > hw && seq_atomic_cas(&q->highWater, hw, n) != hw);
+}
+
 epicsShareFunc boolean seqQueueInvariant(QUEUE q)
 {
+    if (q != NULL && q->varSize)
+        return q->elemSize > 0
+            && q->numElems > 0
+            && q->numBytes >= recSize(q->elemSize)
+            && q->count <= q->numElems
+            && q->rd <= q->numBytes
+            && q->wr <= q->numBytes;
     return (q != NULL)
         && q->elemSize > 0
         && q->numElems > 0
@@ -69,9 +127,166 @@ epicsShareFunc QUEUE seqQueueCreate(size_t numElems, size_t elemSize)
     q->numElems = numElems;
     q->overflow = FALSE;
     q->rd = q->wr = 0;
+    q->policy = seqQueueCoalesce;
     return q;
 }
 
+epicsShareFunc void seqQueueSetPolicy(QUEUE q, int policy)
+{
+    q->policy = policy;
+}
+
+epicsShareFunc int seqQueueGetPolicy(const QUEUE q)
+{
+    return q->policy;
+}
+
+epicsShareFunc const char *seqQueuePolicyName(int policy)
+{
+    switch (policy) {
+    case seqQueueCoalesce:      return "coalesce";
+    case seqQueueDropNewest:    return "drop_newest";
+    case seqQueueDropOldest:    return "drop_oldest";
+    default:                    return "?";
+    }
+}
+
+epicsShareFunc void seqQueueGetCounters(const QUEUE q, seqQueueCounters *c)
+{
+    c->puts = (unsigned)seq_atomic_get(&q->puts);
+    c->gets = (unsigned)seq_atomic_get(&q->gets);
+    c->drops = (unsigned)seq_atomic_get(&q->drops);
+    c->overflows = (unsigned)seq_atomic_get(&q->overflows);
+    c->highWater = (unsigned)seq_atomic_get(&q->highWater);
+}
+
+epicsShareFunc QUEUE seqQueueCreateVar(size_t numElems, size_t maxElemSize,
+    size_t numBytes)
+{
+    QUEUE q;
+
+    numBytes &= ~(size_t)(REC_ALIGN - 1);
+    if (maxElemSize > 0 && numBytes < recSize(maxElemSize)) {
+        errlogSevPrintf(errlogFatal,
+            "seqQueueCreateVar: numBytes too small for an element\n");
+        return 0;
+    }
+    /* let seqQueueCreate check the other arguments and create the mutex,
+       but allocate only the minimum buffer there */
+    q = seqQueueCreate(numElems, maxElemSize > 0 ? 1 : 0);
+    if (!q)
+        return 0;
+    free(q->buffer);
+    q->buffer = (char *)malloc(numBytes);
+    if (!q->buffer) {
+        errlogSevPrintf(errlogFatal, "seqQueueCreateVar: out of memory\n");
+        epicsMutexDestroy(q->mutex);
+        free(q);
+        return 0;
+    }
+    q->elemSize = maxElemSize;
+    q->varSize = TRUE;
+    q->numBytes = numBytes;
+    q->count = 0;
+    return q;
+}
+
+/*
+ * Find a place for an element that needs rec bytes in a queue with
+ * variable size elements; rd is the offset of the oldest element and
+ * wr the end of the newest one.
+ */
+static boolean var_fits(QUEUE q, size_t rec, size_t *pos)
+{
+    if (q->count == 0) {
+        *pos = 0;
+        return rec <= q->numBytes;
+    }
+    if (q->count >= q->numElems)
+        return FALSE;
+    if (q->wr > q->rd) {
+        /* used part is [rd, wr) */
+        if (q->numBytes - q->wr >= rec) {
+            *pos = q->wr;
+            return TRUE;
+        }
+        *pos = 0;
+        return rec <= q->rd;
+    }
+    /* used part is [rd, end) and [0, wr) */
+    *pos = q->wr;
+    return q->rd - q->wr >= rec;
+}
+
+static boolean var_put(QUEUE q, size_t size, seqQueueFunc *put, const void *arg)
+{
+    size_t rec = recSize(size);
+    size_t pos;
+    boolean r = FALSE;
+
+    epicsMutexMustLock(q->mutex);
+    while (!var_fits(q, rec, &pos)) {
+        r = TRUE;
+        if (q->policy == seqQueueDropNewest) {
+            seq_atomic_add(&q->drops, 1);
+            seq_atomic_add(&q->overflows, 1);
+            epicsMutexUnlock(q->mutex);
+            return r;
+        } else if (q->policy == seqQueueDropOldest) {
+            var_get(q, 0, 0);
+        } else {
+            /* coalesce: drop the newest element(s) until it fits */
+            q->wr = q->last;
+            q->last = recHdr(q, q->last)->prev;
+            q->count--;
+        }
+        seq_atomic_add(&q->drops, 1);
+    }
+    if (q->count == 0) {
+        q->rd = 0;
+    } else if (pos != q->wr && q->numBytes - q->wr >= sizeof(REC_HDR)) {
+        recHdr(q, q->wr)->size = REC_SKIP;
+    }
+    recHdr(q, pos)->size = size;
+    recHdr(q, pos)->prev = q->last;
+    put(recData(q, pos), arg, size);
+    q->last = pos;
+    q->wr = pos + rec;
+    q->count++;
+    if (r)
+        seq_atomic_add(&q->overflows, 1);
+    count_put(q);
+    epicsMutexUnlock(q->mutex);
+    return r;
+}
+
+/* Remove the oldest element; if get is NULL, only discard it */
+static boolean var_get(QUEUE q, seqQueueFunc *get, void *arg)
+{
+    REC_HDR *hdr;
+
+    epicsMutexMustLock(q->mutex);
+    if (q->count == 0) {
+        epicsMutexUnlock(q->mutex);
+        return TRUE;
+    }
+    if (q->numBytes - q->rd < sizeof(REC_HDR)
+        || recHdr(q, q->rd)->size == REC_SKIP) {
+        q->rd = 0;
+    }
+    hdr = recHdr(q, q->rd);
+    if (get) {
+        get(arg, recData(q, q->rd), hdr->size);
+        seq_atomic_add(&q->gets, 1);
+    }
+    q->rd += recSize(hdr->size);
+    if (--q->count == 0) {
+        q->rd = q->wr = 0;
+    }
+    epicsMutexUnlock(q->mutex);
+    return FALSE;
+}
+
 epicsShareFunc void seqQueueDestroy(QUEUE q)
 {
     epicsMutexDestroy(q->mutex);
@@ -85,6 +300,25 @@ epicsShareFunc boolean seqQueueGet(QUEUE q, void *value)
 }
 
 epicsShareFunc boolean seqQueueGetF(QUEUE q, seqQueueFunc *get, void *arg)
+{
+    boolean r;
+
+    if (q->varSize)
+        return var_get(q, get, arg);
+    if (q->policy == seqQueueDropOldest) {
+        /* the writer may remove elements, too */
+        epicsMutexLock(q->mutex);
+        r = fixed_get(q, get, arg);
+        epicsMutexUnlock(q->mutex);
+    } else {
+        r = fixed_get(q, get, arg);
+    }
+    if (!r)
+        seq_atomic_add(&q->gets, 1);
+    return r;
+}
+
+static boolean fixed_get(QUEUE q, seqQueueFunc *get, void *arg)
 {
     if (q->wr == q->rd) {
         if (!q->overflow) {
@@ -111,6 +345,56 @@ epicsShareFunc boolean seqQueuePut(QUEUE q, const void *value)
 }
 
 epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *put, const void *arg)
+{
+    return seqQueuePutSizeF(q, q->elemSize, put, arg);
+}
+
+epicsShareFunc boolean seqQueuePutSizeF(QUEUE q, size_t size,
+    seqQueueFunc *put, const void *arg)
+{
+    boolean r;
+
+    assert(size <= q->elemSize);
+    if (q->varSize)
+        return var_put(q, size, put, arg);
+    switch (q->policy) {
+    case seqQueueDropNewest:
+        /* the reader can only make room, so no need to lock */
+        if (seqQueueIsFull(q)) {
+            seq_atomic_add(&q->drops, 1);
+            seq_atomic_add(&q->overflows, 1);
+            return TRUE;
+        }
+        r = fixed_put(q, size, put, arg);
+        break;
+    case seqQueueDropOldest:
+        epicsMutexLock(q->mutex);
+        if (seqQueueIsFull(q)) {
+            /* remove the oldest element, commit the one in the
+               overflow slot and put the new one there */
+            q->rd = (q->rd + 1) % q->numElems;
+            q->wr = (q->wr + 1) % q->numElems;
+            put(q->buffer + q->wr * q->elemSize, arg, size);
+            r = TRUE;
+        } else {
+            r = fixed_put(q, size, put, arg);
+        }
+        epicsMutexUnlock(q->mutex);
+        break;
+    default:
+        r = fixed_put(q, size, put, arg);
+        break;
+    }
+    if (r) {
+        seq_atomic_add(&q->drops, 1);
+        seq_atomic_add(&q->overflows, 1);
+    }
+    count_put(q);
+    return r;
+}
+
+static boolean fixed_put(QUEUE q, size_t size, seqQueueFunc *put,
+    const void *arg)
 {
     boolean r = FALSE;
 
@@ -130,13 +414,13 @@ epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *put, const void *arg)
                 q->overflow = FALSE;
             }
         }
-        put(q->buffer + q->wr * q->elemSize, arg, q->elemSize);
+        put(q->buffer + q->wr * q->elemSize, arg, size);
         if (!q->overflow) {
             q->wr = (q->wr + 1) % q->numElems;
         }
         epicsMutexUnlock(q->mutex);
     } else {
-        put(q->buffer + q->wr * q->elemSize, arg, q->elemSize);
+        put(q->buffer + q->wr * q->elemSize, arg, size);
         q->wr = (q->wr + 1) % q->numElems;
     }
     return r;
@@ -145,13 +429,19 @@ epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *put, const void *arg)
 epicsShareFunc void seqQueueFlush(QUEUE q)
 {
     epicsMutexLock(q->mutex);
-    q->rd = q->wr;
-    q->overflow = FALSE;
+    if (q->varSize) {
+        q->rd = q->wr = q->count = 0;
+    } else {
+        q->rd = q->wr;
+        q->overflow = FALSE;
+    }
     epicsMutexUnlock(q->mutex);
 }
 
 static size_t used(const QUEUE q)
 {
+    if (q->varSize)
+        return q->count;
     return (q->numElems + q->wr - q->rd) % q->numElems + (q->overflow ? 1 : 0);
 }
 
@@ -167,11 +457,15 @@ epicsShareFunc size_t seqQueueUsed(const QUEUE q)
 
 epicsShareFunc boolean seqQueueIsEmpty(const QUEUE q)
 {
+    if (q->varSize)
+        return q->count == 0;
     return q->wr == q->rd && !q->overflow;
 }
 
 epicsShareFunc boolean seqQueueIsFull(const QUEUE q)
 {
+    if (q->varSize)
+        return q->count == q->numElems;
     return (q->wr + 1) % q->numElems == q->rd && q->overflow;
 }
 
@@ -184,3 +478,8 @@ epicsShareFunc size_t seqQueueElemSize(const QUEUE q)
 {
     return q->elemSize;
 }
+
+epicsShareFunc size_t seqQueueNumBytes(const QUEUE q)
+{
+    return q->varSize ? q->numBytes : q->numElems * q->elemSize;
+}
@@ -13,6 +13,20 @@ operations always work on a single element.
 The implementation allows one reader and one writer to access the queue
 without taking a mutex, except where unavoidable, i.e. when the queue is
 full.
+
+Queues created with seqQueueCreateVar instead store elements of varying
+size (up to a maximum) in a buffer with a fixed number of bytes. Such a
+queue is full if it has the maximum number of elements or if there is
+not enough room left for the element that is put; a put then overwrites
+as many of the newest elements as necessary. All operations on these
+queues take the mutex.
+
+What a put does when the queue is full can be changed with
+seqQueueSetPolicy: besides overwriting the last element (the default),
+the new element can be discarded, or the oldest elements can be removed
+to make room for it (this takes the mutex for all operations). Each
+queue counts puts, gets, and dropped elements, and records the highest
+number of elements that were ever used.
 \*************************************************************************/
 #ifndef INCLseq_queueh
 #define INCLseq_queueh
@@ -32,6 +46,15 @@ typedef struct seqQueue *QUEUE;
 */
 epicsShareFunc QUEUE seqQueueCreate(size_t numElems, size_t elemSize);
 
+/* Create a new queue for up to numElems elements of at most
+   maxElemSize bytes each, which share a buffer of numBytes
+   bytes, and return it, if successful, otherwise return NULL.
+   Restrictions as for seqQueueCreate, and
+      numBytes is enough for one element of maxElemSize
+*/
+epicsShareFunc QUEUE seqQueueCreateVar(size_t numElems, size_t maxElemSize,
+    size_t numBytes);
+
 /* Return whether all invariants are satisfied */
 epicsShareFunc boolean seqQueueInvariant(QUEUE q);
 
@@ -58,8 +81,8 @@ epicsShareFunc void seqQueueDestroy(QUEUE q);
 epicsShareFunc boolean seqQueueGet(QUEUE q, void *value);
 
 /* Put an element into the queue. Return whether the
-   queue was full and therefore its last element was
-   overwritten. The value argument must point to a
+   queue was full and therefore an element was lost
+   (which one depends on the queue's policy). The value argument must point to a
    memory area with at least seqQueueElemSize(q)
    bytes. */
 epicsShareFunc boolean seqQueuePut(QUEUE q, const void *value);
@@ -76,21 +99,56 @@ epicsShareFunc size_t seqQueueUsed(const QUEUE q);
 /* Number of elements (fixed on construction). */
 epicsShareFunc size_t seqQueueNumElems(const QUEUE q);
 
-/* Element size (fixed on construction). */
+/* Element size (fixed on construction), or maximum element
+   size for queues with variable size elements. */
 epicsShareFunc size_t seqQueueElemSize(const QUEUE q);
 
+/* Size of the buffer in bytes (fixed on construction). */
+epicsShareFunc size_t seqQueueNumBytes(const QUEUE q);
+
 /* Whether empty, same as seqQueueUsed(q)==0 */
 epicsShareFunc boolean seqQueueIsEmpty(const QUEUE q);
 
 /* Whether full, same as seqQueueFree(q)==0 */
 epicsShareFunc boolean seqQueueIsFull(const QUEUE q);
 
+/* What a put does if the queue is full */
+enum seqQueuePolicy {
+    seqQueueCoalesce,       /* overwrite the newest element (default) */
+    seqQueueDropNewest,     /* discard the element being put */
+    seqQueueDropOldest      /* remove the oldest element(s) */
+};
+
+/* Set the overflow policy, one of enum seqQueuePolicy.
+   Must be called before the queue is used. */
+epicsShareFunc void seqQueueSetPolicy(QUEUE q, int policy);
+
+/* The overflow policy. */
+epicsShareFunc int seqQueueGetPolicy(const QUEUE q);
+
+/* Name of an overflow policy, as used for the syncq_policy
+   program parameter. */
+epicsShareFunc const char *seqQueuePolicyName(int policy);
+
+/* Counters, updated without taking the mutex */
+typedef struct seqQueueCounters {
+    unsigned    puts;       /* successful puts, including overwrites */
+    unsigned    gets;       /* successful gets */
+    unsigned    drops;      /* elements lost due to overflow */
+    unsigned    overflows;  /* puts that found the queue full */
+    unsigned    highWater;  /* maximum number of used elements */
+} seqQueueCounters;
+
+/* Get a snapshot of the counters. */
+epicsShareFunc void seqQueueGetCounters(const QUEUE q, seqQueueCounters *c);
+
 
 /* Unsafe operations; use with care */
 typedef void* seqQueueFunc(void *dest, const void *src, size_t elemSize);
 
 /* Like seqQueueGet but does not copy the element's data;
-   instead the user supplied function is called.
+   instead the user supplied function is called. Its elemSize
+   argument is the size of the element actually stored.
    seqQueueGet(q,v) == seqQueueGetF(q,memcpy,v)
    */
 epicsShareFunc boolean seqQueueGetF(QUEUE q, seqQueueFunc *f, void *arg);
@@ -100,4 +158,12 @@ epicsShareFunc boolean seqQueueGetF(QUEUE q, seqQueueFunc *f, void *arg);
    seqQueuePut(q,v) == seqQueuePutF(q,memcpy,v) */
 epicsShareFunc boolean seqQueuePutF(QUEUE q, seqQueueFunc *f, const void *arg);
 
+/* Like seqQueuePutF, but for an element of the given size, which
+   must not be larger than seqQueueElemSize(q); f is called with this
+   size. Only queues with variable size elements store less than
+   seqQueueElemSize(q); for fixed size queues the rest of the element
+   keeps whatever it contained before. */
+epicsShareFunc boolean seqQueuePutSizeF(QUEUE q, size_t size,
+    seqQueueFunc *f, const void *arg);
+
 #endif /* INCLseq_queueh */
@@ -0,0 +1,159 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Rate-limited reporting of run-time errors
+\*************************************************************************/
+/*
+ * Some run-time errors (a full syncq queue, repeated connection events,
+ * pv requests that are still pending) tend to happen in bursts exactly
+ * when the system is already overloaded, e.g. when an IOC is flapping.
+ * Instead of calling errlogSevPrintf for every single event, the places
+ * that detect them call seq_report, which only counts the event with an
+ * atomic increment. The first event of a site in each interval is still
+ * reported in full by the caller; all further ones are summarized once
+ * per interval by a low priority thread, which does all the formatting:
+ *
+ *   myProg[0]: syncq queue full: 5122 more times in the last 10 s (last: x)
+ *
+ * The interval is set with the iocsh variable seqReportInterval (in
+ * seconds). If it is zero or negative, every event is reported.
+ */
+#include "seq.h"
+#include "seq_debug.h"
+
+/* Set by the iocsh variable of the same name */
+epicsShareDef double seqReportInterval = 10.0;
+
+static const char *report_name[NUM_REPORT_SITES] = {
+	"syncq queue full",
+	"syncq queue full (anonymous pvPut)",
+	"disconnect event but already disconnected",
+	"connect event but already connected",
+	"timeout waiting for pending request",
+	"request while another one is pending",
+};
+
+static epicsThreadOnceId reportOnce = EPICS_THREAD_ONCE_INIT;
+static epicsThreadOnceId lockOnce = EPICS_THREAD_ONCE_INIT;
+static epicsMutexId summaryLock;	/* protects lastSummary */
+static seqTime lastSummary;		/* 64 bits, not atomic everywhere */
+
+static void report_init(void *arg)
+{
+	summaryLock = epicsMutexMustCreate();
+	lastSummary = seq_time_now();
+}
+
+/* Seconds since the last summary; if reset, start a new interval */
+static double since_last_summary(boolean reset)
+{
+	seqTime	now;
+	double	dt;
+
+	epicsThreadOnce(&lockOnce, report_init, NULL);
+	epicsMutexMustLock(summaryLock);
+	now = seq_time_now();
+	dt = seq_time_to_sec(now - lastSummary);
+	if (reset)
+		lastSummary = now;
+	epicsMutexUnlock(summaryLock);
+	return dt;
+}
+
+/* Print the summary for one site and reset its count */
+static void report_summary(PROG *sp, int site, double dt)
+{
+	REPORT	*r = sp->report + site;
+	int	n;
+
+	do {
+		n = seq_atomic_get(&r->count);
+	} while (n != 0 && seq_atomic_cas(&r->count, n, 0) != n);
+	/* the first one was reported by the caller of seq_report */
+	if (n > 1)
+	{
+		errlogSevPrintf(errlogMinor,
+			"%s[%d]: %s: %d more times in the last %.0f s (last: %s)\n",
+			sp->progName, sp->instance, report_name[site], n - 1, dt,
+			(const char *)seq_atomic_get_ptr(&r->last));
+	}
+}
+
+/* This routine is called by seqTraverseProg() from report_thread() */
+static int report_prog(PROG *sp, void *param)
+{
+	double	dt = *(double *)param;
+	int	site;
+
+	for (site = 0; site < NUM_REPORT_SITES; site++)
+		report_summary(sp, site, dt);
+	return FALSE;	/* continue traversal */
+}
+
+static void report_thread(void *arg)
+{
+	while (TRUE)
+	{
+		double	dt;
+
+		epicsThreadSleep(seqReportInterval > 0.0 ? seqReportInterval : 10.0);
+		dt = since_last_summary(TRUE);
+		seqTraverseProg(report_prog, &dt);
+	}
+}
+
+static void report_start(void *arg)
+{
+	since_last_summary(TRUE);
+	epicsThreadCreate("seqReport", epicsThreadPriorityLow,
+		epicsThreadGetStackSize(epicsThreadStackSmall), report_thread, NULL);
+}
+
+/*
+ * seq_report() - Count an error event at the given site, name being the
+ * variable or pv concerned (must stay valid while the program runs).
+ * Return whether the caller should report this one in full.
+ */
+boolean seq_report(PROG *sp, int site, const char *name)
+{
+	REPORT	*r = sp->report + site;
+
+	seq_atomic_add(&r->total, 1);
+	if (seqReportInterval <= 0.0)
+		return TRUE;
+	seq_atomic_set_ptr(&r->last, (void *)name);
+	if (seq_atomic_add(&r->count, 1) != 1)
+		return FALSE;
+	/* first in this interval; make sure the rest gets summarized */
+	epicsThreadOnce(&reportOnce, report_start, NULL);
+	return TRUE;
+}
+
+/*
+ * seq_report_flush() - Report events not yet summarized. Called when
+ * the program exits.
+ */
+void seq_report_flush(PROG *sp)
+{
+	double dt = since_last_summary(FALSE);
+
+	report_prog(sp, &dt);
+}
+
+/*
+ * seq_report_show() - Show the total number of error events per site.
+ */
+void seq_report_show(PROG *sp)
+{
+	int site;
+
+	for (site = 0; site < NUM_REPORT_SITES; site++)
+	{
+		int total = seq_atomic_get(&sp->report[site].total);
+
+		if (total > 0)
+			printf("  Errors: %s: %d\n", report_name[site], total);
+	}
+}
@@ -43,12 +43,15 @@ extern "C" {
 #define OPT_REENT		((seqMask)1u<<3)	/* generate reentrant code */
 #define OPT_NEWEF		((seqMask)1u<<4)	/* new event flag mode */
 #define OPT_SAFE		((seqMask)1u<<5)	/* safe mode */
+#define OPT_CONNEVENT		((seqMask)1u<<6)	/* bit 0 of event masks is
+							   the connection event */
 
 /* Bit encoding for state specific options */
 #define OPT_NORESETTIMERS	((seqMask)1u<<0)	/* Don't reset timers on */
 							/* entry to state from same state */
 #define OPT_DOENTRYFROMSELF	((seqMask)1u<<1)	/* Do entry{} even if from same state */
 #define OPT_DOEXITTOSELF	((seqMask)1u<<2)	/* Do exit{} even if to same state */
+#define OPT_NOWAIT		((seqMask)1u<<3)	/* First when() is always true */
 
 #ifndef TRUE
 #define TRUE	1
@@ -63,6 +66,7 @@ typedef	struct program_instance *const PROG_ID;
 typedef void SEQ_TRANS_FUNC(SS_ID ssId, int transNum, int *nextState);
 typedef seqBool SEQ_EVENT_FUNC(SS_ID ssId, int *transNum, int *nextState);
 typedef void SEQ_SS_FUNC(SS_ID ssId);
+typedef void SEQ_MASK_FUNC(SS_ID ssId, seqMask *eventMask);
 typedef void SEQ_PROG_FUNC(PROG_ID progId);
 
 typedef const struct seqChan seqChan;
@@ -82,6 +86,11 @@ struct seqChan
 	seqBool		monitored;	/* whether channel should be monitored */
 	unsigned	queueSize;	/* syncQ queue size (0=not queued) */
 	unsigned	queueIndex;	/* syncQ queue index */
+	/* compact entries describe several consecutive array elements */
+	unsigned	numElems;	/* number of elements (0 or 1: single) */
+	unsigned	firstElem;	/* array index of the first element */
+	size_t		stride;		/* distance between element values */
+	const char *const *chNames;	/* element channel names (may be NULL) */
 };
 
 /* Static information about a state */
@@ -93,6 +102,7 @@ struct seqState
 	SEQ_SS_FUNC	*entryFunc;	/* statements performed on entry to state */
 	SEQ_SS_FUNC	*exitFunc;	/* statements performed on exit from state */
 	const seqMask	*eventMask;	/* event mask for this state */
+	SEQ_MASK_FUNC	*maskFunc;	/* adds run-time bits to eventMask */
 	seqMask		options;	/* state option mask */
 };
 
@@ -102,6 +112,7 @@ struct seqSS
 	const char	*ssName;	/* state set name */
 	seqState	*states;	/* array of state blocks */
 	unsigned	numStates;	/* number of states in this state set */
+	const seqMask	*chanMask;	/* channels used (NULL=all), safe mode */
 };
 
 /* Static information about a state program */
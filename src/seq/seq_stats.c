@@ -0,0 +1,493 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+            Run-time statistics (latency and CPU accounting)
+\*************************************************************************/
+/*
+ * All counters of a state set are updated only by its own thread, so
+ * no locking is needed; readers (seqStatsShow, seqGatherTimingStats)
+ * may see slightly inconsistent values, which is fine for statistics.
+ */
+#include <errno.h>
+#include <time.h>
+
+#include "seq.h"
+#include "seq_debug.h"
+#include "seqStats.h"
+
+/*
+ * seq_stats_init() - Initialize the statistics of a state set.
+ */
+boolean seq_stats_init(SSCB *ss)
+{
+	memset(&ss->stats, 0, sizeof(ss->stats));
+	ss->stats.cpuTime = -1.0;
+	if (ss->numStates > 0)
+	{
+		ss->stats.trans = newArray(TRANS_STATS, ss->numStates * STATS_TRANS);
+		if (!ss->stats.trans)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * seq_stats_time() - Account for a duration (in seconds).
+ */
+void seq_stats_time(TIMING *t, double dt)
+{
+	int bucket = 0;
+
+	if (dt < 0.0)
+		dt = 0.0;
+	t->count++;
+	t->total += dt;
+	if (dt > t->max)
+		t->max = dt;
+	/* bucket n > 0 counts durations in [2^(n-1),2^n) microseconds */
+	if (dt >= 1e-6)
+	{
+		frexp(dt * 1e6, &bucket);
+		if (bucket >= STATS_BUCKETS)
+			bucket = STATS_BUCKETS - 1;
+	}
+	t->hist[bucket]++;
+}
+
+/*
+ * seq_stats_trans() - Account for the action of a transition
+ * from the current state.
+ */
+void seq_stats_trans(SSCB *ss, int transNum, double dt)
+{
+	seq_stats_time(&ss->stats.action, dt);
+	if (ss->stats.trans && transNum >= 0)
+	{
+		TRANS_STATS *ts = ss->stats.trans + ss->currentState * STATS_TRANS
+			+ min(transNum, STATS_TRANS - 1);
+		ts->count++;
+		ts->total += dt;
+	}
+}
+
+/*
+ * seq_stats_cpu() - Sample the CPU time of the calling thread,
+ * which must be the state set's thread.
+ */
+void seq_stats_cpu(SSCB *ss)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		ss->stats.cpuTime = ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+static void showTiming(const char *what, TIMING *t, int level)
+{
+	printf("    %-16s count=%lu total=%.6fs avg=%.1fus max=%.1fus\n", what,
+		t->count, t->total, t->count ? t->total * 1e6 / t->count : 0.0,
+		t->max * 1e6);
+	if (level > 0 && t->count)
+	{
+		int n, last = 0;
+
+		for (n = 0; n < STATS_BUCKETS; n++)
+			if (t->hist[n])
+				last = n;
+		printf("      histogram (us):");
+		for (n = 0; n <= last; n++)
+		{
+			if (n == STATS_BUCKETS - 1)
+				printf(" >=%lu:%lu", 1ul << (n - 1), t->hist[n]);
+			else
+				printf(" <%lu:%lu", 1ul << n, t->hist[n]);
+		}
+		printf("\n");
+	}
+}
+
+static void showStateSet(SSCB *ss, int level)
+{
+	SS_STATS *s = &ss->stats;
+
+	printf("  State Set: \"%s\"\n", ss->ssName);
+	printf("    state entries = %lu, wakeups = %lu, without transition = %lu\n",
+		s->entries, s->wakeups, s->idleWakeups);
+	if (ss->spinTime)
+		printf("    busy-poll %.1fus: woken = %lu, blocked = %lu\n",
+			seq_time_to_sec(ss->spinTime) * 1e6,
+			s->spinWakeups, s->spinMisses);
+	if (s->cpuTime >= 0.0)
+		printf("    CPU time = %.6fs\n", s->cpuTime);
+	else
+		printf("    CPU time = unknown\n");
+	showTiming("when conditions", &s->event, level);
+	showTiming("actions", &s->action, level);
+	showTiming("sync get/put", &s->sync, level);
+	if (level > 0 && s->trans)
+	{
+		unsigned nst;
+		int ntr;
+
+		for (nst = 0; nst < ss->numStates; nst++)
+		{
+			for (ntr = 0; ntr < STATS_TRANS; ntr++)
+			{
+				TRANS_STATS *ts = s->trans + nst * STATS_TRANS + ntr;
+
+				if (!ts->count)
+					continue;
+				printf("    state %s, transition %d%s: count=%lu "
+					"total=%.6fs avg=%.1fus\n",
+					ss->states[nst].stateName, ntr,
+					ntr == STATS_TRANS - 1 ? " (and higher)" : "",
+					ts->count, ts->total, ts->total * 1e6 / ts->count);
+			}
+		}
+	}
+}
+
+/* This routine is called by seqTraverseProg() for seqStatsShow(NULL) */
+static int showProgSummary(PROG *sp, void *param)
+{
+	int		*pcount = (int *)param;
+	unsigned	nss;
+
+	if ((*pcount)++ == 0)
+	{
+		printf("Program Name        SS Name             Entries     Wakeups     Idle        Trans.      CPU [s]\n");
+		printf("------------        -------             -------     -------     ----        ------      -------\n");
+	}
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SS_STATS *s = &sp->ss[nss].stats;
+
+		printf("%-19s %-19s %-11lu %-11lu %-11lu %-11lu ",
+			nss == 0 ? sp->progName : "", sp->ss[nss].ssName,
+			s->entries, s->wakeups, s->idleWakeups, s->action.count);
+		if (s->cpuTime >= 0.0)
+			printf("%.3f\n", s->cpuTime);
+		else
+			printf("-\n");
+	}
+	return FALSE;	/* continue traversal */
+}
+
+/*
+ * seqStatsShow() - Show run-time statistics of the program running the
+ * given thread, or a summary of all programs if tid is NULL.
+ */
+epicsShareFunc void epicsShareAPI seqStatsShow(epicsThreadId tid, int level)
+{
+	PROG	*sp;
+	unsigned nss;
+
+	if (tid == NULL)
+	{
+		int count = 0;
+
+		seqTraverseProg(showProgSummary, &count);
+		if (count == 0)
+			printf("No active state programs\n");
+		return;
+	}
+	sp = seqFindProg(tid);
+	if (sp == NULL)
+	{
+		printf("No program instance is running thread %p.\n", tid);
+		return;
+	}
+	printf("State Program: \"%s\"\n", sp->progName);
+	for (nss = 0; nss < sp->numSS; nss++)
+		showStateSet(sp->ss + nss, level);
+	seq_report_show(sp);
+}
+
+/* This routine is called by seqTraverseProg() for seqGatherTimingStats() */
+static int gatherTiming(PROG *sp, void *param)
+{
+	seqTimingStats	*stats = (seqTimingStats *)param;
+	unsigned	nss;
+
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SS_STATS *s = &sp->ss[nss].stats;
+
+		stats->entries += s->entries;
+		stats->wakeups += s->wakeups;
+		stats->idleWakeups += s->idleWakeups;
+		stats->transitions += s->action.count;
+		stats->eventTime += s->event.total;
+		stats->actionTime += s->action.total;
+		stats->syncTime += s->sync.total;
+		if (s->cpuTime > 0.0)
+			stats->cpuTime += s->cpuTime;
+	}
+	return FALSE;	/* continue traversal */
+}
+
+epicsShareFunc void seqGatherTimingStats(seqTimingStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	seqTraverseProg(gatherTiming, stats);
+}
+
+/* This routine is called by seqTraverseProg() for seqGatherQueueStats() */
+static int gatherQueues(PROG *sp, void *param)
+{
+	seqQueueStats	*stats = (seqQueueStats *)param;
+	unsigned	nq;
+
+	for (nq = 0; nq < sp->numQueues; nq++)
+	{
+		seqQueueCounters qc;
+
+		if (!sp->queues[nq])
+			continue;
+		seqQueueGetCounters(sp->queues[nq], &qc);
+		stats->numQueues++;
+		stats->puts += qc.puts;
+		stats->gets += qc.gets;
+		stats->drops += qc.drops;
+		if (qc.drops > 0)
+			stats->numOverflowed++;
+	}
+	return FALSE;	/* continue traversal */
+}
+
+epicsShareFunc void seqGatherQueueStats(seqQueueStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	seqTraverseProg(gatherQueues, stats);
+}
+
+/*
+ * Monitor latency of channels (optional, switched on with seqLatency):
+ *  - callback: from the PV's time stamp to arrival of the monitor
+ *  - wakeup:   from arrival to a state set evaluating its conditions
+ *  - reaction: from arrival to completion of the triggered transition
+ * A state set attributes a wakeup to the first instrumented channel
+ * that woke it; wakeups that trigger no transition count only as such.
+ */
+
+/*
+ * seq_latency_arrival() - Called for monitor events of an instrumented
+ * channel, before the state sets are woken up.
+ */
+void seq_latency_arrival(CHAN *ch, pvType type, pvValue *value)
+{
+	PROG		*sp = ch->prog;
+	LATENCY		*lat = ch->latency;
+	epicsTimeStamp	stamp;
+	double		wallNow;
+	seqTime		now = seq_time_now();
+	unsigned	nss;
+
+	epicsMutexMustLock(sp->latLock);
+	if (value && pv_is_time_type(type))
+	{
+		/* time stamps are wall-clock time */
+		stamp = pv_stamp(value, type);
+		pvTimeGetCurrentDouble(&wallNow);
+		if (stamp.secPastEpoch != 0)
+			seq_stats_time(&lat->callback,
+				wallNow - (stamp.secPastEpoch + stamp.nsec * 1e-9));
+	}
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SSCB *ss = sp->ss + nss;
+
+		if (!ss->latChan && ss->mask && bitTest(ss->mask, ch->eventNum))
+		{
+			ss->latChan = ch;
+			ss->latArrival = now;
+		}
+	}
+	epicsMutexUnlock(sp->latLock);
+}
+
+/*
+ * seq_latency_wakeup() - Called by a state set (if ss->latChan is set)
+ * after evaluating its conditions.
+ */
+void seq_latency_wakeup(SSCB *ss, seqTime woken, boolean triggered)
+{
+	PROG *sp = ss->prog;
+
+	epicsMutexMustLock(sp->latLock);
+	if (ss->latChan && !ss->latWoken)
+	{
+		/* the monitor may have arrived after we read the time */
+		seq_stats_time(&ss->latChan->latency->wakeup, woken > ss->latArrival
+			? seq_time_to_sec(woken - ss->latArrival) : 0.0);
+		ss->latWoken = TRUE;
+	}
+	if (!triggered)
+	{
+		ss->latChan = NULL;
+		ss->latWoken = FALSE;
+	}
+	epicsMutexUnlock(sp->latLock);
+}
+
+/*
+ * seq_latency_reaction() - Called by a state set (if ss->latChan is set)
+ * after a transition has completed.
+ */
+void seq_latency_reaction(SSCB *ss, seqTime done)
+{
+	PROG *sp = ss->prog;
+
+	epicsMutexMustLock(sp->latLock);
+	/* a monitor that arrived during the action is kept for the next wakeup */
+	if (ss->latChan && ss->latWoken)
+	{
+		seq_stats_time(&ss->latChan->latency->reaction, done > ss->latArrival
+			? seq_time_to_sec(done - ss->latArrival) : 0.0);
+		ss->latChan = NULL;
+		ss->latWoken = FALSE;
+	}
+	epicsMutexUnlock(sp->latLock);
+}
+
+static boolean matchChannel(CHAN *ch, const char *pattern)
+{
+	return ch->dbch && (!pattern || !pattern[0]
+		|| strstr(ch->dbch->dbName, pattern) != NULL);
+}
+
+/*
+ * seqLatency() - Switch latency measurement on or off for the channels
+ * of a program whose PV name contains the pattern (all if NULL or empty).
+ */
+epicsShareFunc void epicsShareAPI seqLatency(epicsThreadId tid, const char *pattern, int on)
+{
+	PROG		*sp = seqFindProg(tid);
+	unsigned	nch, count = 0;
+
+	if (!sp)
+	{
+		printf("No program instance is running thread %p.\n", tid);
+		return;
+	}
+	for (nch = 0; nch < sp->numChans; nch++)
+	{
+		CHAN *ch = sp->chan + nch;
+
+		if (!matchChannel(ch, pattern))
+			continue;
+		if (on && !ch->latency)
+		{
+			/* never freed before the program exits, since
+			   pv callbacks may use it without locking */
+			LATENCY *lat = new(LATENCY);
+
+			if (!lat)
+			{
+				printf("seqLatency: out of memory\n");
+				return;
+			}
+			epicsMutexMustLock(sp->latLock);
+			ch->latency = lat;
+			epicsMutexUnlock(sp->latLock);
+		}
+		if (ch->latency)
+			ch->latency->on = on;
+		count++;
+	}
+	printf("Latency measurement %s for %u channel(s)\n", on ? "on" : "off", count);
+}
+
+/*
+ * seqLatencyShow() - Show the latency statistics of the instrumented
+ * channels of a program whose PV name contains the pattern.
+ */
+epicsShareFunc void epicsShareAPI seqLatencyShow(epicsThreadId tid, const char *pattern)
+{
+	PROG		*sp = seqFindProg(tid);
+	unsigned	nch;
+
+	if (!sp)
+	{
+		printf("No program instance is running thread %p.\n", tid);
+		return;
+	}
+	printf("State Program: \"%s\"\n", sp->progName);
+	for (nch = 0; nch < sp->numChans; nch++)
+	{
+		CHAN *ch = sp->chan + nch;
+
+		if (!ch->latency || !matchChannel(ch, pattern))
+			continue;
+		printf("  Variable \"%s\", PV \"%s\"%s\n", ch->varName,
+			ch->dbch->dbName, ch->latency->on ? "" : " (off)");
+		showTiming("callback", &ch->latency->callback, 1);
+		showTiming("wakeup", &ch->latency->wakeup, 1);
+		showTiming("reaction", &ch->latency->reaction, 1);
+	}
+}
+
+static void dumpTiming(FILE *out, CHAN *ch, const char *what, TIMING *t)
+{
+	int n;
+
+	fprintf(out, "%s,%s,%s,%lu,%.9f,%.9f", ch->prog->progName,
+		ch->dbch->dbName, what, t->count, t->total, t->max);
+	for (n = 0; n < STATS_BUCKETS; n++)
+		fprintf(out, ",%lu", t->hist[n]);
+	fprintf(out, "\n");
+}
+
+/*
+ * seqLatencyDump() - Write the latency statistics of all instrumented
+ * channels of a program to a file in CSV format.
+ */
+epicsShareFunc void epicsShareAPI seqLatencyDump(epicsThreadId tid, const char *file)
+{
+	PROG		*sp = seqFindProg(tid);
+	FILE		*out = stdout;
+	unsigned	nch;
+	int		n;
+
+	if (!sp)
+	{
+		printf("No program instance is running thread %p.\n", tid);
+		return;
+	}
+	if (file && file[0])
+	{
+		out = fopen(file, "w");
+		if (!out)
+		{
+			printf("seqLatencyDump: cannot open '%s': %s\n", file, strerror(errno));
+			return;
+		}
+	}
+	fprintf(out, "program,pv,stage,count,total,max");
+	for (n = 0; n < STATS_BUCKETS; n++)
+	{
+		if (n == 0)
+			fprintf(out, ",<1us");
+		else if (n == STATS_BUCKETS - 1)
+			fprintf(out, ",>=%luus", 1ul << (n - 1));
+		else
+			fprintf(out, ",<%luus", 1ul << n);
+	}
+	fprintf(out, "\n");
+	for (nch = 0; nch < sp->numChans; nch++)
+	{
+		CHAN *ch = sp->chan + nch;
+
+		if (!ch->latency || !ch->dbch)
+			continue;
+		dumpTiming(out, ch, "callback", &ch->latency->callback);
+		dumpTiming(out, ch, "wakeup", &ch->latency->wakeup);
+		dumpTiming(out, ch, "reaction", &ch->latency->reaction);
+	}
+	if (out != stdout)
+		fclose(out);
+}
@@ -13,7 +13,20 @@ in the file LICENSE that is included with this distribution.
 #include "seq.h"
 #include "seq_debug.h"
 
+#include "epicsVersion.h"
+
+#if EPICS_VERSION > 3 || (EPICS_VERSION == 3 && EPICS_REVISION >= 15)
+#include "epicsAtomic.h"
+#define HAVE_ATOMIC
+#endif
+
 static void ss_entry(void *arg);
+static void shrink_shared_buffer(PROG *sp);
+static boolean ss_update_mask(PROG *sp, SSCB *ss, STATE *st);
+static void ss_wait(SSCB *ss, seqTime now);
+#ifdef HAVE_ATOMIC
+static boolean ss_spin(SSCB *ss, seqTime now);
+#endif
 
 /*
  * sequencer() - Sequencer main thread entry point.
@@ -51,6 +64,7 @@ void sequencer (void *arg)	/* ptr to original (global) state program table */
 			SSCB	*ss = sp->ss + nss;
 			memcpy(ss->var, sp->var, sp->varSize);
 		}
+		shrink_shared_buffer(sp);
 	}
 
 	/* Attach to PV system */
@@ -89,8 +103,8 @@ void sequencer (void *arg)	/* ptr to original (global) state program table */
 		/* Spawn the task */
 		tid = epicsThreadCreate(
 			threadName,			/* thread name */
-			sp->threadPriority,		/* priority */
-			sp->stackSize,			/* stack size */
+			ss->threadPriority,		/* priority */
+			ss->stackSize,			/* stack size */
 			ss_entry,			/* entry point */
 			ss);				/* parameter */
 
@@ -116,6 +130,7 @@ exit:
 	seq_disconnect(sp);
 	DEBUG("   Remove program instance from list\n");
 	seqDelProg(sp);
+	seq_report_flush(sp);
 
 	errlogSevPrintf(errlogInfo,
 		"Instance %d of sequencer program \"%s\" terminated\n",
@@ -125,6 +140,38 @@ exit:
 	seq_free(sp);
 }
 
+/*
+ * shrink_shared_buffer() - In safe mode, after the state set buffers
+ * have been initialized, the shared buffer is accessed only for channel
+ * values. Since snc places variables assigned to channels first, we can
+ * usually release everything behind the last of them.
+ */
+static void shrink_shared_buffer(PROG *sp)
+{
+	size_t		size = 0;
+	unsigned	nch;
+	void		*var;
+
+	for (nch = 0; nch < sp->numChans; nch++)
+	{
+		CHAN	*ch = sp->chan + nch;
+		size_t	end = ch->offset + ch->type->size * ch->count;
+
+		if (end > size)
+			size = end;
+	}
+	/* keep the end of the block on its own cache line */
+	size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+	if (size == 0 || size >= sp->varSize)
+		return;
+	var = realloc(sp->var, size);
+	if (var)
+	{
+		sp->var = (SEQ_VARS *)var;
+		sp->sharedSize = size;
+	}
+}
+
 /*
  * ss_read_buffer_static() - static version of ss_read_buffer.
  * This is to enable inlining in the for loop in ss_read_all_buffer.
@@ -175,7 +222,7 @@ void ss_read_buffer(SSCB *ss, CHAN *ch, boolean dirty_only)
 
 /*
  * ss_read_all_buffer() - Call ss_read_buffer_static
- * for all channels.
+ * for all channels used by the state set.
  */
 static void ss_read_all_buffer(PROG *sp, SSCB *ss)
 {
@@ -185,39 +232,45 @@ static void ss_read_all_buffer(PROG *sp, SSCB *ss)
 	{
 		CHAN *ch = sp->chan + nch;
 		/* Call static version so it gets inlined */
-		ss_read_buffer_static(ss, ch, TRUE);
+		if (ssUsesChan(ss, nch))
+			ss_read_buffer_static(ss, ch, TRUE);
 	}
 }
 
 /*
  * ss_read_all_buffer_selective() - Call ss_read_buffer_static
  * for all channels that are sync'ed to the given event flag.
- * NOTE: calling code must take sp->lock, as we traverse
- * the list of channels synced to this event flag.
+ * The lock protects the list against seq_pvArraySync.
  */
 void ss_read_buffer_selective(PROG *sp, SSCB *ss, EF_ID ev_flag)
 {
-	CHAN *ch = sp->syncedChans[ev_flag];
-	while (ch)
+	CHAN *ch;
+
+	epicsMutexMustLock(sp->lock);
+	for (ch = sp->syncedChans[ev_flag]; ch; ch = ch->nextSynced)
 	{
 		/* Call static version so it gets inlined */
-		ss_read_buffer_static(ss, ch, TRUE);
-		ch = ch->nextSynced;
+		if (ssUsesChan(ss, chNum(ch)))
+			ss_read_buffer_static(ss, ch, TRUE);
 	}
+	epicsMutexUnlock(sp->lock);
 }
 
 /*
  * ss_write_buffer() - Copy given value and meta data
  * to shared buffer. In safe mode, if dirtify is TRUE then
- * set dirty flag for each state set.
+ * set dirty flag for each state set that uses the channel.
+ * The caller passes ch->dbch as it has read it (NULL for an
+ * anonymous channel), since pvAssign may change it concurrently.
  */
-void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
+void ss_write_buffer(CHAN *ch, DBCHAN *dbch, void *val, PVMETA *meta,
+	boolean dirtify)
 {
 	PROG *sp = ch->prog;
 	char *buf = bufPtr(ch);		/* shared buffer */
 	/* Must use dbCount for db channels, else we overwrite
 	   elements we didn't get */
-	size_t count = ch->dbch ? ch->dbch->dbCount : ch->count;
+	size_t count = dbch ? dbch->dbCount : ch->count;
 	size_t var_size = ch->type->size * count;
 	ptrdiff_t nch = chNum(ch);
 	unsigned nss;
@@ -228,16 +281,17 @@ void ss_write_buffer(CHAN *ch, void *val, PVMETA *meta, boolean dirtify)
 	print_channel_value(DEBUG, ch, buf);
 
 	memcpy(buf, val, var_size);
-	if (ch->dbch && meta)
+	if (dbch && meta)
 		/* structure copy */
-		ch->dbch->metaData = *meta;
+		dbch->metaData = *meta;
 
 	DEBUG("ss_write_buffer: after write %s", ch->varName);
 	print_channel_value(DEBUG, ch, buf);
 
 	if (optTest(sp, OPT_SAFE) && dirtify)
 		for (nss = 0; nss < sp->numSS; nss++)
-			sp->ss[nss].dirty[nch] = TRUE;
+			if (ssUsesChan(sp->ss + nss, nch))
+				sp->ss[nss].dirty[nch] = TRUE;
 
 	epicsMutexUnlock(ch->varLock);
 }
@@ -258,6 +312,8 @@ static void ss_entry(void *arg)
 		createOrAttachPvSystem(sp);
 	}
 
+	seq_set_affinity(ss);
+
 	/* Register this thread with the EPICS watchdog (no callback func) */
 	taskwdInsert(ss->threadId, 0, 0);
 
@@ -281,15 +337,21 @@ static void ss_entry(void *arg)
 	while (TRUE)
 	{
 		boolean	ev_trig;
+		boolean	entered = TRUE;	/* first evaluation in this state */
 		int	transNum = 0;	/* highest prio trans. # triggered */
 		STATE	*st = ss->states + ss->currentState;
-		double	now;
+		seqTime	now, start;
 
 		/* Set state to current state */
 		assert(ss->currentState >= 0);
 
 		/* Set state set event mask to this state's event mask */
-		ss->mask = st->eventMask;
+		if (st->maskFunc)
+			ss_update_mask(sp, ss, st);
+		else
+			ss->mask = st->eventMask;
+
+		ssTrace(ss, TRACE_STATE, 0, (unsigned)ss->prevState);
 
 		/* If we've changed state, do any entry actions. Also do these
 		 * even if it's the same state if option to do so is enabled.
@@ -305,10 +367,12 @@ static void ss_entry(void *arg)
 
 		/* Setting this semaphore here guarantees that a when() is
 		 * always executed at least once when a state is first entered.
+		 * Not needed if we don't wait at all (see below).
 		 */
-		epicsEventSignal(ss->syncSem);
+		if (!optTest(st, OPT_NOWAIT))
+			ss_signal(ss);
 
-		pvTimeGetCurrentDouble(&now);
+		now = seq_time_now();
 
 		/* Set time we entered this state if transition from a different
 		 * state or else if option not to do so is off for this state.
@@ -318,27 +382,46 @@ static void ss_entry(void *arg)
 		{
 			ss->timeEntered = now;
 		}
-		ss->wakeupTime = epicsINF;
+		ss->wakeupTime = SEQ_TIME_INF;
 
 		/* Loop until an event is triggered, i.e. when() returns TRUE
 		 */
 		do {
-			/* Wake up on PV event, event flag, or expired delay */
-			DEBUG("before epicsEventWaitWithTimeout(ss=%d,timeout=%f)\n",
-				ss - sp->ss, ss->wakeupTime - now);
-			epicsEventWaitWithTimeout(ss->syncSem, ss->wakeupTime - now);
-			DEBUG("after epicsEventWaitWithTimeout()\n");
+			/* Wake up on PV event, event flag, or expired delay,
+			 * unless snc found that the first when() is always true */
+			if (!optTest(st, OPT_NOWAIT))
+				ss_wait(ss, now);
 
 			/* Check whether we have been asked to exit */
 			if (sp->die) goto exit;
 
+			/* Connection changes from now on need another wakeup */
+			if (seq_atomic_get(&ss->connPending))
+				seq_atomic_cas(&ss->connPending, TRUE, FALSE);
+
 			/* Copy dirty variable values from CA buffer
 			 * to user (safe mode only).
 			 */
 			if (optTest(sp, OPT_SAFE))
 				ss_read_all_buffer(sp, ss);
 
-			ss->wakeupTime = epicsINF;
+			/* Re-evaluate subscripts in the event mask; if it changed,
+			   an event may have been missed, so make sure we check
+			   again after the next read */
+			if (st->maskFunc && ss_update_mask(sp, ss, st))
+				ss_signal(ss);
+
+			/* All delay() calls in the conditions compare against
+			   the same time, read once per evaluation */
+			ss->wakeupTime = SEQ_TIME_INF;
+			/* the first evaluation is forced (or does not wait at
+			   all), so it is not a wakeup */
+			if (entered)
+				ss->stats.entries++;
+			else
+				ss->stats.wakeups++;
+			start = seq_time_now();
+			ss->evalTime = start;
 
 			/* Check state change conditions */
 			ev_trig = st->eventFunc(ss,
@@ -347,19 +430,29 @@ static void ss_entry(void *arg)
 			/* Clear all event flags (old ef mode only) */
 			if (ev_trig && !optTest(sp, OPT_NEWEF))
 			{
-				unsigned i;
-				for (i = 0; i < NWORDS(sp->numEvFlags); i++)
-				{
-					sp->evFlags[i] &= ~ss->mask[i];
-				}
+				seq_mask_clear_all(sp->evFlags, ss->mask,
+					NWORDS(sp->numEvFlags));
 			}
-			if (!ev_trig)
-				pvTimeGetCurrentDouble(&now);
+			now = seq_time_now();
+			seq_stats_time(&ss->stats.event, seq_time_to_sec(now - start));
+			if (ss->latChan)
+				seq_latency_wakeup(ss, start, ev_trig);
+			if (!ev_trig && !entered)
+				ss->stats.idleWakeups++;
+			entered = FALSE;
 		} while (!ev_trig);
 
+		ssTrace(ss, TRACE_TRANS, 0, (unsigned)transNum);
+
 		/* Execute the state change action */
 		st->actionFunc(ss, transNum, &ss->nextState);
 
+		start = seq_time_now();
+		seq_stats_trans(ss, transNum, seq_time_to_sec(start - now));
+		seq_stats_cpu(ss);
+		if (ss->latChan)
+			seq_latency_reaction(ss, start);
+
 		/* Check whether we have been asked to exit */
 		if (sp->die) goto exit;
 
@@ -383,6 +476,100 @@ exit:
 		epicsEventSignal(ss->dead);
 }
 
+/*
+ * ss_wait() -- wait for an event or until ss->wakeupTime (the earliest
+ * deadline of all delay() conditions in the current state). A timeout
+ * that the OS delivers before the deadline is not a wakeup; we just wait
+ * for the rest of the time, instead of evaluating the conditions in vain.
+ */
+static void ss_wait(SSCB *ss, seqTime now)
+{
+#ifdef HAVE_ATOMIC
+	/* no point in spinning if the deadline has already passed */
+	if (ss->spinTime && ss->wakeupTime > now)
+	{
+		if (ss_spin(ss, now))
+			return;
+		now = seq_time_now();
+	}
+#endif
+	while (TRUE)
+	{
+		if (ss->wakeupTime == SEQ_TIME_INF)
+		{
+			DEBUG("ss %s: waiting for event\n", ss->ssName);
+			epicsEventMustWait(ss->syncSem);
+			return;
+		}
+		if (ss->wakeupTime <= now)
+		{
+			/* consume a pending signal, as it is taken care of now */
+			epicsEventTryWait(ss->syncSem);
+			ssTrace(ss, TRACE_TIMEOUT, 0, 0);
+			return;
+		}
+		DEBUG("ss %s: waiting for event or %.9f seconds\n", ss->ssName,
+			seq_time_to_sec(ss->wakeupTime - now));
+		if (epicsEventWaitWithTimeout(ss->syncSem,
+			seq_time_to_sec(ss->wakeupTime - now)) != epicsEventWaitTimeout)
+			return;
+		now = seq_time_now();
+	}
+}
+
+#ifdef HAVE_ATOMIC
+/*
+ * ss_spin() -- busy-poll the wake flag for at most ss->spinTime (and not
+ * beyond the next deadline), to react faster than a blocking wait allows.
+ * Returns whether we have been woken. The protocol with ss_signal: each
+ * side first writes its own flag, then reads the other's (with full
+ * barriers in between), so either we see the wake flag, or the waker
+ * sees that we stopped spinning and signals the semaphore.
+ */
+static boolean ss_spin(SSCB *ss, seqTime now)
+{
+	seqTime until = min(seq_time_add(now, ss->spinTime), ss->wakeupTime);
+
+	/* The wake flag may have been set while we were not spinning. Such
+	   events have also signalled the semaphore, so that is where we
+	   look for them; they do not count as spin wakeups. */
+	epicsAtomicSetIntT(&ss->wakeFlag, 0);
+	if (epicsEventTryWait(ss->syncSem) == epicsEventWaitOK)
+		return TRUE;
+	epicsAtomicCmpAndSwapIntT(&ss->spinning, FALSE, TRUE);
+	while (!epicsAtomicGetIntT(&ss->wakeFlag) && seq_time_now() < until)
+		;
+	epicsAtomicCmpAndSwapIntT(&ss->spinning, TRUE, FALSE);
+	if (epicsAtomicGetIntT(&ss->wakeFlag))
+	{
+		/* a signal posted before we started spinning is obsolete now */
+		epicsEventTryWait(ss->syncSem);
+		ss->stats.spinWakeups++;
+		return TRUE;
+	}
+	ss->stats.spinMisses++;
+	return FALSE;
+}
+#endif
+
+/*
+ * ss_signal() -- wake up a state set. While it busy-polls (see ss_spin)
+ * setting its wake flag suffices; otherwise we signal the semaphore, on
+ * which it may be blocked in ss_wait or in a synchronous pvGet/pvPut.
+ */
+void ss_signal(SSCB *ss)
+{
+#ifdef HAVE_ATOMIC
+	if (ss->spinTime)
+	{
+		epicsAtomicCmpAndSwapIntT(&ss->wakeFlag, FALSE, TRUE);
+		if (epicsAtomicGetIntT(&ss->spinning))
+			return;
+	}
+#endif
+	epicsEventSignal(ss->syncSem);
+}
+
 /*
  * Delete all state set threads and do general clean-up.
  */
@@ -397,6 +584,32 @@ epicsShareFunc void epicsShareAPI seqStop(epicsThreadId tid)
 	seq_exit(sp->ss);
 }
 
+/*
+ * ss_update_mask() -- compute the event mask of a state whose when()
+ * conditions contain subscripts that can only be evaluated at run-time.
+ * Returns whether the mask has changed.
+ */
+static boolean ss_update_mask(PROG *sp, SSCB *ss, STATE *st)
+{
+	unsigned	nwords = NWORDS(sp->numEvFlags + sp->numChans);
+	bitMask		*scratch = ss->dynMask + nwords;
+	boolean		changed;
+
+	memcpy(scratch, st->eventMask, nwords * sizeof(bitMask));
+	st->maskFunc(ss, scratch);
+
+	/* No lock: a waker that reads the mask while it is being updated
+	   may miss us, which is why the caller signals itself if it changed */
+	changed = ss->mask != ss->dynMask
+		|| memcmp(ss->dynMask, scratch, nwords * sizeof(bitMask)) != 0;
+	if (changed)
+	{
+		memcpy(ss->dynMask, scratch, nwords * sizeof(bitMask));
+		ss->mask = ss->dynMask;
+	}
+	return changed;
+}
+
 /*
  * ss_wakeup() -- wake up each state set that is waiting on this event
  * based on the current event mask; eventNum = 0 means wake all state sets.
@@ -410,7 +623,6 @@ void ss_wakeup(PROG *sp, unsigned eventNum)
 	{
 		SSCB *ss = sp->ss + nss;
 
-		epicsMutexMustLock(sp->lock);
 		/* If event bit in mask is set, wake that state set */
 		DEBUG("ss_wakeup: eventNum=%d, mask=%u, state set=%d\n", eventNum, 
 			ss->mask? *ss->mask : 0, (int)ssNum(ss));
@@ -418,8 +630,65 @@ void ss_wakeup(PROG *sp, unsigned eventNum)
 			(ss->mask && bitTest(ss->mask, eventNum)))
 		{
 			DEBUG("ss_wakeup: waking up state set=%d\n", (int)ssNum(ss));
-			epicsEventSignal(ss->syncSem); /* wake up ss thread */
+			ssTrace(ss, TRACE_WAKEUP, 0, eventNum);
+			ss_signal(ss); /* wake up ss thread */
 		}
-		epicsMutexUnlock(sp->lock);
+	}
+}
+
+/*
+ * ss_wakeup_conn() -- wake up each state set whose current state depends
+ * on the connection status of channels (programs compiled by older
+ * versions of snc don't tell, so all of them). A state set that has
+ * been woken but has not yet evaluated its conditions is not signalled
+ * again, so that a burst of connection events results in one wakeup.
+ */
+void ss_wakeup_conn(PROG *sp)
+{
+	unsigned nss;
+
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SSCB		*ss = sp->ss + nss;
+		const bitMask	*mask = ss->mask;
+
+		if (optTest(sp, OPT_CONNEVENT) && mask && !bitTest(mask, 0))
+			continue;
+		if (seq_atomic_cas(&ss->connPending, FALSE, TRUE) != FALSE)
+			continue;
+		DEBUG("ss_wakeup_conn: waking up state set=%d\n", (int)ssNum(ss));
+		ssTrace(ss, TRACE_WAKEUP, 1, 0);
+		ss_signal(ss); /* wake up ss thread */
+	}
+}
+
+/*
+ * ss_wakeup_chan() -- wake up each state set that is waiting on the
+ * event of a channel (if chanEvent is TRUE) or on the event flag it is
+ * synced to (if ev_flag is not 0). Each state set is signalled at most
+ * once, and the mask of each is read only once.
+ */
+void ss_wakeup_chan(PROG *sp, CHAN *ch, boolean chanEvent, EF_ID ev_flag)
+{
+	unsigned nss;
+
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SSCB		*ss = sp->ss + nss;
+		const bitMask	*mask = ss->mask;
+		unsigned	eventNum;
+
+		if (!mask)
+			continue;
+		if (chanEvent && bitTest(mask, ch->eventNum))
+			eventNum = ch->eventNum;
+		else if (ev_flag && bitTest(mask, ev_flag))
+			eventNum = ev_flag;
+		else
+			continue;
+		DEBUG("ss_wakeup_chan: waking up state set=%d, eventNum=%d\n",
+			(int)ssNum(ss), eventNum);
+		ssTrace(ss, TRACE_WAKEUP, 0, eventNum);
+		ss_signal(ss); /* wake up ss thread */
 	}
 }
@@ -0,0 +1,68 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Monotonic time for delays and state timing
+\*************************************************************************/
+/*
+ * Everything the sequencer measures as an interval (delay(), time spent
+ * in a state, timeouts of synchronous requests, statistics) uses a
+ * monotonic clock in integer nanoseconds, so that stepping the system
+ * clock neither fires delays early nor holds them up.
+ */
+#include "seq.h"
+
+#include "epicsVersion.h"
+
+#if EPICS_VERSION > 3 || (EPICS_VERSION == 3 && (EPICS_REVISION > 16 || \
+	(EPICS_REVISION == 16 && EPICS_MODIFICATION >= 1)))
+#define USE_EPICS_MONOTONIC
+#elif !defined(_WIN32) && !defined(vxWorks)
+#include <time.h>
+#endif
+
+/*
+ * seq_time_now() - The current monotonic time.
+ */
+seqTime seq_time_now(void)
+{
+#if defined(USE_EPICS_MONOTONIC)
+	return epicsMonotonicGet();
+#else
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (seqTime)ts.tv_sec * 1000000000u + (seqTime)ts.tv_nsec;
+#endif
+	{
+		/* no monotonic clock available: use wall-clock time */
+		epicsTimeStamp stamp;
+
+		epicsTimeGetCurrent(&stamp);
+		return (seqTime)stamp.secPastEpoch * 1000000000u + stamp.nsec;
+	}
+#endif
+}
+
+/*
+ * seq_time_from_sec() - Convert a duration in seconds. Negative (and NaN)
+ * durations are zero, durations too long to represent are infinite.
+ */
+seqTime seq_time_from_sec(double sec)
+{
+	if (!(sec > 0.0))
+		return 0;
+	if (sec >= 1.8e10)
+		return SEQ_TIME_INF;
+	return (seqTime)(sec * 1e9 + 0.5);
+}
+
+/*
+ * seq_time_add() - Add a duration to a point in time, without overflow.
+ */
+seqTime seq_time_add(seqTime t, seqTime d)
+{
+	return t + d < t ? SEQ_TIME_INF : t + d;
+}
@@ -0,0 +1,200 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Run-time event tracing for state sets
+\*************************************************************************/
+/*
+ * Each state set has a fixed size ring buffer of binary trace records
+ * (see struct trace_rec). Records are written by the state set thread
+ * itself (state entries, transitions, pv requests) and by pv callback
+ * threads (wakeups, completions), so slots are claimed with an atomic
+ * increment; no lock is taken. When tracing is disabled, the only cost
+ * is the test of seqTraceEnabled in the ssTrace macro.
+ *
+ * The buffers are formatted into text only when they are dumped.
+ */
+#include <errno.h>
+
+#include "seq.h"
+#include "seq_debug.h"
+
+#include "epicsVersion.h"
+
+#if EPICS_VERSION > 3 || (EPICS_VERSION == 3 && EPICS_REVISION >= 15)
+#include "epicsAtomic.h"
+#define traceClaim(ss) ((unsigned)epicsAtomicIncrIntT(&(ss)->traceNext) - 1u)
+#else
+/* no atomic operations: concurrent writers may clobber a record */
+#define traceClaim(ss) ((unsigned)(ss)->traceNext++)
+#endif
+
+/* Set by the seqTrace shell command */
+int seqTraceEnabled = FALSE;
+
+/* Number of records per state set; rounded up to a power of 2 */
+int seqTraceSize = 1024;
+
+static const char *trace_type_name[] = {
+	"state",
+	"trans",
+	"wakeup",
+	"timeout",
+	"get",
+	"get-done",
+	"put",
+	"put-done",
+};
+
+/*
+ * seq_trace_init() - Allocate the trace buffer of a state set.
+ */
+boolean seq_trace_init(SSCB *ss)
+{
+	unsigned size = 1;
+
+	if (seqTraceSize <= 0)
+		return TRUE;
+	while (size < (unsigned)seqTraceSize)
+		size <<= 1;
+	ss->trace = newArray(TRACE_REC, size);
+	if (!ss->trace)
+		return FALSE;
+	ss->traceSize = size;
+	ss->traceNext = 0;
+	return TRUE;
+}
+
+/*
+ * seq_trace_rec() - Append a record to a state set's trace buffer.
+ * Called via the ssTrace macro only if tracing is enabled.
+ */
+void seq_trace_rec(SSCB *ss, unsigned type, unsigned aux, unsigned arg)
+{
+	unsigned	seqNo = traceClaim(ss);
+	TRACE_REC	*rec = ss->trace + (seqNo & (ss->traceSize - 1));
+
+	epicsTimeGetCurrent(&rec->stamp);
+	rec->type = (epicsUInt8)type;
+	rec->aux = (epicsUInt8)aux;
+	rec->state = (epicsUInt16)ss->currentState;
+	rec->arg = arg;
+	/* written last, so a dump can detect records being overwritten */
+	rec->seqNo = seqNo;
+}
+
+/* Name of the channel that posts the given event number, if any */
+static const char *event_name(PROG *sp, unsigned eventNum)
+{
+	unsigned nch;
+
+	if (eventNum == 0)
+		return "(all)";
+	if (eventNum <= sp->numEvFlags)
+		return "(event flag)";
+	for (nch = 0; nch < sp->numChans; nch++)
+		if (sp->chan[nch].eventNum == eventNum)
+			return sp->chan[nch].varName;
+	return "";
+}
+
+static void trace_dump_ss(FILE *out, SSCB *ss)
+{
+	PROG		*sp = ss->prog;
+	unsigned	next = (unsigned)ss->traceNext;
+	unsigned	first = next > ss->traceSize ? next - ss->traceSize : 0;
+	unsigned	n;
+
+	fprintf(out, "# program \"%s\" state set \"%s\": %u records\n",
+		sp->progName, ss->ssName, next - first);
+	for (n = first; n != next; n++)
+	{
+		TRACE_REC	rec = ss->trace[n & (ss->traceSize - 1)];
+		char		stamp[40];
+		const char	*stateName;
+
+		/* skip records that were overwritten during the dump */
+		if (rec.seqNo != n || rec.type > TRACE_PUT_DONE)
+			continue;
+		epicsTimeToStrftime(stamp, sizeof(stamp),
+			"%Y-%m-%d %H:%M:%S.%06f", &rec.stamp);
+		stateName = rec.state < ss->numStates ?
+			ss->states[rec.state].stateName : "?";
+		fprintf(out, "%u %s %s %s", rec.seqNo, stamp,
+			trace_type_name[rec.type], stateName);
+		switch (rec.type)
+		{
+		case TRACE_STATE:
+			fprintf(out, " from=%s", rec.arg < ss->numStates ?
+				ss->states[rec.arg].stateName : "-");
+			break;
+		case TRACE_TRANS:
+			fprintf(out, " trans=%u", rec.arg);
+			break;
+		case TRACE_WAKEUP:
+			fprintf(out, " event=%u %s", rec.arg,
+				rec.aux ? "(connection)" : event_name(sp, rec.arg));
+			break;
+		case TRACE_GET:
+		case TRACE_PUT:
+			if (rec.arg >= sp->numChans)
+				break;
+			fprintf(out, " var=%s comp=%s", sp->chan[rec.arg].varName,
+				rec.aux == SYNC ? "sync" : rec.aux == ASYNC ? "async" : "default");
+			break;
+		case TRACE_GET_DONE:
+		case TRACE_PUT_DONE:
+			if (rec.arg >= sp->numChans)
+				break;
+			fprintf(out, " var=%s status=%u", sp->chan[rec.arg].varName, rec.aux);
+			break;
+		}
+		fprintf(out, "\n");
+	}
+}
+
+/*
+ * seqTrace() - Switch tracing on or off for all programs.
+ */
+epicsShareFunc void epicsShareAPI seqTrace(int on)
+{
+	seqTraceEnabled = on;
+	printf("Sequencer tracing is %s\n", on ? "on" : "off");
+}
+
+/*
+ * seqTraceDump() - Write the trace records of all state sets of the
+ * program running the given thread to a file (or stdout if file is
+ * NULL or empty).
+ */
+epicsShareFunc void epicsShareAPI seqTraceDump(epicsThreadId tid, const char *file)
+{
+	PROG		*sp = seqFindProg(tid);
+	FILE		*out = stdout;
+	unsigned	nss;
+
+	if (!sp)
+	{
+		printf("No program instance is running thread %p.\n", tid);
+		return;
+	}
+	if (file && file[0])
+	{
+		out = fopen(file, "w");
+		if (!out)
+		{
+			printf("seqTraceDump: cannot open '%s': %s\n", file, strerror(errno));
+			return;
+		}
+	}
+	for (nss = 0; nss < sp->numSS; nss++)
+	{
+		SSCB *ss = sp->ss + nss;
+
+		if (ss->trace)
+			trace_dump_ss(out, ss);
+	}
+	if (out != stdout)
+		fclose(out);
+}
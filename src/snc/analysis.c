@@ -11,6 +11,7 @@ in the file LICENSE that is included with this distribution.
                 Analysis of parse tree
 \*************************************************************************/
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <limits.h>
 #include <assert.h>
@@ -50,6 +51,10 @@ static void check_states_reachable_from_first(Node *ss);
 static void add_var(Var *vp, Node *scope);
 static Var *find_var(SymTable st, char *name, Node *scope);
 static uint assign_ef_bits(Node *scope);
+static void analyse_chan_usage(Node *prog, uint num_channels);
+static void analyse_writers(Node *prog);
+static void check_performance(Program *p);
+static void optimise_state_set(Node *ssp, int xwarn);
 
 Program *analyse_program(Node *prog, Options options)
 {
@@ -72,8 +77,7 @@ Program *analyse_program(Node *prog, Options options)
 
 	p->sym_table = sym_table_create();
 
-	register_builtin_consts(p->sym_table);
-	register_builtin_funcs(p->sym_table);
+	register_builtins();
 
 	p->chan_list = new(ChanList);
 	p->syncq_list = new(SyncQList);
@@ -88,7 +92,13 @@ Program *analyse_program(Node *prog, Options options)
 	connect_state_change_stmts(p->sym_table, prog);
 	foreach(ss, prog->prog_statesets)
 		check_states_reachable_from_first(ss);
+	foreach(ss, prog->prog_statesets)
+		optimise_state_set(ss, p->options.xwarn);
 	p->num_event_flags = assign_ef_bits(p->prog);
+	analyse_chan_usage(prog, p->chan_list->num_elems);
+	analyse_writers(prog);
+	if (p->options.perf)
+		check_performance(p);
 	return p;
 }
 
@@ -301,6 +311,7 @@ static void analyse_option(Options *options, Node *defn)
 		case 's': options->safe = optval; break;
 		case 'w': options->warn = optval; break;
 		case 'W': options->xwarn = optval; break;
+		case 'p': options->perf = optval; break;
 		default: report_at_node(defn,
 		  "warning: unknown option '%s'\n", optname);
 		}
@@ -1284,14 +1295,14 @@ static int connect_variable(Node *ep, Node *scope, void *parg)
 		struct const_symbol *csym;
 		struct func_symbol *fsym;
 
-		csym = lookup_builtin_const(st, ep->token.str);
+		csym = lookup_builtin_const(ep->token.str);
 		if (csym)
 		{
 			ep->tag = E_CONST;
 			ep->extra.e_const = csym;
 			return FALSE;
 		}
-		fsym = lookup_builtin_func(st, ep->token.str);
+		fsym = lookup_builtin_func(ep->token.str);
 		if (fsym)
 		{
 			ep->tag = E_BUILTIN;
@@ -1609,3 +1620,902 @@ static uint assign_ef_bits(Node *scope)
 	}
 	return num_event_flags;
 }
+
+typedef struct funcdef_list {
+	Node			*defn;
+	struct funcdef_list	*next;
+} funcdef_list;
+
+typedef struct {
+	Node		*prog;
+	seqMask		*chan_mask;
+	uint		all;		/* may use any channel */
+	funcdef_list	*visited;	/* function definitions already seen */
+} chan_usage_arg;
+
+/* Find the definition of an SNL function, or 0 if it has none */
+static Node *find_funcdef(Node *prog, Var *vp)
+{
+	Node *defn;
+
+	foreach (defn, prog->prog_defns)
+		if (defn->tag == D_FUNCDEF && defn->funcdef_decl->extra.e_decl == vp)
+			return defn;
+	foreach (defn, prog->prog_xdefns)
+		if (defn->tag == D_FUNCDEF && defn->funcdef_decl->extra.e_decl == vp)
+			return defn;
+	return 0;
+}
+
+static int iter_chan_usage(Node *ep, Node *scope, void *parg)
+{
+	chan_usage_arg	*cu_arg = (chan_usage_arg *)parg;
+	Var		*vp;
+	uint		n, num;
+
+	if (cu_arg->all)
+		return FALSE;
+	/* embedded C code can access any variable */
+	if (ep->tag == T_TEXT)
+	{
+		cu_arg->all = TRUE;
+		return FALSE;
+	}
+	assert(ep->tag == E_VAR);
+	vp = ep->extra.e_var;
+	assert(vp != 0);
+
+	if (vp->type->tag == T_FUNCTION)
+	{
+		Node		*defn = find_funcdef(cu_arg->prog, vp);
+		funcdef_list	*fl;
+
+		if (!defn)
+			return FALSE;
+		foreach (fl, cu_arg->visited)
+			if (fl->defn == defn)
+				return FALSE;
+		fl = new(funcdef_list);
+		fl->defn = defn;
+		fl->next = cu_arg->visited;
+		cu_arg->visited = fl;
+		traverse_syntax_tree(defn->funcdef_block, bit(E_VAR)|bit(T_TEXT), 0,
+			defn, iter_chan_usage, cu_arg);
+		return FALSE;
+	}
+	/* foreign code that is passed the state set or variable block */
+	if (vp->type->tag == T_NONE && (
+		strcmp(vp->name, "ssId") == 0 || strcmp(vp->name, NM_ENV) == 0 ||
+		strcmp(vp->name, "pVar") == 0 || strcmp(vp->name, NM_VAR) == 0))
+	{
+		cu_arg->all = TRUE;
+		return FALSE;
+	}
+	switch (vp->assign)
+	{
+	case M_SINGLE:
+		bitSet(cu_arg->chan_mask, vp->index);
+		break;
+	case M_MULTI:
+		num = type_array_length1(vp->type);
+		for (n = 0; n < num; n++)
+			bitSet(cu_arg->chan_mask, vp->index + n);
+		break;
+	}
+	return FALSE;
+}
+
+/* Determine for each state set the channels it uses, so that in safe
+ * mode the run-time system needs to copy only those into the state set's
+ * private variable buffer. Program entry and exit code runs in the
+ * thread of the first state set. */
+static void analyse_chan_usage(Node *prog, uint num_channels)
+{
+	Node	*ssp;
+	Node	*ep;
+
+	foreach (ssp, prog->prog_statesets)
+	{
+		chan_usage_arg	cu_arg;
+
+		cu_arg.prog = prog;
+		cu_arg.chan_mask = newArray(seqMask, NWORDS(num_channels));
+		cu_arg.all = FALSE;
+		cu_arg.visited = 0;
+		traverse_syntax_tree(ssp, bit(E_VAR)|bit(T_TEXT), 0, 0,
+			iter_chan_usage, &cu_arg);
+		if (ssp == prog->prog_statesets)
+		{
+			foreach (ep, prog->prog_entry)
+				traverse_syntax_tree(ep, bit(E_VAR)|bit(T_TEXT), 0, prog,
+					iter_chan_usage, &cu_arg);
+			foreach (ep, prog->prog_exit)
+				traverse_syntax_tree(ep, bit(E_VAR)|bit(T_TEXT), 0, prog,
+					iter_chan_usage, &cu_arg);
+		}
+		ssp->extra.e_ss->chan_mask = cu_arg.all ? 0 : cu_arg.chan_mask;
+	}
+}
+
+typedef struct writers_arg {
+	Node	*prog;
+	Node	*ssp;		/* state set being analysed, 0 for functions */
+} writers_arg;
+
+/* Record that state set ssp writes variable vp (ssp == 0: unknown) */
+static void note_write(Var *vp, Node *ssp)
+{
+	if (!ssp || (vp->writer && vp->writer != ssp))
+		vp->shared = TRUE;
+	else
+		vp->writer = ssp;
+}
+
+/* Whether a binary operator is "=" or a compound assignment like "+=" */
+static int is_assign_op(const char *op)
+{
+	return op[strlen(op)-1] == '=' && strcmp(op, "==") != 0
+		&& strcmp(op, "!=") != 0 && strcmp(op, "<=") != 0
+		&& strcmp(op, ">=") != 0;
+}
+
+static int iter_writers(Node *ep, Node *scope, void *parg)
+{
+	writers_arg	*wr_arg = (writers_arg *)parg;
+	Node		*target = 0;
+	char		*op = ep->token.str;
+	Var		*vp;
+
+	switch (ep->tag)
+	{
+	case T_TEXT:
+		/* embedded C code can write any global variable */
+		foreach (vp, var_list_from_scope(wr_arg->prog)->first)
+			note_write(vp, wr_arg->ssp);
+		return FALSE;
+	case E_BINOP:
+		if (is_assign_op(op))
+			target = ep->binop_left;
+		break;
+	case E_PRE:
+		/* taking the address allows writing via the pointer */
+		if (strcmp(op, "++") == 0 || strcmp(op, "--") == 0 || strcmp(op, "&") == 0)
+			target = ep->pre_operand;
+		break;
+	case E_POST:
+		target = ep->post_operand;
+		break;
+	case E_FUNC:
+		/* an array passed to a function can be written by it */
+		foreach (target, ep->func_args)
+			if (target->tag == E_VAR && target->extra.e_var->type->tag == T_ARRAY)
+				note_write(target->extra.e_var, wr_arg->ssp);
+		return TRUE;
+	default:
+		break;
+	}
+	/* find the variable that contains the modified object */
+	while (target && target->tag != E_VAR)
+	{
+		if (target->tag == E_SUBSCR)
+			target = target->subscr_operand;
+		else if (target->tag == E_SELECT)
+			target = target->select_left;
+		else if (target->tag == E_PAREN && !target->paren_expr->next)
+			target = target->paren_expr;
+		else
+			target = 0;	/* e.g. via a pointer: cannot tell */
+	}
+	if (target)
+		note_write(target->extra.e_var, wr_arg->ssp);
+	return TRUE;
+}
+
+#define writes_mask (bit(E_BINOP)|bit(E_PRE)|bit(E_POST)|bit(E_FUNC)|bit(T_TEXT))
+
+/* Determine for each variable whether only one state set writes it.
+ * Program entry and exit code does not run concurrently with the state
+ * sets and is ignored; functions can be called from any state set. */
+static void analyse_writers(Node *prog)
+{
+	writers_arg	wr_arg;
+	Node		*defn;
+
+	wr_arg.prog = prog;
+	foreach (wr_arg.ssp, prog->prog_statesets)
+		traverse_syntax_tree(wr_arg.ssp, writes_mask, 0, 0,
+			iter_writers, &wr_arg);
+	wr_arg.ssp = 0;
+	foreach (defn, prog->prog_defns)
+		if (defn->tag == D_FUNCDEF)
+			traverse_syntax_tree(defn->funcdef_block, writes_mask, 0, defn,
+				iter_writers, &wr_arg);
+}
+
+static long lmin(long a, long b) { return a < b ? a : b; }
+static long lmax(long a, long b) { return a > b ? a : b; }
+
+/* Parse an integer constant */
+static int const_value(Node *ep, long *pval)
+{
+	char *end;
+
+	if (ep->tag != E_CONST || !ep->token.str)
+		return FALSE;
+	errno = 0;
+	*pval = strtol(ep->token.str, &end, 0);
+	if (errno || end == ep->token.str)
+		return FALSE;
+	while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L')
+		end++;
+	return *end == 0;
+}
+
+/* Value range of variables with a small integral type */
+static int type_range(Type *t, long *plo, long *phi)
+{
+	if (t->tag != T_PRIM)
+		return FALSE;
+	switch (t->val.prim)
+	{
+	case P_CHAR:	*plo = -128; *phi = 255; return TRUE;	/* signedness varies */
+	case P_INT8T:	*plo = -128; *phi = 127; return TRUE;
+	case P_UCHAR:
+	case P_UINT8T:	*plo = 0; *phi = 255; return TRUE;
+	case P_SHORT:
+	case P_INT16T:	*plo = -32768; *phi = 32767; return TRUE;
+	case P_USHORT:
+	case P_UINT16T:	*plo = 0; *phi = 65535; return TRUE;
+	default:	return FALSE;
+	}
+}
+
+/* Bound for the values handled by expr_range; sums and differences of
+   two such values fit into a long (which may have only 32 bits) */
+#define RANGE_MAX 65536L
+
+/* Store a computed range, or fail if it exceeds +/- RANGE_MAX */
+static int set_range(long lo, long hi, long *plo, long *phi)
+{
+	if (lo < -RANGE_MAX || hi > RANGE_MAX)
+		return FALSE;
+	*plo = lo;
+	*phi = hi;
+	return TRUE;
+}
+
+/* Determine the range of values an integral expression can take. Only
+   simple cases are handled. All ranges are limited to +/- RANGE_MAX,
+   anything bigger is treated as unknown. */
+static int expr_range(Node *ep, long *plo, long *phi)
+{
+	long	llo, lhi, rlo, rhi, c;
+	char	*op = ep->token.str;
+
+	switch (ep->tag)
+	{
+	case E_CONST:
+		if (!const_value(ep, &c) || c < -RANGE_MAX || c > RANGE_MAX)
+			return FALSE;
+		*plo = *phi = c;
+		return TRUE;
+	case E_VAR:
+		return type_range(ep->extra.e_var->type, plo, phi);
+	case E_PAREN:
+		return !ep->paren_expr->next && expr_range(ep->paren_expr, plo, phi);
+	case E_TERNOP:
+		if (!expr_range(ep->ternop_then, &llo, &lhi)
+			|| !expr_range(ep->ternop_else, &rlo, &rhi))
+			return FALSE;
+		*plo = lmin(llo, rlo);
+		*phi = lmax(lhi, rhi);
+		return TRUE;
+	case E_PRE:
+		if (strcmp(op, "!") == 0)
+		{
+			*plo = 0; *phi = 1;
+			return TRUE;
+		}
+		if (strcmp(op, "-") == 0 && expr_range(ep->pre_operand, &llo, &lhi))
+		{
+			*plo = -lhi; *phi = -llo;
+			return TRUE;
+		}
+		if (strcmp(op, "+") == 0)
+			return expr_range(ep->pre_operand, plo, phi);
+		return FALSE;
+	case E_BINOP:
+		if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0
+			|| strcmp(op, "<") == 0 || strcmp(op, "<=") == 0
+			|| strcmp(op, ">") == 0 || strcmp(op, ">=") == 0
+			|| strcmp(op, "&&") == 0 || strcmp(op, "||") == 0)
+		{
+			*plo = 0; *phi = 1;
+			return TRUE;
+		}
+		if (strcmp(op, "%") == 0)
+		{
+			/* the sign of the result is that of the left operand */
+			if (!const_value(ep->binop_right, &c) || c == 0
+				|| c < -RANGE_MAX || c > RANGE_MAX)
+				return FALSE;
+			c = c < 0 ? -c : c;
+			if (expr_range(ep->binop_left, &llo, &lhi) && llo >= 0)
+			{
+				*plo = 0; *phi = lmin(lhi, c - 1);
+			}
+			else
+			{
+				*plo = -(c - 1); *phi = c - 1;
+			}
+			return TRUE;
+		}
+		if (strcmp(op, "&") == 0)
+		{
+			/* masking with a non-negative value bounds the result */
+			if (expr_range(ep->binop_right, &rlo, &rhi) && rlo >= 0)
+			{
+				*plo = 0; *phi = rhi;
+				return TRUE;
+			}
+			if (expr_range(ep->binop_left, &llo, &lhi) && llo >= 0)
+			{
+				*plo = 0; *phi = lhi;
+				return TRUE;
+			}
+			return FALSE;
+		}
+		if (!expr_range(ep->binop_left, &llo, &lhi)
+			|| !expr_range(ep->binop_right, &rlo, &rhi))
+			return FALSE;
+		if (strcmp(op, "+") == 0)
+			return set_range(llo + rlo, lhi + rhi, plo, phi);
+		if (strcmp(op, "-") == 0)
+			return set_range(llo - rhi, lhi - rlo, plo, phi);
+		if (strcmp(op, "*") == 0)
+		{
+			long lmag = lmax(-llo, lhi), rmag = lmax(-rlo, rhi);
+			long p1, p2, p3, p4;
+
+			/* check before multiplying, the product might overflow */
+			if (lmag != 0 && rmag > RANGE_MAX / lmag)
+				return FALSE;
+			p1 = llo * rlo; p2 = llo * rhi; p3 = lhi * rlo; p4 = lhi * rhi;
+			return set_range(lmin(lmin(p1, p2), lmin(p3, p4)),
+				lmax(lmax(p1, p2), lmax(p3, p4)), plo, phi);
+		}
+		if (strcmp(op, ">>") == 0 && llo >= 0 && rlo >= 0 && rhi < 31)
+		{
+			*plo = llo >> rhi; *phi = lhi >> rlo;
+			return TRUE;
+		}
+		return FALSE;
+	default:
+		return FALSE;
+	}
+}
+
+int subscr_range(Node *ix, uint length, uint *plo, uint *phi)
+{
+	long lo, hi;
+
+	if (!expr_range(ix, &lo, &hi))
+		return FALSE;
+	/* indices outside the array are undefined behaviour anyway */
+	lo = lmax(lo, 0);
+	hi = lmin(hi, (long)length - 1);
+	if (hi < lo)
+	{
+		*plo = 1;
+		*phi = 0;
+	}
+	else
+	{
+		*plo = (uint)lo;
+		*phi = (uint)hi;
+	}
+	return TRUE;
+}
+
+/* Whether a variable can change only when state set ssp changes it,
+   i.e. no other state set writes it and it is not assigned to a pv */
+static int var_is_owned(Var *vp, Node *ssp)
+{
+	return vp->assign == M_NONE && !vp->shared
+		&& (!vp->writer || vp->writer == ssp);
+}
+
+/* Whether an expression can be evaluated again without side effects.
+   If ssp is not 0, the result must also be the same, unless state set
+   ssp itself has changed something: then only constants and variables
+   owned by ssp (see var_is_owned) may be involved. */
+static int expr_is_pure(Node *ep, Node *ssp)
+{
+	char	*op = ep->token.str;
+	Var	*vp;
+
+	switch (ep->tag)
+	{
+	case E_CONST:
+		return TRUE;
+	case E_VAR:
+		vp = ep->extra.e_var;
+		if (ssp)
+			return vp->type->tag == T_PRIM && var_is_owned(vp, ssp);
+		return vp->type->tag == T_PRIM || vp->type->tag == T_NONE;
+	case E_PAREN:
+		return !ep->paren_expr->next && expr_is_pure(ep->paren_expr, ssp);
+	case E_TERNOP:
+		return expr_is_pure(ep->ternop_cond, ssp) && expr_is_pure(ep->ternop_then, ssp)
+			&& expr_is_pure(ep->ternop_else, ssp);
+	case E_PRE:
+		return strcmp(op, "++") != 0 && strcmp(op, "--") != 0
+			&& expr_is_pure(ep->pre_operand, ssp);
+	case E_BINOP:
+		if (is_assign_op(op))
+			return FALSE;
+		return expr_is_pure(ep->binop_left, ssp) && expr_is_pure(ep->binop_right, ssp);
+	case E_SUBSCR:
+		return ep->subscr_operand->tag == E_VAR
+			&& (!ssp || var_is_owned(ep->subscr_operand->extra.e_var, ssp))
+			&& expr_is_pure(ep->subscr_index, ssp);
+	default:
+		return FALSE;
+	}
+}
+
+int subscr_is_dynamic(Node *ep, Node *ssp)
+{
+	Node	*e_var, *e_ix;
+	Var	*vp;
+	uint	lo, hi;
+
+	assert(ep->tag == E_SUBSCR);
+	e_var = ep->subscr_operand;
+	e_ix = ep->subscr_index;
+	if (e_var->tag != E_VAR || e_ix->tag == E_CONST)
+		return FALSE;
+	vp = e_var->extra.e_var;
+	if (vp->type->tag != T_ARRAY || vp->assign != M_MULTI)
+		return FALSE;
+	if (subscr_range(e_ix, type_array_length1(vp->type), &lo, &hi))
+		return FALSE;
+	/* the event mask function evaluates the subscript after each
+	   wakeup; if something else can change it in between, the mask
+	   gets stale, so the caller must set the bits for all elements */
+	return expr_is_pure(e_ix, ssp);
+}
+
+typedef struct dynamic_mask_arg {
+	Node	*ssp;
+	int	found;
+} dynamic_mask_arg;
+
+static int iter_dynamic_mask(Node *ep, Node *scope, void *parg)
+{
+	dynamic_mask_arg *dm_arg = (dynamic_mask_arg *)parg;
+
+	if (subscr_is_dynamic(ep, dm_arg->ssp))
+		dm_arg->found = TRUE;
+	return !dm_arg->found;
+}
+
+Node *state_set_of_state(Node *sp)
+{
+	assert(sp->tag == D_STATE);
+	return sp->extra.e_state->var_list->parent_scope;
+}
+
+int state_has_dynamic_mask(Node *sp)
+{
+	Node			*tp;
+	dynamic_mask_arg	dm_arg;
+
+	dm_arg.ssp = state_set_of_state(sp);
+	dm_arg.found = FALSE;
+	foreach (tp, sp->state_whens)
+		traverse_syntax_tree(tp->when_cond, bit(E_SUBSCR), 0, 0,
+			iter_dynamic_mask, &dm_arg);
+	return dm_arg.found;
+}
+
+/*
+ * Performance diagnostics (option +p). These look for patterns that are
+ * correct but waste CPU or network resources at run-time.
+ */
+
+/* Name of the builtin function called by a function call node, or 0 */
+static const char *builtin_name(Node *ep)
+{
+	if (ep->tag != E_FUNC || ep->func_expr->tag != E_BUILTIN)
+		return 0;
+	return ep->func_expr->extra.e_builtin->name;
+}
+
+/* Value of a numeric constant, if the node is one */
+static int const_number(Node *ep, double *pval)
+{
+	char *end;
+
+	while (ep->tag == E_PAREN && !ep->paren_expr->next)
+		ep = ep->paren_expr;
+	if (ep->tag != E_CONST)
+		return FALSE;
+	if (ep->extra.e_const)
+	{
+		if (strcmp(ep->token.str, "TRUE") == 0)
+			*pval = 1;
+		else if (strcmp(ep->token.str, "FALSE") == 0)
+			*pval = 0;
+		else
+			return FALSE;
+		return TRUE;
+	}
+	if (ep->token.str[0] == '\'')
+		return FALSE;
+	*pval = strtod(ep->token.str, &end);
+	return end != ep->token.str;
+}
+
+/* Whether a pvGet or pvPut call blocks until completion */
+static int is_sync_request(Node *ep, const char *name, Options options)
+{
+	Node	*comp = ep->func_args ? ep->func_args->next : 0;
+
+	if (!comp)
+		return strcmp(name, "pvGet") == 0 && !options.async;
+	return comp->tag == E_CONST && comp->extra.e_const
+		&& strcmp(comp->token.str, "SYNC") == 0;
+}
+
+static int iter_perf_loop_body(Node *ep, Node *scope, void *parg)
+{
+	Options		*options = (Options *)parg;
+	const char	*name = builtin_name(ep);
+
+	if (!name)
+		return TRUE;
+	if ((strcmp(name, "pvGet") == 0 || strcmp(name, "pvPut") == 0)
+		&& is_sync_request(ep, name, *options))
+	{
+		perf_warning_at_node(ep, "synchronous %s inside a loop blocks "
+			"once per iteration\n", name);
+		report("  perhaps issue all requests with ASYNC and wait "
+			"for completion in a when() condition\n");
+	}
+	else if (strcmp(name, "pvGetComplete") == 0
+		|| strcmp(name, "pvPutComplete") == 0
+		|| strcmp(name, "pvArrayGetComplete") == 0
+		|| strcmp(name, "pvArrayPutComplete") == 0)
+	{
+		perf_warning_at_node(ep, "%s inside a loop polls for "
+			"completion\n", name);
+		report("  perhaps test it in a when() condition, so that the "
+			"state set waits for the completion event\n");
+	}
+	return TRUE;
+}
+
+static int iter_perf_loop(Node *ep, Node *scope, void *parg)
+{
+	uint i;
+
+	/* check everything inside the loop, including nested loops */
+	for (i = 0; i < node_info[ep->tag].num_children; i++)
+		traverse_syntax_tree(ep->children[i], bit(E_FUNC), 0, scope,
+			iter_perf_loop_body, parg);
+	return FALSE;
+}
+
+/* Whether a when() condition is true every time it is evaluated */
+static int is_always_true(Node *cond)
+{
+	double		val;
+	const char	*name;
+
+	if (!cond)
+		return TRUE;
+	while (cond->tag == E_PAREN && !cond->paren_expr->next)
+		cond = cond->paren_expr;
+	if (const_number(cond, &val))
+		return val != 0;
+	name = builtin_name(cond);
+	return name && strcmp(name, "delay") == 0 && cond->func_args
+		&& const_number(cond->func_args, &val) && val <= 0;
+}
+
+static void check_busy_transitions(Node *ssp)
+{
+	Node	*sp, *tp;
+
+	foreach (sp, ssp->ss_states)
+	{
+		foreach (tp, sp->state_whens)
+		{
+			if (tp->extra.e_when->next_state != sp
+				|| !is_always_true(tp->when_cond))
+				continue;
+			perf_warning_at_node(tp->when_cond ? tp->when_cond : tp,
+				"condition is always true and the transition "
+				"returns to state '%s'\n", sp->token.str);
+			report("  this keeps the state set busy; wait for an event "
+				"or use a positive delay()\n");
+		}
+	}
+}
+
+typedef struct {
+	Var	*var;
+	int	found;
+} var_ref_arg;
+
+static int iter_var_ref(Node *ep, Node *scope, void *parg)
+{
+	var_ref_arg *vr_arg = (var_ref_arg *)parg;
+
+	if (ep->tag == E_VAR && ep->extra.e_var == vr_arg->var)
+		vr_arg->found = TRUE;
+	/* calls to SNL functions or embedded C code may use anything */
+	if (ep->tag == T_TEXT || (ep->tag == E_FUNC && !builtin_name(ep)))
+		vr_arg->found = TRUE;
+	return !vr_arg->found;
+}
+
+/* Whether a variable is (or may be) referenced in a when() condition */
+static int used_in_conditions(Node *prog, Var *vp)
+{
+	Node		*ssp, *sp, *tp;
+	var_ref_arg	vr_arg;
+
+	vr_arg.var = vp;
+	vr_arg.found = FALSE;
+	foreach (ssp, prog->prog_statesets)
+		foreach (sp, ssp->ss_states)
+			foreach (tp, sp->state_whens)
+				traverse_syntax_tree(tp->when_cond,
+					bit(E_VAR)|bit(E_FUNC)|bit(T_TEXT), 0, 0,
+					iter_var_ref, &vr_arg);
+	return vr_arg.found;
+}
+
+static void check_unused_monitors(Program *p)
+{
+	Chan	*cp;
+	Var	*last = 0;
+
+	for (cp = p->chan_list->first; cp; cp = cp->next)
+	{
+		Var *vp = cp->var;
+
+		if (vp == last || !cp->monitor || cp->sync || cp->syncq)
+			continue;
+		last = vp;
+		if (!vp->decl || used_in_conditions(p->prog, vp))
+			continue;
+		perf_warning_at_node(vp->decl, "variable '%s' is monitored "
+			"but not used in any when() condition\n", vp->name);
+		report("  perhaps call pvGet where the value is needed "
+			"instead of monitoring it\n");
+	}
+}
+
+static void check_performance(Program *p)
+{
+	Node *ssp;
+
+	traverse_syntax_tree(p->prog, bit(S_FOR)|bit(S_WHILE), 0, 0,
+		iter_perf_loop, &p->options);
+	foreach (ssp, p->prog->prog_statesets)
+		check_busy_transitions(ssp);
+	check_unused_monitors(p);
+}
+
+/*
+ * Optimisation of state sets: conditions with a value known at compile
+ * time are folded, transitions that can never be taken are removed, and
+ * then states that can no longer be reached.
+ */
+
+#define COND_UNKNOWN (-1)
+
+static int iter_unsigned_const(Node *ep, Node *scope, void *parg)
+{
+	if (ep->token.str && strpbrk(ep->token.str, "uU"))
+		*(int *)parg = TRUE;
+	return TRUE;
+}
+
+/* Whether an expression contains an integer constant with an unsigned
+   suffix. Such an operand makes C compare in unsigned arithmetic, where
+   the value ranges from expr_range no longer apply (e.g. c > -1u is
+   always false). */
+static int has_unsigned_const(Node *ep)
+{
+	int found = FALSE;
+
+	traverse_syntax_tree(ep, bit(E_CONST), 0, 0, iter_unsigned_const, &found);
+	return found;
+}
+
+/* Truth value (TRUE or FALSE) of a pure condition if it can be
+   determined at compile time, else COND_UNKNOWN */
+static int cond_value(Node *ep)
+{
+	double	val;
+	long	llo, lhi, rlo, rhi;
+	int	l, r;
+	char	*op = ep->token.str;
+
+	if (const_number(ep, &val))
+		return val != 0;
+	switch (ep->tag)
+	{
+	case E_PAREN:
+		return ep->paren_expr->next ? COND_UNKNOWN : cond_value(ep->paren_expr);
+	case E_TERNOP:
+		l = cond_value(ep->ternop_cond);
+		if (l != COND_UNKNOWN)
+			return cond_value(l ? ep->ternop_then : ep->ternop_else);
+		l = cond_value(ep->ternop_then);
+		return l == cond_value(ep->ternop_else) ? l : COND_UNKNOWN;
+	case E_PRE:
+		if (strcmp(op, "!") == 0)
+		{
+			l = cond_value(ep->pre_operand);
+			return l == COND_UNKNOWN ? l : !l;
+		}
+		break;
+	case E_BINOP:
+		if (strcmp(op, "&&") == 0 || strcmp(op, "||") == 0)
+		{
+			int is_and = op[0] == '&';
+
+			l = cond_value(ep->binop_left);
+			r = cond_value(ep->binop_right);
+			/* the value of one operand can decide the result */
+			if (l == !is_and || r == !is_and)
+				return !is_and;
+			if (l == is_and && r == is_and)
+				return is_and;
+			return COND_UNKNOWN;
+		}
+		if (has_unsigned_const(ep->binop_left)
+			|| has_unsigned_const(ep->binop_right)
+			|| !expr_range(ep->binop_left, &llo, &lhi)
+			|| !expr_range(ep->binop_right, &rlo, &rhi))
+			break;
+		if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0)
+		{
+			int eq = op[0] == '=';
+
+			if (llo == lhi && rlo == rhi && llo == rlo)
+				return eq;
+			if (lhi < rlo || rhi < llo)
+				return !eq;
+			return COND_UNKNOWN;
+		}
+		if (strcmp(op, ">") == 0 || strcmp(op, ">=") == 0)
+		{
+			/* swap operands and test with < or <= */
+			long t;
+			t = llo; llo = rlo; rlo = t;
+			t = lhi; lhi = rhi; rhi = t;
+		}
+		if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0)
+		{
+			if (lhi < rlo)
+				return TRUE;
+			if (llo >= rhi)
+				return FALSE;
+			return COND_UNKNOWN;
+		}
+		if (strcmp(op, "<=") == 0 || strcmp(op, ">=") == 0)
+		{
+			if (lhi <= rlo)
+				return TRUE;
+			if (llo > rhi)
+				return FALSE;
+			return COND_UNKNOWN;
+		}
+		break;
+	default:
+		break;
+	}
+	if (expr_range(ep, &llo, &lhi))
+	{
+		if (llo > 0 || lhi < 0)
+			return TRUE;
+		if (llo == 0 && lhi == 0)
+			return FALSE;
+	}
+	return COND_UNKNOWN;
+}
+
+/* Fold the conditions of a state and remove transitions that are never
+   taken: those with a condition that is always false, and all following
+   a transition with a condition that is always true. The latter are
+   reported if xwarn (option +W, which may be given in the program). */
+static void fold_conditions(Node *sp, int xwarn)
+{
+	Node	*tp, **ptp;
+	int	value, taken = FALSE;
+
+	ptp = &sp->state_whens;
+	while ((tp = *ptp))
+	{
+		if (taken)
+		{
+			if (xwarn)
+				warning_at_node(tp, "transition is never taken, "
+					"since an earlier condition is always true\n");
+			*ptp = tp->next;
+			continue;
+		}
+		if (is_always_true(tp->when_cond))
+			value = TRUE;
+		else if (expr_is_pure(tp->when_cond, 0))
+			value = cond_value(tp->when_cond);
+		else
+			value = COND_UNKNOWN;
+		if (value == FALSE)
+		{
+			*ptp = tp->next;
+			continue;
+		}
+		if (value == TRUE)
+		{
+			tp->when_cond = 0;
+			taken = TRUE;
+		}
+		ptp = &tp->next;
+	}
+	/* the state set never needs to wait for an event in this state */
+	if (sp->state_whens && !sp->state_whens->when_cond)
+		sp->extra.e_state->options.no_wait = TRUE;
+}
+
+/* Whether a state has local variables that are assigned to channels */
+static int has_assigned_vars(Node *sp)
+{
+	Var *vp;
+
+	foreach (vp, sp->extra.e_state->var_list->first)
+		if (vp->assign != M_NONE)
+			return TRUE;
+	return FALSE;
+}
+
+/* Remove states that can no longer be reached after fold_conditions, and
+   re-number the remaining ones */
+static void remove_unreachable_states(Node *ssp)
+{
+	Node	*sp, **psp;
+	uint	num_states = 0;
+
+	foreach (sp, ssp->ss_states)
+		sp->extra.e_state->is_target = FALSE;
+	ssp->ss_states->extra.e_state->is_target = TRUE;
+	mark_states_reachable_from(ssp->ss_states);
+
+	psp = &ssp->ss_states;
+	while ((sp = *psp))
+	{
+		if (!sp->extra.e_state->is_target && !has_assigned_vars(sp))
+		{
+			*psp = sp->next;
+			continue;
+		}
+		sp->extra.e_state->index = num_states++;
+		psp = &sp->next;
+	}
+	ssp->extra.e_ss->num_states = num_states;
+}
+
+static void optimise_state_set(Node *ssp, int xwarn)
+{
+	Node *sp;
+
+	foreach (sp, ssp->ss_states)
+		fold_conditions(sp, xwarn);
+	remove_unreachable_states(ssp);
+}
@@ -44,4 +44,21 @@ Node *defn_list_from_scope(Node *scope);
 
 Program *analyse_program(Node *ep, Options options);
 
+/* Range of array elements [*plo,*phi] that a subscript expression can
+   select, if it can be determined at compile time; *plo > *phi means none */
+int subscr_range(Node *ix, uint length, uint *plo, uint *phi);
+
+/* Whether a subscripted expression (E_SUBSCR) of an array assigned to
+   multiple channels, in a when() condition of state set ssp, needs a
+   run-time computed event mask, i.e. its index can not be bounded at
+   compile time, has no side effects, and only state set ssp can change
+   its value. */
+int subscr_is_dynamic(Node *ep, Node *ssp);
+
+/* The state set a state belongs to */
+Node *state_set_of_state(Node *sp);
+
+/* Whether any when() condition of a state has such a subscript */
+int state_has_dynamic_mask(Node *sp);
+
 #endif	/*INCLanalysish*/
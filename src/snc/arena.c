@@ -0,0 +1,117 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Memory allocation and string interning
+\*************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "main.h"
+#include "arena.h"
+
+/* Nothing the compiler allocates is ever freed before it exits, so
+   there is no need to keep track of the blocks. */
+
+#define ARENA_BLOCK_SIZE	(64*1024)
+
+/* Allocations are aligned for the most demanding of these types */
+typedef union {
+	void	*p;
+	long	l;
+	double	d;
+} arena_align;
+
+static char *arena_next, *arena_limit;
+
+static void *checked_calloc(size_t size)
+{
+	void *result = calloc(1, size);
+
+	if (!result)
+	{
+		report("out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return result;
+}
+
+void *arena_alloc(size_t size)
+{
+	char *result;
+
+	size = (size + sizeof(arena_align) - 1)
+		/ sizeof(arena_align) * sizeof(arena_align);
+	if (size > (size_t)(arena_limit - arena_next))
+	{
+		/* large requests get a block of their own */
+		if (size > ARENA_BLOCK_SIZE / 4)
+			return checked_calloc(size);
+		arena_next = (char *)checked_calloc(ARENA_BLOCK_SIZE);
+		arena_limit = arena_next + ARENA_BLOCK_SIZE;
+	}
+	result = arena_next;
+	arena_next += size;
+	return result;
+}
+
+/* Open addressing hash table of interned strings; the size is a power
+   of 2 and at most half of the slots are used. */
+static char **intern_table;
+static size_t intern_size, intern_count;
+
+static size_t hash_string(const char *str, size_t len)
+{
+	size_t h = 2166136261u;	/* FNV-1a */
+
+	while (len--)
+		h = (h ^ (unsigned char)*str++) * 16777619u;
+	return h;
+}
+
+static void intern_grow(void)
+{
+	char	**old_table = intern_table;
+	size_t	old_size = intern_size;
+	size_t	i;
+
+	intern_size = old_size ? 2 * old_size : 4096;
+	intern_table = (char **)checked_calloc(intern_size * sizeof(char *));
+	for (i = 0; i < old_size; i++)
+	{
+		char *str = old_table[i];
+
+		if (str)
+		{
+			size_t j = hash_string(str, strlen(str)) & (intern_size - 1);
+
+			while (intern_table[j])
+				j = (j + 1) & (intern_size - 1);
+			intern_table[j] = str;
+		}
+	}
+	free(old_table);
+}
+
+char *intern(const char *str, size_t len)
+{
+	size_t	i;
+	char	*result;
+
+	if (2 * (intern_count + 1) > intern_size)
+		intern_grow();
+	i = hash_string(str, len) & (intern_size - 1);
+	while ((result = intern_table[i]) != 0)
+	{
+		if (strncmp(result, str, len) == 0 && result[len] == 0)
+			return result;
+		i = (i + 1) & (intern_size - 1);
+	}
+	result = (char *)arena_alloc(len + 1);
+	memcpy(result, str, len);
+	intern_table[i] = result;
+	intern_count++;
+	return result;
+}
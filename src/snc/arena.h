@@ -0,0 +1,23 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in the file LICENSE that is included with this distribution.
+\*************************************************************************/
+/*************************************************************************\
+                Memory allocation and string interning
+\*************************************************************************/
+#ifndef INCLarenah
+#define INCLarenah
+
+#include <stddef.h>
+
+/* Allocate zero-initialized memory that lives until snc exits. Memory is
+   taken from large blocks and cannot be freed individually. Does not
+   return if out of memory. */
+void *arena_alloc(size_t size);
+
+/* Return the unique copy of the string with the given length (which
+   need not be zero terminated). Interned strings are equal if and only
+   if their pointers are equal. */
+char *intern(const char *str, size_t len);
+
+#endif /*INCLarenah*/
@@ -4,6 +4,9 @@ Copyright (c) 2010-2015 Helmholtz-Zentrum Berlin f. Materialien
 This file is distributed subject to a Software License Agreement found
 in the file LICENSE that is included with this distribution.
 \*************************************************************************/
+#include <string.h>
+#include <assert.h>
+
 #include "builtin.h"
 
 static struct const_symbol const_symbols[] =
@@ -76,84 +79,91 @@ static const struct param *pvPutCompleteParams[]         = {&pvP,&defLenP,&boolP
 
 static struct func_symbol func_symbols[] =
 {
-    /* name              c_name     action_only cond_only params                    */
-    {"delay",               0,          FALSE,  TRUE,   otherParams                 },
-    {"efClear",             0,          TRUE,   FALSE,  efParams                    },
-    {"efSet",               0,          TRUE,   FALSE,  efParams                    },
-    {"efTest",              0,          FALSE,  FALSE,  efParams                    },
-    {"efTestAndClear",      0,          FALSE,  FALSE,  efParams                    },
-    {"macValueGet",         0,          FALSE,  FALSE,  otherParams                 },
-    {"optGet",              0,          FALSE,  FALSE,  otherParams                 },
-    {"pvAssign",            0,          FALSE,  FALSE,  assignParams                },
-    {"pvAssignCount",       0,          FALSE,  FALSE,  noParams                    },
-    {"pvAssignSubst",       0,          FALSE,  FALSE,  assignParams                },
-    {"pvAssigned",          0,          FALSE,  FALSE,  pvParams                    },
-    {"pvChannelCount",      0,          FALSE,  FALSE,  noParams                    },
-    {"pvConnectCount",      0,          FALSE,  FALSE,  noParams                    },
-    {"pvConnected",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayConnected",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvCount",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvFlush",             0,          FALSE,  FALSE,  noParams                    },
-    {"pvFlushQ",            0,          FALSE,  FALSE,  pvParams                    },
-    {"pvFreeQ",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvGet",               "pvGetTmo", FALSE,  FALSE,  pvGetPutParams              },
-    {"pvGetCancel",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayGetCancel",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvGetComplete",       0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayGetComplete",  0,          FALSE,  FALSE,  pvArrayGetPutCompleteParams },
-    {"pvGetQ",              0,          FALSE,  FALSE,  pvParams                    },
-    {"pvIndex",             0,          FALSE,  FALSE,  pvParams                    },
-    {"pvMessage",           0,          FALSE,  FALSE,  pvParams                    },
-    {"pvMonitor",           0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayMonitor",      0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvName",              0,          FALSE,  FALSE,  pvParams                    },
-    {"pvPut",               "pvPutTmo", FALSE,  FALSE,  pvGetPutParams              },
-    {"pvPutCancel",         0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayPutCancel",    0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvPutComplete",       0,          FALSE,  FALSE,  pvPutCompleteParams         },
-    {"pvArrayPutComplete",  0,          FALSE,  FALSE,  pvArrayGetPutCompleteParams },
-    {"pvSeverity",          0,          FALSE,  FALSE,  pvParams                    },
-    {"pvStatus",            0,          FALSE,  FALSE,  pvParams                    },
-    {"pvStopMonitor",       0,          FALSE,  FALSE,  pvParams                    },
-    {"pvArrayStopMonitor",  0,          FALSE,  FALSE,  pvArrayParams               },
-    {"pvSync",              0,          FALSE,  FALSE,  pvSyncParams                },
-    {"pvArraySync",         0,          FALSE,  FALSE,  pvArraySyncParams           },
-    {"pvTimeStamp",         0,          FALSE,  FALSE,  pvParams                    },
-    {0,                     0,          FALSE,  FALSE,  0                           }
+    /* name              c_name     action_only cond_only conn    params                    */
+    {"delay",               0,          FALSE,  TRUE,   FALSE,  otherParams                 },
+    {"efClear",             0,          TRUE,   FALSE,  FALSE,  efParams                    },
+    {"efSet",               0,          TRUE,   FALSE,  FALSE,  efParams                    },
+    {"efTest",              0,          FALSE,  FALSE,  FALSE,  efParams                    },
+    {"efTestAndClear",      0,          FALSE,  FALSE,  FALSE,  efParams                    },
+    {"macValueGet",         0,          FALSE,  FALSE,  FALSE,  otherParams                 },
+    {"optGet",              0,          FALSE,  FALSE,  FALSE,  otherParams                 },
+    {"pvAssign",            0,          FALSE,  FALSE,  FALSE,  assignParams                },
+    {"pvAssignCount",       0,          FALSE,  FALSE,  TRUE,   noParams                    },
+    {"pvAssignSubst",       0,          FALSE,  FALSE,  FALSE,  assignParams                },
+    {"pvAssigned",          0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvChannelCount",      0,          FALSE,  FALSE,  FALSE,  noParams                    },
+    {"pvConnectCount",      0,          FALSE,  FALSE,  TRUE,   noParams                    },
+    {"pvConnected",         0,          FALSE,  FALSE,  TRUE,   pvParams                    },
+    {"pvArrayConnected",    0,          FALSE,  FALSE,  TRUE,   pvArrayParams               },
+    {"pvCount",             0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvFlush",             0,          FALSE,  FALSE,  FALSE,  noParams                    },
+    {"pvFlushQ",            0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvFreeQ",             0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvGet",               "pvGetTmo", FALSE,  FALSE,  FALSE,  pvGetPutParams              },
+    {"pvGetCancel",         0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayGetCancel",    0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvGetComplete",       0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayGetComplete",  0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutCompleteParams },
+    {"pvGetQ",              0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvIndex",             0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvMessage",           0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvMonitor",           0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayMonitor",      0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvName",              0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvPut",               "pvPutTmo", FALSE,  FALSE,  FALSE,  pvGetPutParams              },
+    {"pvPutCancel",         0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayPutCancel",    0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvPutComplete",       0,          FALSE,  FALSE,  FALSE,  pvPutCompleteParams         },
+    {"pvArrayPutComplete",  0,          FALSE,  FALSE,  FALSE,  pvArrayGetPutCompleteParams },
+    {"pvSeverity",          0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvStatus",            0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvStopMonitor",       0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {"pvArrayStopMonitor",  0,          FALSE,  FALSE,  FALSE,  pvArrayParams               },
+    {"pvSync",              0,          FALSE,  FALSE,  FALSE,  pvSyncParams                },
+    {"pvArraySync",         0,          FALSE,  FALSE,  FALSE,  pvArraySyncParams           },
+    {"pvTimeStamp",         0,          FALSE,  FALSE,  FALSE,  pvParams                    },
+    {0,                     0,          FALSE,  FALSE,  FALSE,  0                           }
 };
 
-/* Insert builtin constants into symbol table */
-void register_builtin_consts(SymTable sym_table)
+/* Symbol table for builtins; it is created once and shared by all
+   programs compiled by this process */
+static SymTable builtin_table;
+static int builtin_table_valid;
+
+/* Insert builtin constants and functions into the builtin symbol table */
+void register_builtins(void)
 {
-    struct const_symbol *sym;
+    struct const_symbol *csym;
+    struct func_symbol *fsym;
 
-    for (sym = const_symbols; sym->name; sym++) {
+    if (builtin_table_valid)
+        return;
+    builtin_table = sym_table_create();
+    builtin_table_valid = TRUE;
+    for (csym = const_symbols; csym->name; csym++) {
         /* use address of const_symbols array as the symbol type */
-        sym_table_insert(sym_table, sym->name, const_symbols, sym);
+        sym_table_insert(builtin_table, intern(csym->name, strlen(csym->name)),
+            const_symbols, csym);
     }
-}
-
-/* Insert builtin functions into symbol table */
-void register_builtin_funcs(SymTable sym_table)
-{
-    struct func_symbol *sym;
-
-    for (sym = func_symbols; sym->name; sym++) {
+    for (fsym = func_symbols; fsym->name; fsym++) {
         /* use address of func_symbols array as the symbol type */
-        sym_table_insert(sym_table, sym->name, func_symbols, sym);
+        sym_table_insert(builtin_table, intern(fsym->name, strlen(fsym->name)),
+            func_symbols, fsym);
     }
 }
 
-/* Look up a builtin function from the symbol table */
-struct func_symbol *lookup_builtin_func(SymTable sym_table, const char *func_name)
+/* Look up a builtin function */
+struct func_symbol *lookup_builtin_func(const char *func_name)
 {
+    assert(builtin_table_valid);
     /* use address of func_symbols array as the symbol type */
-    return (struct func_symbol *)sym_table_lookup(sym_table, func_name, func_symbols);
+    return (struct func_symbol *)sym_table_lookup(builtin_table, func_name, func_symbols);
 }
 
-/* Look up a builtin constant from the symbol table */
-struct const_symbol *lookup_builtin_const(SymTable sym_table, const char *const_name)
+/* Look up a builtin constant */
+struct const_symbol *lookup_builtin_const(const char *const_name)
 {
+    assert(builtin_table_valid);
     /* use address of const_symbols array as the symbol type */
-    return (struct const_symbol *)sym_table_lookup(sym_table, const_name, const_symbols);
+    return (struct const_symbol *)sym_table_lookup(builtin_table, const_name, const_symbols);
 }
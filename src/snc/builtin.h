@@ -36,19 +36,17 @@ struct func_symbol {
     const char *c_name;         /* C name, or 0 if same as SNL name */
     uint action_only:1;         /* not allowed in when-conditions */
     uint cond_only:1;           /* only allowed in when-conditions */
+    uint conn:1;                /* depends on connection status */
     const struct param **params;/* parameter descriptions */
 };
 
-/* Insert builtin constants into symbol table */
-void register_builtin_consts(SymTable sym_table);
+/* Create the builtin symbol table; does nothing if it already exists */
+void register_builtins(void);
 
-/* Insert builtin functions into symbol table */
-void register_builtin_funcs(SymTable sym_table);
+/* Look up a builtin function */
+struct func_symbol *lookup_builtin_func(const char *func_name);
 
-/* Look up a builtin function from the symbol table */
-struct func_symbol *lookup_builtin_func(SymTable sym_table, const char *func_name);
-
-/* Look up a builtin constant from the symbol table */
-struct const_symbol *lookup_builtin_const(SymTable sym_table, const char *const_name);
+/* Look up a builtin constant */
+struct const_symbol *lookup_builtin_const(const char *const_name);
 
 #endif /*INCLbuiltinh */
@@ -29,6 +29,14 @@ static void gen_var_struct(Node *prog, uint opt_reent);
 static void gen_init_reg(char *prog_name);
 static void gen_func_decls(Node *prog);
 static void gen_global_defn(Node *defn);
+static void gen_single(Program *p);
+static void gen_split(Program *p);
+static int can_split(Program *p);
+static int is_preprocessor_text(const char *text);
+static void gen_prologue(Program *p);
+static void gen_state_func_decls(Node *prog);
+static void gen_state_func_decl(const char *type, const char *prefix,
+	Node *ssp, uint ss_num, Node *sp);
 
 static int assert_var_declared(Node *ep, Node *scope, void *parg)
 {
@@ -43,11 +51,12 @@ static int assert_var_declared(Node *ep, Node *scope, void *parg)
 	return TRUE;		/* there are no children anyway */
 }
 
+/* Name of the program if output is split (option +S), else 0 */
+static const char *split_prog_name;
+
 /* Generate C code from parse tree. */
 void generate_code(Program *p)
 {
-	Node *defn;
-
 	/* assume there have been no errors, so all vars are declared */
 	traverse_syntax_tree(p->prog, bit(E_VAR), 0, 0, assert_var_declared, 0);
 
@@ -55,10 +64,137 @@ void generate_code(Program *p)
 	report("-------------------- Code Generation --------------------\n");
 #endif
 
+	split_prog_name = p->options.split && can_split(p) ? p->name : 0;
+
+	if (split_prog_name)
+		gen_split(p);
+	else
+		gen_single(p);
+}
+
+/* Generate everything into one file */
+static void gen_single(Program *p)
+{
+	Node *defn;
+
 	/* Initial comments */
 	gen_code("/* C code for program %s, ", p->name);
 	gen_code("generated by snc from %s */\n", p->prog->token.file);
 
+	gen_prologue(p);
+
+	/* Function declarations */
+	gen_func_decls(p->prog);
+
+	/* State and state set functions */
+	gen_ss_code(p->prog, p->options, p->num_event_flags);
+
+	/* Channel, state set, and program tables */
+	gen_tables(p);
+
+	/* Extra definitions */
+	foreach (defn, p->prog->prog_xdefns) gen_global_defn(defn);
+
+	/* Main function */
+	if (p->options.main) gen_main(p->name);
+
+	/* Sequencer registration */
+	gen_init_reg(p->name);
+}
+
+/* Generate a header with the declarations, one file with the functions
+   for each state set, and the tables etc. into the output file. A state
+   set file is only rewritten if its content changes, so that editing
+   one state set recompiles only its own file and the output file. */
+static void gen_split(Program *p)
+{
+	Node		*defn, *ssp;
+	uint		ss_num = 0;
+	const char	*header;
+	char		*suffix;
+
+	header = gen_output_begin("_seqg.h");
+	gen_code("/* Declarations for program %s, ", p->name);
+	gen_code("generated by snc from %s */\n", p->prog->token.file);
+	gen_prologue(p);
+	gen_state_func_decls(p->prog);
+	gen_output_end();
+
+	gen_code("/* C code for program %s, ", p->name);
+	gen_code("generated by snc from %s */\n", p->prog->token.file);
+	gen_code("#include \"%s\"\n", header);
+	gen_prog_code(p->prog, p->options, p->num_event_flags);
+	gen_tables(p);
+	foreach (defn, p->prog->prog_xdefns) gen_global_defn(defn);
+	if (p->options.main) gen_main(p->name);
+	gen_init_reg(p->name);
+
+	foreach (ssp, p->prog->prog_statesets)
+	{
+		suffix = (char *)malloc(strlen(ssp->token.str) + 9);
+		sprintf(suffix, "_seqg_%s.c", ssp->token.str);
+		gen_output_begin(suffix);
+		free(suffix);
+		gen_code("/* C code for state set %s of program %s, ",
+			ssp->token.str, p->name);
+		gen_code("generated by snc from %s */\n", p->prog->token.file);
+		gen_code("#include \"%s\"\n", header);
+		gen_single_ss_code(ssp, ss_num, p->options, p->num_event_flags);
+		gen_output_end();
+		ss_num++;
+	}
+}
+
+/* Whether the state set functions can be compiled separately. This
+   excludes everything that generates definitions with internal linkage
+   that the state set code might refer to. */
+static int can_split(Program *p)
+{
+	Node		*defn;
+	const char	*reason = 0;
+
+	if (!p->options.reent)
+		reason = "it requires option +r";
+	foreach (defn, p->prog->prog_defns)
+	{
+		if (defn->tag == D_FUNCDEF)
+			reason = "the program defines functions";
+		else if (defn->tag == T_TEXT && !is_preprocessor_text(defn->token.str))
+			reason = "the program contains embedded C code other than preprocessor directives";
+	}
+	foreach (defn, p->prog->prog_xdefns)
+	{
+		if (defn->tag == D_FUNCDEF)
+			reason = "the program defines functions";
+	}
+	if (reason)
+		warning_at_node(p->prog, "cannot split output: %s; "
+			"generating a single file\n", reason);
+	return reason == 0;
+}
+
+/* Whether every non-blank line of the text is a preprocessor directive */
+static int is_preprocessor_text(const char *text)
+{
+	while (*text)
+	{
+		while (*text == ' ' || *text == '\t')
+			text++;
+		if (*text && *text != '\n' && *text != '#')
+			return FALSE;
+		while (*text && *text != '\n')
+			text++;
+		if (*text)
+			text++;
+	}
+	return TRUE;
+}
+
+/* Includes, global definitions, and variable declarations */
+static void gen_prologue(Program *p)
+{
+	Node *defn;
+
 	/* Includes */
 	gen_code("#include <string.h>\n");
 	gen_code("#include <stddef.h>\n");
@@ -74,24 +210,54 @@ void generate_code(Program *p)
 
 	/* Variable declarations */
 	gen_var_struct(p->prog, p->options.reent);
+}
 
-	/* Function declarations */
-	gen_func_decls(p->prog);
-
-	/* State and state set functions */
-	gen_ss_code(p->prog, p->options);
+/* Declarations of the state functions, which are defined in the
+   state set files and referred to by the state tables (option +S) */
+static void gen_state_func_decls(Node *prog)
+{
+	Node	*ssp, *sp;
+	uint	ss_num = 0;
 
-	/* Channel, state set, and program tables */
-	gen_tables(p);
+	gen_code("\n/* State function declarations */\n");
+	foreach (ssp, prog->prog_statesets)
+	{
+		foreach (sp, ssp->ss_states)
+		{
+			if (sp->state_entry)
+				gen_state_func_decl("SEQ_SS_FUNC", NM_ENTRY, ssp, ss_num, sp);
+			if (sp->state_exit)
+				gen_state_func_decl("SEQ_SS_FUNC", NM_EXIT, ssp, ss_num, sp);
+			gen_state_func_decl("SEQ_EVENT_FUNC", NM_EVENT, ssp, ss_num, sp);
+			gen_state_func_decl("SEQ_TRANS_FUNC", NM_ACTION, ssp, ss_num, sp);
+			if (state_has_dynamic_mask(sp))
+				gen_state_func_decl("SEQ_MASK_FUNC", NM_DYNMASK, ssp, ss_num, sp);
+		}
+		ss_num++;
+	}
+}
 
-	/* Extra definitions */
-	foreach (defn, p->prog->prog_xdefns) gen_global_defn(defn);
+static void gen_state_func_decl(const char *type, const char *prefix,
+	Node *ssp, uint ss_num, Node *sp)
+{
+	gen_code("%s ", type);
+	gen_state_func_name(prefix, ssp->token.str, ss_num, sp->token.str);
+	gen_code(";\n");
+}
 
-	/* Main function */
-	if (p->options.main) gen_main(p->name);
+void gen_state_func_name(const char *prefix, const char *ss_name,
+	uint ss_num, const char *state_name)
+{
+	if (split_prog_name)
+		gen_code("%s_%s_%s_%d_%s", prefix, split_prog_name, ss_name,
+			ss_num, state_name);
+	else
+		gen_code("%s_%s_%d_%s", prefix, ss_name, ss_num, state_name);
+}
 
-	/* Sequencer registration */
-	gen_init_reg(p->name);
+const char *gen_state_func_storage(void)
+{
+	return split_prog_name ? "" : "static ";
 }
 
 /* Generate main program */
@@ -132,13 +298,17 @@ static void gen_func_decls(Node *prog)
    set and state local variables are _visible_ only inside the block
    where they are declared, but still have global lifetime. To avoid
    name collisions, generate a nested struct for each state set, and
-   for each state in a state set. */
+   for each state in a state set.
+   Top-level variables assigned to channels come first, so that the
+   shared buffer for channel values (the "world view" in safe mode) is
+   a contiguous block at the start of the struct. */
 static void gen_var_struct(Node *prog, uint opt_reent)
 {
 	Var	*vp;
 	Node	*sp, *ssp;
 	uint	num_globals = 0;
 	uint	num_decls = 0;
+	int	assigned;
 
 	gen_code("\n/* Variable declarations */\n");
 
@@ -147,18 +317,21 @@ static void gen_var_struct(Node *prog, uint opt_reent)
 		gen_code("struct %s {\n", NM_VARS);
 	}
 	/* Convert internal type to `C' type */
-	foreach (vp, var_list_from_scope(prog)->first)
+	for (assigned = TRUE; assigned >= FALSE; assigned--)
 	{
-		if (vp->decl && vp->type->tag != T_NONE && vp->type->tag != T_EVFLAG &&
-			vp->type->tag != T_FUNCTION)
+		foreach (vp, var_list_from_scope(prog)->first)
 		{
-			gen_line_marker(vp->decl);
-			if (!opt_reent) gen_code("static");
-			indent(1);
-			gen_var_decl(vp);
-			num_decls++;
-			gen_code(";\n");
-			num_globals++;
+			if (vp->decl && vp->type->tag != T_NONE && vp->type->tag != T_EVFLAG &&
+				vp->type->tag != T_FUNCTION && (vp->assign != M_NONE) == assigned)
+			{
+				gen_line_marker(vp->decl);
+				if (!opt_reent) gen_code("static");
+				indent(1);
+				gen_var_decl(vp);
+				num_decls++;
+				gen_code(";\n");
+				num_globals++;
+			}
 		}
 	}
 	if (opt_reent && !num_globals)
@@ -20,11 +20,20 @@ void gen_defn_c_code(Node *scope, int level);
 void gen_var_decl(Var *vp);
 void indent(int level);
 
+/* name of a state function; if output is split (option +S), the name
+   includes the program name, since these functions are then extern */
+void gen_state_func_name(const char *prefix, const char *ss_name,
+	uint ss_num, const char *state_name);
+/* storage class for state functions: "static " unless output is split */
+const char *gen_state_func_storage(void);
+
 /* names and name prefixes for generated structs */
 #define NM_VARS		"seqg_vars"
 #define NM_CHANS	"seqg_chans"
 #define NM_STATES	"seqg_states"
 #define NM_STATESETS	"seqg_statesets"
+#define NM_CHANMASK	"seqg_chanmask"
+#define NM_CHNAMES	"seqg_chnames"
 
 /* names and name prefixes for generated functions */
 #define NM_ENTRY	"seqg_entry"
@@ -33,6 +42,7 @@ void indent(int level);
 #define NM_ACTION	"seqg_action"
 #define NM_EVENT	"seqg_event"
 #define NM_MASK		"seqg_mask"
+#define NM_DYNMASK	"seqg_dynmask"
 
 /* names of generated function arguments */
 #define NM_VAR		"seqg_var"
@@ -40,6 +50,8 @@ void indent(int level);
 #define NM_TRN		"seqg_trn"
 #define NM_PTRN		"seqg_ptrn"
 #define NM_PNST		"seqg_pnst"
+#define NM_PMASK	"seqg_pmask"
+#define NM_IX		"seqg_ix"
 
 /* prefix for generated inititialization variable names */
 #define NM_INITVAR	"seqg_initvar_"
@@ -25,6 +25,7 @@ in the file LICENSE that is included with this distribution.
 static const int impossible = 0;
 
 static void gen_local_var_decls(Node *scope, int context, int level);
+static void gen_ss_funcs(Node *ssp, uint ss_num);
 static void gen_state_func(
 	const char *ss_name,
 	uint ss_num,
@@ -40,6 +41,7 @@ static void gen_state_func(
 static void gen_entex_body(Node *xp, int context);
 static void gen_event_body(Node *xp, int context);
 static void gen_action_body(Node *xp, int context);
+static void gen_dynamic_mask_body(Node *xp, int context);
 static void gen_expr(int context, Node *ep, int level);
 static void gen_builtin_call(int context, Node *ep);
 static void gen_ef_arg(
@@ -92,14 +94,18 @@ enum context
  */
 static Options global_options;
 
+/* Same hack for the number of event flags, needed to compute event bits */
+static uint global_num_event_flags;
+
 /* Generate state set C code from analysed syntax tree */
-void gen_ss_code(Node *prog, Options options)
+void gen_ss_code(Node *prog, Options options, uint num_event_flags)
 {
-	Node	*sp, *ssp;
+	Node	*ssp;
 	uint	ss_num = 0;
 
-	/* HACK: intialise global variable as implicit parameter */
+	/* HACK: intialise global variables as implicit parameters */
 	global_options = options;
+	global_num_event_flags = num_event_flags;
 
 	gen_code("\n#define " NM_VAR " (*(struct " NM_VARS " *const *)" NM_ENV ")\n");
 
@@ -113,32 +119,7 @@ void gen_ss_code(Node *prog, Options options)
 	/* For each state set ... */
 	foreach (ssp, prog->prog_statesets)
 	{
-		/* For each state ... */
-		foreach (sp, ssp->ss_states)
-		{
-			gen_code("\n/****** Code for state \"%s\" in state set \"%s\" ******/\n",
-				sp->token.str, ssp->token.str);
-
-			/* Generate entry and exit functions */
-			if (sp->state_entry)
-				gen_state_func(ssp->token.str, ss_num, sp->token.str, 
-					sp->state_entry, gen_entex_body,
-					C_SS, "Entry", NM_ENTRY, "void", "");
-			if (sp->state_exit)
-				gen_state_func(ssp->token.str, ss_num, sp->token.str,
-					sp->state_exit, gen_entex_body,
-					C_SS, "Exit", NM_EXIT, "void", "");
-			/* Generate event processing function */
-			gen_state_func(ssp->token.str, ss_num, sp->token.str,
-				sp->state_whens, gen_event_body,
-				C_SS, "Event", NM_EVENT, "seqBool",
-				", int *"NM_PTRN", int *"NM_PNST);
-			/* Generate action processing function */
-			gen_state_func(ssp->token.str, ss_num, sp->token.str,
-				sp->state_whens, gen_action_body,
-				C_TRANS, "Action", NM_ACTION, "void",
-				", int "NM_TRN", int *"NM_PNST);
-		}
+		gen_ss_funcs(ssp, ss_num);
 		ss_num++;
 	}
 
@@ -149,6 +130,71 @@ void gen_ss_code(Node *prog, Options options)
 	gen_code("\n#undef " NM_VAR "\n");
 }
 
+/* Generate only the program init, entry, and exit functions (option +S) */
+void gen_prog_code(Node *prog, Options options, uint num_event_flags)
+{
+	global_options = options;
+	global_num_event_flags = num_event_flags;
+
+	gen_code("\n#define " NM_VAR " (*(struct " NM_VARS " *const *)" NM_ENV ")\n");
+	gen_prog_func(prog, "init", NM_INIT, gen_prog_init_body);
+	if (prog->prog_entry)
+		gen_prog_entex_func(prog, "entry", NM_ENTRY, gen_prog_entry_body);
+	if (prog->prog_exit)
+		gen_prog_entex_func(prog, "exit", NM_EXIT, gen_prog_exit_body);
+	gen_code("\n#undef " NM_VAR "\n");
+}
+
+/* Generate only the functions of one state set (option +S) */
+void gen_single_ss_code(Node *ssp, uint ss_num, Options options, uint num_event_flags)
+{
+	global_options = options;
+	global_num_event_flags = num_event_flags;
+
+	gen_code("\n#define " NM_VAR " (*(struct " NM_VARS " *const *)" NM_ENV ")\n");
+	gen_ss_funcs(ssp, ss_num);
+	gen_code("\n#undef " NM_VAR "\n");
+}
+
+/* Generate the functions for all states of a state set */
+static void gen_ss_funcs(Node *ssp, uint ss_num)
+{
+	Node	*sp;
+
+	/* For each state ... */
+	foreach (sp, ssp->ss_states)
+	{
+		gen_code("\n/****** Code for state \"%s\" in state set \"%s\" ******/\n",
+			sp->token.str, ssp->token.str);
+
+		/* Generate entry and exit functions */
+		if (sp->state_entry)
+			gen_state_func(ssp->token.str, ss_num, sp->token.str, 
+				sp->state_entry, gen_entex_body,
+				C_SS, "Entry", NM_ENTRY, "void", "");
+		if (sp->state_exit)
+			gen_state_func(ssp->token.str, ss_num, sp->token.str,
+				sp->state_exit, gen_entex_body,
+				C_SS, "Exit", NM_EXIT, "void", "");
+		/* Generate event processing function */
+		gen_state_func(ssp->token.str, ss_num, sp->token.str,
+			sp->state_whens, gen_event_body,
+			C_SS, "Event", NM_EVENT, "seqBool",
+			", int *"NM_PTRN", int *"NM_PNST);
+		/* Generate action processing function */
+		gen_state_func(ssp->token.str, ss_num, sp->token.str,
+			sp->state_whens, gen_action_body,
+			C_TRANS, "Action", NM_ACTION, "void",
+			", int "NM_TRN", int *"NM_PNST);
+		/* Generate event mask function if needed */
+		if (state_has_dynamic_mask(sp))
+			gen_state_func(ssp->token.str, ss_num, sp->token.str,
+				sp, gen_dynamic_mask_body,
+				C_COND, "Event mask", NM_DYNMASK, "void",
+				", seqMask *"NM_PMASK);
+	}
+}
+
 /* Generate a local C variable declaration for each variable declared
    inside the body of an entry, exit, when, or compound statement block. */
 static void gen_local_var_decls(Node *scope, int context, int level)
@@ -194,8 +240,9 @@ static void gen_state_func(
 {
 	gen_code("\n/* %s function for state \"%s\" in state set \"%s\" */\n",
 		title, state_name, ss_name);
-	gen_code("static %s %s_%s_%d_%s(SS_ID " NM_ENV "%s)\n",
-		rettype, prefix, ss_name, ss_num, state_name, extra_args);
+	gen_code("%s%s ", gen_state_func_storage(), rettype);
+	gen_state_func_name(prefix, ss_name, ss_num, state_name);
+	gen_code("(SS_ID " NM_ENV "%s)\n", extra_args);
 	gen_body(xp, context);
 }
 
@@ -299,6 +346,45 @@ static void gen_event_body(Node *xp, int context)
 	gen_code("}\n");
 }
 
+static int iter_dynamic_mask(Node *ep, Node *scope, void *parg)
+{
+	Node	*ssp = (Node *)parg;
+	Var	*vp;
+
+	if (!subscr_is_dynamic(ep, ssp))
+		return TRUE;
+	vp = ep->subscr_operand->extra.e_var;
+	indent(1); gen_code(NM_IX " = (int)(");
+	gen_expr(C_COND, ep->subscr_index, 0);
+	gen_code(");\n");
+	indent(1); gen_code("if (" NM_IX " >= 0 && " NM_IX " < %u)\n",
+		type_array_length1(vp->type));
+	indent(2); gen_code("bitSet(" NM_PMASK ", %u + " NM_IX ");\n",
+		global_num_event_flags + vp->index + 1);
+	return TRUE;
+}
+
+/* Generate a C function that adds to the static event mask of a state
+   the bits for array elements whose subscript in a when() condition
+   can only be evaluated at run-time; xp is the state */
+static void gen_dynamic_mask_body(Node *xp, int context)
+{
+	Node		*tp;
+	Node		*ssp = state_set_of_state(xp);
+
+	gen_code("{\n");
+	indent(1); gen_code("int " NM_IX ";\n");
+	foreach (tp, xp->state_whens)
+	{
+		assert(tp->tag == D_WHEN);
+		if (tp->when_cond)
+			traverse_syntax_tree(tp->when_cond, bit(E_SUBSCR), 0, 0,
+				iter_dynamic_mask, ssp);
+	}
+	/* end of function */
+	gen_code("}\n");
+}
+
 static void gen_var_access(Var *vp)
 {
 	const char *pre = global_options.reent ? NM_VAR "->" : "";
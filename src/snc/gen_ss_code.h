@@ -15,7 +15,9 @@ in the file LICENSE that is included with this distribution.
 
 #include "types.h"
 
-void gen_ss_code(Node *prog, Options options);
+void gen_ss_code(Node *prog, Options options, uint num_event_flags);
+void gen_prog_code(Node *prog, Options options, uint num_event_flags);
+void gen_single_ss_code(Node *ssp, uint ss_num, Options options, uint num_event_flags);
 void gen_funcdef(Node *fp);
 
 #endif	/*INCLgensscodeh*/
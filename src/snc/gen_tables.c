@@ -21,6 +21,7 @@ in the file LICENSE that is included with this distribution.
 #include "gen_code.h"
 #include "node.h"
 #include "var_types.h"
+#include "builtin.h"
 #include "gen_tables.h"
 #include "seq_mask.h"
 #include "seq_release.h"
@@ -28,20 +29,25 @@ in the file LICENSE that is included with this distribution.
 typedef struct event_mask_args {
 	seqMask	*event_words;
 	uint	num_event_flags;
+	Node	*ssp;
 } event_mask_args;
 
 static void gen_channel_table(ChanList *chan_list, uint num_event_flags, int opt_reent);
-static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent);
+static uint chan_group_size(Chan *cp);
+static int chan_group_named(Chan *cp, uint num_elems);
+static void gen_var_name(Var *vp);
+static void gen_channel(Chan *cp, uint num_elems, uint num_event_flags, int opt_reent);
 static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channels);
 static void fill_state_struct(Node *sp, char *ss_name, uint ss_num);
 static void gen_prog_table(Program *p);
 static void encode_options(Options options);
 static void encode_state_options(StateOptions options);
-static void gen_ss_table(Node *ss_list);
+static void gen_ss_table(Node *ss_list, uint num_channels);
 static void gen_state_event_mask(Node *sp, uint num_event_flags,
 	seqMask *event_words, uint num_event_words);
 static int iter_event_mask_scalar(Node *ep, Node *scope, void *parg);
 static int iter_event_mask_array(Node *ep, Node *scope, void *parg);
+static int iter_event_mask_conn(Node *ep, Node *scope, void *parg);
 
 /* Generate all kinds of tables for a SNL program. */
 void gen_tables(Program *p)
@@ -49,24 +55,79 @@ void gen_tables(Program *p)
 	gen_code("\n/************************ Tables ************************/\n");
 	gen_channel_table(p->chan_list, p->num_event_flags, p->options.reent);
 	gen_state_table(p->prog->prog_statesets, p->num_event_flags, p->chan_list->num_elems);
-	gen_ss_table(p->prog->prog_statesets);
+	gen_ss_table(p->prog->prog_statesets, p->chan_list->num_elems);
 	gen_prog_table(p);
 }
 
-/* Generate channel table with data for each defined channel */
+/* Generate channel table with data for each defined channel. Consecutive
+   elements of an array that are assigned to multiple channels and that
+   agree in all other properties share a single (compact) entry. */
 static void gen_channel_table(ChanList *chan_list, uint num_event_flags, int opt_reent)
 {
 	Chan *cp;
+	uint n, num_elems;
 
 	if (chan_list->first)
 	{
+		/* PV names for compact entries */
+		for (cp = chan_list->first, n = 0; cp; n += num_elems)
+		{
+			uint i;
+
+			num_elems = chan_group_size(cp);
+			if (num_elems > 1 && chan_group_named(cp, num_elems))
+			{
+				gen_code("\n/* PV names for '%s[%d..%d]' */\n",
+					cp->var->name, cp->index, cp->index + num_elems - 1);
+				gen_code("static const char *const " NM_CHNAMES "_%d[] = {\n", n);
+				for (i = 0; i < num_elems; cp = cp->next, i++)
+				{
+					if (cp->name && cp->name[0])
+						gen_code("\t\"%s\",\n", cp->name);
+					else
+						gen_code("\t0,\n");
+				}
+				gen_code("};\n");
+			}
+			else
+			{
+				for (i = 0; i < num_elems; i++)
+					cp = cp->next;
+			}
+		}
 		gen_code("\n/* Channel table */\n");
 		gen_code("static seqChan " NM_CHANS "[] = {\n");
-		gen_code("\t/* chName, offset, varName, varType, count, eventNum, efId, monitored, queueSize, queueIndex */\n");
-		foreach (cp, chan_list->first)
+		gen_code("\t/* chName, offset, varName, varType, count, eventNum, efId, monitored, queueSize, queueIndex, numElems, firstElem, stride, chNames */\n");
+		for (cp = chan_list->first, n = 0; cp; n += num_elems)
 		{
-			gen_channel(cp, num_event_flags, opt_reent);
-			gen_code(",\n");
+			uint i;
+
+			num_elems = chan_group_size(cp);
+			gen_channel(cp, num_elems, num_event_flags, opt_reent);
+			if (num_elems == 1)
+				gen_code(", 0, 0, 0, 0},\n");
+			else
+			{
+				gen_code(", %d, %d, ", num_elems, cp->index);
+				if (opt_reent)
+				{
+					gen_code("sizeof(((struct %s *)0)->", NM_VARS);
+					gen_var_name(cp->var);
+					gen_code("[0]), ");
+				}
+				else
+				{
+					gen_code("sizeof(");
+					gen_var_name(cp->var);
+					gen_code("[0]), ");
+				}
+				if (chan_group_named(cp, num_elems))
+					gen_code(NM_CHNAMES "_%d},\n", n);
+				else
+					gen_code("0},\n");
+			}
+			for (i = 0; i < num_elems; i++)
+				cp = cp->next;
 		}
 		gen_code("};\n");
 	}
@@ -95,8 +156,39 @@ static void gen_var_name(Var *vp)
 	}
 }
 
-/* Generate a seqChan structure */
-static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent)
+/* Number of channels, starting with cp, that can share a compact entry */
+static uint chan_group_size(Chan *cp)
+{
+	Chan	*np;
+	uint	n = 1;
+
+	if (cp->var->assign != M_MULTI)
+		return 1;
+	foreach (np, cp->next)
+	{
+		if (np->var != cp->var || np->index != cp->index + n
+			|| np->count != cp->count || np->monitor != cp->monitor
+			|| np->sync != cp->sync || np->syncq != cp->syncq)
+			break;
+		n++;
+	}
+	return n;
+}
+
+/* Whether any of num_elems channels starting with cp has a (non-empty) PV name */
+static int chan_group_named(Chan *cp, uint num_elems)
+{
+	uint i;
+
+	for (i = 0; i < num_elems; cp = cp->next, i++)
+		if (cp->name && cp->name[0])
+			return TRUE;
+	return FALSE;
+}
+
+/* Generate a seqChan structure (without the closing brace and the members
+   describing compact entries) */
+static void gen_channel(Chan *cp, uint num_elems, uint num_event_flags, int opt_reent)
 {
 	Var		*vp = cp->var;
 	char		elem_str[20] = "";
@@ -135,7 +227,8 @@ static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent)
 	else
 		ef_num = 0;
 
-	if (!cp->name)
+	/* compact entries have their names in a separate array */
+	if (!cp->name || num_elems > 1)
 		gen_code("\t{0, ");
 	else
 		gen_code("\t{\"%s\", ", cp->name);
@@ -153,8 +246,9 @@ static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent)
 		gen_code("%s, ", elem_str);
 	}
 
-	/* variable name with optional elem num */
-	gen_code("\"%s%s\", ", vp->name, elem_str);
+	/* variable name with optional elem num (runtime adds it for
+	   compact entries) */
+	gen_code("\"%s%s\", ", vp->name, num_elems > 1 ? "" : elem_str);
 	/* variable type */
 	assert(base_type(vp->type)->tag == T_PRIM);
 	gen_code("%s, ", prim_type_tag_name[base_type(vp->type)->val.prim]);
@@ -173,7 +267,6 @@ static void gen_channel(Chan *cp, uint num_event_flags, int opt_reent)
 		gen_code("DEFAULT_QUEUE_SIZE, %d", cp->syncq->index);
 	else
 		gen_code("%d, %d", cp->syncq->size, cp->syncq->index);
-	gen_code("}");
 }
 
 /* Generate state event mask and table */
@@ -186,8 +279,8 @@ static void gen_state_table(Node *ss_list, uint num_event_flags, uint num_channe
 	uint	ss_num = 0;
 	seqMask	*event_mask = newArray(seqMask, num_event_words);
 
-	/* NOTE: Bit zero of event mask is not used. Bit 1 to num_event_flags
-	   are used for event flags, then come channels. */
+	/* NOTE: Bit zero of event mask is the connection event. Bit 1 to
+	   num_event_flags are used for event flags, then come channels. */
 
 	/* For each state set... */
 	foreach (ssp, ss_list)
@@ -221,19 +314,37 @@ static void fill_state_struct(Node *sp, char *ss_name, uint ss_num)
 {
 	gen_code("\t{\n");
 	gen_code("\t/* state name */        \"%s\",\n", sp->token.str);
-	gen_code("\t/* action function */   " NM_ACTION "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
-	gen_code("\t/* event function */    " NM_EVENT "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
+	gen_code("\t/* action function */   ");
+	gen_state_func_name(NM_ACTION, ss_name, ss_num, sp->token.str);
+	gen_code(",\n");
+	gen_code("\t/* event function */    ");
+	gen_state_func_name(NM_EVENT, ss_name, ss_num, sp->token.str);
+	gen_code(",\n");
 	gen_code("\t/* entry function */    ");
 	if (sp->state_entry)
-		gen_code(NM_ENTRY "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
+	{
+		gen_state_func_name(NM_ENTRY, ss_name, ss_num, sp->token.str);
+		gen_code(",\n");
+	}
 	else
 		gen_code("0,\n");
 	gen_code("\t/* exit function */     ");
 	if (sp->state_exit)
-		gen_code(NM_EXIT "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
+	{
+		gen_state_func_name(NM_EXIT, ss_name, ss_num, sp->token.str);
+		gen_code(",\n");
+	}
 	else
 		gen_code("0,\n");
 	gen_code("\t/* event mask array */  " NM_MASK "_%s_%d_%s,\n", ss_name, ss_num, sp->token.str);
+	gen_code("\t/* event mask func */   ");
+	if (state_has_dynamic_mask(sp))
+	{
+		gen_state_func_name(NM_DYNMASK, ss_name, ss_num, sp->token.str);
+		gen_code(",\n");
+	}
+	else
+		gen_code("0,\n");
 	gen_code("\t/* state options */     ");
 	encode_state_options(sp->extra.e_state->options);
 	gen_code("\n\t},\n");
@@ -249,14 +360,30 @@ static void encode_state_options(StateOptions options)
 		gen_code(" | OPT_DOENTRYFROMSELF");
 	if (!options.no_exit_to_self)
 		gen_code(" | OPT_DOEXITTOSELF");
+	if (options.no_wait)
+		gen_code(" | OPT_NOWAIT");
 	gen_code(")");
 } 
 
 /* Generate state set table, one entry for each state set */
-static void gen_ss_table(Node *ss_list)
+static void gen_ss_table(Node *ss_list, uint num_channels)
 {
 	Node	*ssp;
 	int	num_ss;
+	uint	n;
+
+	foreach (ssp, ss_list)
+	{
+		seqMask *chan_mask = ssp->extra.e_ss->chan_mask;
+
+		if (!chan_mask || num_channels == 0)
+			continue;
+		gen_code("\n/* Channels used by state set \"%s\" */\n", ssp->token.str);
+		gen_code("static const seqMask " NM_CHANMASK "_%s[] = {\n", ssp->token.str);
+		for (n = 0; n < NWORDS(num_channels); n++)
+			gen_code("\t0x%08x,\n", chan_mask[n]);
+		gen_code("};\n");
+	}
 
 	gen_code("\n/* State set table */\n");
 	gen_code("static seqSS " NM_STATESETS "[] = {\n");
@@ -269,7 +396,11 @@ static void gen_ss_table(Node *ss_list)
 		gen_code("\t{\n");
 		gen_code("\t/* state set name */    \"%s\",\n", ssp->token.str);
 		gen_code("\t/* states */            " NM_STATES "_%s,\n", ssp->token.str);
-		gen_code("\t/* number of states */  %d\n", ssp->extra.e_ss->num_states);
+		gen_code("\t/* number of states */  %d,\n", ssp->extra.e_ss->num_states);
+		if (ssp->extra.e_ss->chan_mask && num_channels > 0)
+			gen_code("\t/* channel mask */      " NM_CHANMASK "_%s\n", ssp->token.str);
+		else
+			gen_code("\t/* channel mask */      0\n");
 		gen_code("\t},\n");
 	}
 	gen_code("};\n");
@@ -315,6 +446,8 @@ static void encode_options(Options options)
 		gen_code(" | OPT_REENT");
 	if (options.safe)
 		gen_code(" | OPT_SAFE");
+	/* bit zero of all event masks is meaningful */
+	gen_code(" | OPT_CONNEVENT");
 	gen_code("),\n");
 }
 
@@ -322,8 +455,9 @@ static void encode_options(Options options)
    event flag and for each process variable (assigned var) used in one of the
    state's when() conditions. The bits from 1 to num_event_flags are for the
    event flags. The bits from num_event_flags+1 to num_event_flags+num_channels
-   are for process variables. Bit zero is not used for whatever mysterious reason
-   I cannot tell. */
+   are for process variables. Bit zero is set if a condition depends on the
+   connection status of channels (e.g. pvConnectCount), so that the state set
+   gets woken up when a channel connects or disconnects. */
 static void gen_state_event_mask(Node *sp, uint num_event_flags,
 	seqMask *event_words, uint num_event_words)
 {
@@ -340,7 +474,11 @@ static void gen_state_event_mask(Node *sp, uint num_event_flags,
 	 */
 	foreach (tp, sp->state_whens)
 	{
-		event_mask_args em_args = { event_words, num_event_flags };
+		event_mask_args em_args;
+
+		em_args.event_words = event_words;
+		em_args.num_event_flags = num_event_flags;
+		em_args.ssp = state_set_of_state(sp);
 
 		/* look for scalar variables and event flags */
 		traverse_syntax_tree(tp->when_cond, bit(E_VAR), 0, 0,
@@ -349,6 +487,10 @@ static void gen_state_event_mask(Node *sp, uint num_event_flags,
 		/* look for arrays and subscripted array elements */
 		traverse_syntax_tree(tp->when_cond, bit(E_VAR)|bit(E_SUBSCR), 0, 0,
 			iter_event_mask_array, &em_args);
+
+		/* look for calls that depend on connection status */
+		traverse_syntax_tree(tp->when_cond, bit(E_FUNC)|bit(T_TEXT), 0, 0,
+			iter_event_mask_conn, &em_args);
 	}
 #ifdef DEBUG
 	report("event mask for state %s is", sp->token.str);
@@ -402,6 +544,24 @@ static int iter_event_mask_scalar(Node *ep, Node *scope, void *parg)
 	return FALSE;		/* no children anyway */
 }
 
+/* Iteratee for function calls and embedded C code. */
+static int iter_event_mask_conn(Node *ep, Node *scope, void *parg)
+{
+	event_mask_args	*em_args = (event_mask_args *)parg;
+
+	/* calls to SNL or C functions and embedded C code may use anything */
+	if (ep->tag == T_TEXT || ep->func_expr->tag != E_BUILTIN
+		|| ep->func_expr->extra.e_builtin->conn)
+	{
+#ifdef DEBUG
+		report("  iter_event_mask_conn: connection event bit\n");
+#endif
+		bitSet(em_args->event_words, 0);
+		return FALSE;
+	}
+	return TRUE;		/* descend into the arguments */
+}
+
 /* Iteratee for array variables. */
 static int iter_event_mask_array(Node *ep, Node *scope, void *parg)
 {
@@ -482,9 +642,28 @@ static int iter_event_mask_array(Node *ep, Node *scope, void *parg)
 		}
 		else if (e_ix)	/* subscript is an expression */
 		{
-			/* must descend for the array variable (see below) and
-			   possible array vars inside subscript expression */
-			return TRUE;
+			uint lo, hi, ix;
+
+			if (subscr_range(e_ix, length1, &lo, &hi))
+			{
+#ifdef DEBUG
+				report("  iter_event_mask_array: %s, subscript range [%d..%d]\n",
+					vp->name, lo, hi);
+#endif
+				/* set only the bits the index can select */
+				for (ix = lo; ix <= hi; ix++)
+					bitSet(event_words, bitnum(vp->index,ix,num_event_flags));
+			}
+			else if (!subscr_is_dynamic(ep, em_args->ssp))
+			{
+				/* must descend for the array variable (see below) and
+				   possible array vars inside subscript expression */
+				return TRUE;
+			}
+			/* else: bit is set at run-time, see gen_dynamic_mask_func */
+			traverse_syntax_tree(e_ix, bit(E_VAR)|bit(E_SUBSCR), 0, scope,
+				iter_event_mask_array, parg);
+			return FALSE;
 		}
 		else /* no subscript */
 		{
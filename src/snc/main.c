@@ -10,6 +10,7 @@ in the file LICENSE that is included with this distribution.
 /*************************************************************************\
                 Main program, reporting and printing procedures
 \*************************************************************************/
+#include <assert.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -17,39 +18,89 @@ in the file LICENSE that is included with this distribution.
 #include <stdarg.h>
 
 #include "osiUnistd.h"
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 
 #include "types.h"
 #include "parser.h"
 #include "analysis.h"
 #include "gen_code.h"
+#include "builtin.h"
 #include "main.h"
 
 #include "seq_release.h"
 
 static Options options = DEFAULT_OPTIONS;
 
-static char *input_name;	/* input file name */
-static char *output_name;	/* output file name */
+typedef struct {
+	char	*input_name;	/* input file name */
+	char	*output_name;	/* output file name */
+} Job;
 
-static FILE *output_file;	/* output file handle */
+static Job *jobs;		/* files to compile */
+static int num_jobs, max_jobs;
+static int num_procs = 1;	/* max. number of parallel compilations */
+
+typedef struct {
+	FILE	*file;		/* handle of the temporary file */
+	char	*name;		/* output file name */
+	char	*tmp_name;	/* name of the temporary file */
+} Output;
+
+static Output main_output;	/* the output file */
+static Output sub_output;	/* additional output file (option +S) */
+static FILE *output_file;	/* where generated code goes */
+
+typedef struct {
+	const char	**names;
+	int		num, max;
+} NameList;
+
+static NameList out_names;	/* output files written */
+static NameList src_names;	/* source files read */
 
 static int err_cnt;
 
 static void parse_args(int argc, char *argv[]);
 static void parse_option(char *s);
+static void add_job(char *input_name, char *output_name);
+static void read_response_file(const char *name);
+static int compile(const char *input_name, const char *output_name);
+static int compile_batch(void);
 static void print_usage(void);
 static char *replace_extension(const char *in, const char *ext);
+static void add_name(NameList *list, const char *name);
+static int open_output(Output *out, const char *name);
+static void close_output(Output *out, int keep, int touch);
+static int same_content(const char *name1, const char *name2);
+static void write_depfile(const char *input_name);
 
 /* The streams stdin and stdout are redirected to files named in the
    command parameters. */
 int main(int argc, char *argv[])
+{
+	/* Get command arguments */
+	parse_args(argc, argv);
+
+	if (num_jobs == 1)
+		return compile(jobs[0].input_name, jobs[0].output_name);
+	else
+		return compile_batch();
+}
+
+/* Compile a single file */
+static int compile(const char *input_name, const char *output_name)
 {
 	FILE	*input_file;
 	Program	*prg;
         Node    *exp;
+	int	n;
 
-	/* Get command arguments */
-	parse_args(argc, argv);
+	err_cnt = 0;
+	out_names.num = 0;
+	src_names.num = 0;
 
 	input_file = fopen(input_name, "r");
 	if (input_file == NULL)
@@ -59,11 +110,10 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	/* the input file should be unbuffered,
-           since the lexer maintains its own buffer */
-	setvbuf(input_file, NULL, _IONBF, 0);
-
 	exp = parse_program(input_file, input_name);
+	fclose(input_file);
+	if (!exp)
+		return EXIT_FAILURE;
 
         prg = analyse_program(exp, options);
 
@@ -71,37 +121,136 @@ int main(int argc, char *argv[])
 	if (err_cnt > 0)
 		return EXIT_FAILURE;
 
-	output_file = fopen(output_name, "w");
-	if (output_file == NULL)
-	{
-		report("error opening output file: %s: %s\n", output_name,
-			strerror(errno));
+	if (!open_output(&main_output, output_name))
 		return EXIT_FAILURE;
-	}
+	add_name(&out_names, output_name);
+	output_file = main_output.file;
 
 	generate_code(prg);
 
-	if (fclose(output_file))
-	{
-		report("error closing output file: %s: %s\n", output_name,
-			strerror(errno));
-		err_cnt++;
-	}
+	/* make compares the time stamp of the main output with that of the
+	   input, so replace it even if unchanged; otherwise make would run
+	   snc again every time */
+	close_output(&main_output, err_cnt == 0, TRUE);
+
+	if (err_cnt == 0 && options.depend)
+		write_depfile(input_name);
 
 	if (err_cnt > 0)
 	{
-		if (unlink(output_name))
-			report("error removing partially written output file: %s: %s\n",
-				output_name, strerror(errno));
+		for (n = 0; n < out_names.num; n++)
+		{
+			if (remove(out_names.names[n]) && errno != ENOENT)
+				report("error removing output file: %s: %s\n",
+					out_names.names[n], strerror(errno));
+		}
 		return EXIT_FAILURE;
 	}
 	return EXIT_SUCCESS;
 }
 
-/* Initialize options, input_name, and output_name from arguments. */
+#ifndef _WIN32
+/* Compile all files, each in a child process, so that a fatal error
+   while compiling one file does not affect the others. Builtin symbols
+   are set up once, before forking. */
+static int compile_batch(void)
+{
+	pid_t	*pids = (pid_t *)calloc((size_t)num_jobs, sizeof(pid_t));
+	int	next = 0, running = 0, failed = 0;
+	int	max_running = num_procs;
+
+	if (max_running <= 0)
+	{
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		max_running = ncpus > 0 ? (int)ncpus : 1;
+	}
+	if (!pids)
+	{
+		report("out of memory\n");
+		return EXIT_FAILURE;
+	}
+	register_builtins();
+	fflush(stdout);
+	fflush(stderr);
+
+	while (next < num_jobs || running > 0)
+	{
+		if (next < num_jobs && running < max_running)
+		{
+			pid_t pid = fork();
+
+			if (pid == 0)
+				exit(compile(jobs[next].input_name, jobs[next].output_name));
+			if (pid < 0)
+			{
+				report("%s: cannot fork: %s\n", jobs[next].input_name,
+					strerror(errno));
+				failed++;
+			}
+			else
+			{
+				pids[next] = pid;
+				running++;
+			}
+			next++;
+		}
+		else
+		{
+			int	status, n;
+			pid_t	pid = wait(&status);
+
+			if (pid < 0)
+			{
+				report("wait failed: %s\n", strerror(errno));
+				return EXIT_FAILURE;
+			}
+			running--;
+			for (n = 0; n < next && pids[n] != pid; n++)
+				;
+			if (WIFSIGNALED(status))
+			{
+				report("%s: snc terminated by signal %d\n",
+					n < next ? jobs[n].input_name : "?", WTERMSIG(status));
+				failed++;
+			}
+			else if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+			{
+				failed++;
+			}
+		}
+	}
+	free(pids);
+	if (failed)
+		report("%d of %d files failed to compile\n", failed, num_jobs);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#else
+/* No fork on Windows: compile all files in turn. Errors in a file,
+   including a parser that gives up and input that cannot be read, only
+   fail that file. What still ends the whole batch are the cases where
+   snc exits at once: running out of memory (arena.c, sym_table.c,
+   snl.re, add_name) and snc bugs caught by assert_at, assert_at_node,
+   or assert. */
+static int compile_batch(void)
+{
+	int n, failed = 0;
+
+	for (n = 0; n < num_jobs; n++)
+	{
+		if (compile(jobs[n].input_name, jobs[n].output_name) != EXIT_SUCCESS)
+			failed++;
+	}
+	if (failed)
+		report("%d of %d files failed to compile\n", failed, num_jobs);
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
+
+/* Initialize options and the list of files to compile from arguments. */
 static void parse_args(int argc, char *argv[])
 {
 	int i;
+	char *output_name = 0;
 
 	if (argc < 2)
 	{
@@ -113,24 +262,29 @@ static void parse_args(int argc, char *argv[])
 	{
 		char *s = argv[i];
 
-		if (strcmp(s,"-o") == 0)
+		if (strcmp(s,"-o") == 0 || strcmp(s,"-j") == 0)
 		{
 			if (i+1 == argc)
 			{
-				report("missing filename after option -o\n");
+				report("missing argument after option %s\n", s);
 				print_usage();
 				exit(EXIT_FAILURE);
 			}
-			else
-			{
-				i++;
+			i++;
+			if (s[1] == 'o')
 				output_name = argv[i];
-				continue;
-			}
+			else
+				num_procs = atoi(argv[i]);
+			continue;
+		}
+		else if (s[0] == '@')
+		{
+			read_response_file(s+1);
+			continue;
 		}
 		else if (s[0] != '+' && s[0] != '-')
 		{
-			input_name = s;
+			add_job(s, 0);
 			continue;
 		}
 		else
@@ -142,19 +296,234 @@ static void parse_args(int argc, char *argv[])
 		options.reent = TRUE;
 	}
 
-	if (!input_name)
+	if (num_jobs == 0)
 	{
 		report("no input file argument given\n");
 		print_usage();
 		exit(EXIT_FAILURE);
 	}
 
-	if (!output_name)	/* no -o option given */
+	if (output_name)
+	{
+		if (num_jobs > 1)
+		{
+			report("option -o cannot be used with more than one input file\n");
+			exit(EXIT_FAILURE);
+		}
+		jobs[0].output_name = output_name;
+	}
+}
+
+/* Add a file to compile; the output name defaults to the input name
+   with extension replaced by .c */
+static void add_job(char *input_name, char *output_name)
+{
+	if (num_jobs == max_jobs)
+	{
+		max_jobs = max_jobs ? 2 * max_jobs : 16;
+		jobs = (Job *)realloc(jobs, (size_t)max_jobs * sizeof(Job));
+		if (!jobs)
+		{
+			report("out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	jobs[num_jobs].input_name = input_name;
+	jobs[num_jobs].output_name = output_name ? output_name
+		: replace_extension(input_name, ".c");
+	num_jobs++;
+}
+
+/* Read a response file: each line names an input file and optionally
+   an output file, separated by white space. Empty lines and lines
+   starting with '#' are ignored. */
+static void read_response_file(const char *name)
+{
+	FILE	*file = fopen(name, "r");
+	char	line[4096];
+	int	line_num = 0;
+
+	if (!file)
+	{
+		report("error opening response file: %s: %s\n", name,
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof(line), file))
+	{
+		char *input_name, *output_name, *rest;
+
+		line_num++;
+		input_name = strtok(line, " \t\r\n");
+		if (!input_name || input_name[0] == '#')
+			continue;
+		output_name = strtok(0, " \t\r\n");
+		rest = strtok(0, " \t\r\n");
+		if (rest)
+			report_at(name, line_num, "warning: ignoring '%s'\n", rest);
+		add_job(intern(input_name, strlen(input_name)),
+			output_name ? intern(output_name, strlen(output_name)) : 0);
+	}
+	fclose(file);
+}
+
+static void add_name(NameList *list, const char *name)
+{
+	int n;
+
+	for (n = 0; n < list->num; n++)
+		if (strcmp(list->names[n], name) == 0)
+			return;
+	if (list->num == list->max)
+	{
+		list->max = list->max ? 2 * list->max : 16;
+		list->names = (const char **)realloc((void *)list->names,
+			(size_t)list->max * sizeof(const char *));
+		if (!list->names)
+		{
+			report("out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	list->names[list->num++] = name;
+}
+
+/* Output files are first written under a temporary name; see close_output */
+static int open_output(Output *out, const char *name)
+{
+	out->name = (char *)name;
+	out->tmp_name = (char *)malloc(strlen(name) + 5);
+	sprintf(out->tmp_name, "%s.tmp", name);
+	out->file = fopen(out->tmp_name, "w");
+	if (out->file == NULL)
+	{
+		report("error opening output file: %s: %s\n", out->tmp_name,
+			strerror(errno));
+		err_cnt++;
+		free(out->tmp_name);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* Close an output file and, if keep is true, move it to its final name.
+   Unless touch is true, an existing file with the same content is left
+   alone, so that its time stamp does not cause make to rebuild everything
+   that depends on it. */
+static void close_output(Output *out, int keep, int touch)
+{
+	if (fclose(out->file))
+	{
+		report("error closing output file: %s: %s\n", out->tmp_name,
+			strerror(errno));
+		err_cnt++;
+		keep = FALSE;
+	}
+	out->file = NULL;
+	if (!keep)
+	{
+		remove(out->tmp_name);
+	}
+	else if (!touch && same_content(out->tmp_name, out->name))
+	{
+		remove(out->tmp_name);
+	}
+	else
+	{
+#ifdef _WIN32
+		/* rename does not replace an existing file here */
+		remove(out->name);
+#endif
+		if (rename(out->tmp_name, out->name))
+		{
+			report("error renaming output file: %s: %s\n", out->tmp_name,
+				strerror(errno));
+			err_cnt++;
+			remove(out->tmp_name);
+		}
+	}
+	free(out->tmp_name);
+	out->tmp_name = NULL;
+}
+
+static int same_content(const char *name1, const char *name2)
+{
+	FILE	*file1, *file2;
+	char	buf1[BUFSIZ], buf2[BUFSIZ];
+	size_t	len1, len2;
+	int	same = FALSE;
+
+	file1 = fopen(name1, "rb");
+	if (!file1)
+		return FALSE;
+	file2 = fopen(name2, "rb");
+	if (file2)
+	{
+		do {
+			len1 = fread(buf1, 1, sizeof(buf1), file1);
+			len2 = fread(buf2, 1, sizeof(buf2), file2);
+			same = len1 == len2 && memcmp(buf1, buf2, len1) == 0;
+		} while (same && len1 == sizeof(buf1));
+		fclose(file2);
+	}
+	fclose(file1);
+	return same;
+}
+
+/* Write name to a make file, escaping characters that make treats specially */
+static void put_make_name(FILE *file, const char *name)
+{
+	for (; *name; name++)
 	{
-		output_name = replace_extension(input_name, ".c");
+		if (*name == ' ' || *name == '#')
+			putc('\\', file);
+		else if (*name == '$')
+			putc('$', file);
+		putc(*name, file);
 	}
 }
 
+/* Write a make rule with all output files as targets and all source
+   files (the input file and whatever the preprocessor included into it)
+   as prerequisites, plus an empty rule for each included file, so that
+   make does not complain when one of them is removed. */
+static void write_depfile(const char *input_name)
+{
+	Output	dep;
+	char	*name = (char *)malloc(strlen(main_output.name) + 3);
+	int	n;
+
+	sprintf(name, "%s.d", main_output.name);
+	if (!open_output(&dep, name))
+		return;
+	for (n = 0; n < out_names.num; n++)
+	{
+		if (n > 0)
+			fputs(" ", dep.file);
+		put_make_name(dep.file, out_names.names[n]);
+	}
+	fputs(": ", dep.file);
+	put_make_name(dep.file, input_name);
+	for (n = 0; n < src_names.num; n++)
+	{
+		if (strcmp(src_names.names[n], input_name) == 0)
+			continue;
+		fputs(" \\\n  ", dep.file);
+		put_make_name(dep.file, src_names.names[n]);
+	}
+	fputs("\n", dep.file);
+	for (n = 0; n < src_names.num; n++)
+	{
+		if (strcmp(src_names.names[n], input_name) == 0)
+			continue;
+		fputs("\n", dep.file);
+		put_make_name(dep.file, src_names.names[n]);
+		fputs(":\n", dep.file);
+	}
+	close_output(&dep, TRUE, FALSE);
+	free(name);
+}
+
 static char *replace_extension(const char *in, const char *ext)
 {
 	char *in_ext = strrchr(in, '.');
@@ -205,6 +574,15 @@ static void parse_option(char *s)
 	case 'W':
 		options.xwarn = opt_val;
 		break;
+	case 'p':
+		options.perf = opt_val;
+		break;
+	case 'S':
+		options.split = opt_val;
+		break;
+	case 'M':
+		options.depend = opt_val;
+		break;
 	default:
 		report("unknown option ignored: '%s'\n", s);
 		break;
@@ -214,9 +592,11 @@ static void parse_option(char *s)
 static void print_usage(void)
 {
 	report("%s\n", SEQ_RELEASE);
-	report("usage: snc <options> <infile>\n");
+	report("usage: snc <options> <infile>...\n");
+	report("       snc <options> @<response file>\n");
 	report("options:\n");
 	report("  -o <outfile> - override name of output file\n");
+	report("  -j <n>       - compile up to n files in parallel (0: one per CPU)\n");
 	report("  +a           - do asynchronous pvGet\n");
 	report("  -c           - don't wait for all connects\n");
 	report("  +d           - turn on debug run-time option\n");
@@ -228,6 +608,9 @@ static void print_usage(void)
 	report("  +s           - safe mode (implies +r, overrides -r)\n");
 	report("  -w           - suppress compiler warnings\n");
 	report("  +W           - enable extra compiler warnings\n");
+	report("  +p           - enable performance warnings\n");
+	report("  +S           - one output file per state set (needs +r)\n");
+	report("  +M           - write make dependencies to <outfile>.d\n");
 	report("example:\n snc +a -c vacuum.st\n");
 }
 
@@ -248,6 +631,38 @@ void gen_code(const char *format, ...)
 	va_end(args);
 }
 
+const char *gen_output_begin(const char *suffix)
+{
+	char		*name = replace_extension(main_output.name, suffix);
+	const char	*base;
+
+	assert(!sub_output.file);
+	/* if this fails, err_cnt makes sure all output is discarded */
+	if (open_output(&sub_output, name))
+	{
+		add_name(&out_names, name);
+		output_file = sub_output.file;
+	}
+	base = name + strlen(name);
+	while (base > name && base[-1] != '/' && base[-1] != '\\')
+		base--;
+	return base;
+}
+
+void gen_output_end(void)
+{
+	if (sub_output.file)
+		close_output(&sub_output, err_cnt == 0, FALSE);
+	output_file = main_output.file;
+}
+
+void note_source_file(const char *src_file)
+{
+	/* skip pseudo files like <built-in> */
+	if (src_file[0] != '<')
+		add_name(&src_names, src_file);
+}
+
 /* Errors and warnings */
 
 void report_loc(const char *src_file, int line_num)
@@ -331,6 +746,18 @@ void extra_warning_at_node(Node *ep, const char *format, ...)
 	va_end(args);
 }
 
+void perf_warning_at_node(Node *ep, const char *format, ...)
+{
+	va_list args;
+
+	report_loc(ep->token.file, ep->token.line);
+	fprintf(stderr, "performance warning: ");
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
 void error_at_node(Node *ep, const char *format, ...)
 {
 	va_list args;
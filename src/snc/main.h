@@ -23,6 +23,17 @@ void gen_line_marker_prim(int line_num, const char *src_file);
 /* this gets the shorter name as it is the common way to call above */
 #define gen_line_marker(ep) gen_line_marker_prim((ep)->token.line, (ep)->token.file)
 
+/* send generated code to an additional output file, named like the output
+   file but with its extension replaced by suffix; returns the name without
+   directory part, for use in #include directives */
+const char *gen_output_begin(const char *suffix);
+
+/* close the additional output file and continue with the output file */
+void gen_output_end(void);
+
+/* remember a file name from a line marker, for the dependency file (+M) */
+void note_source_file(const char *src_file);
+
 /* Error and warning message support */
 
 /* just the location info */
@@ -53,6 +64,11 @@ __attribute__((format(printf,2,3)));
 void extra_warning_at_node(struct syntax_node *ep, const char *format, ...)
 __attribute__((format(printf,2,3)));
 
+/* with location from this node; callers check the +p option, so that
+   it can also be given inside the program */
+void perf_warning_at_node(struct syntax_node *ep, const char *format, ...)
+__attribute__((format(printf,2,3)));
+
 /* with location from this node and increase error count */
 void error_at_node(struct syntax_node *ep, const char *format, ...)
 __attribute__((format(printf,2,3)));
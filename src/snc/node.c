@@ -37,12 +37,13 @@ Node *node(
 
 	num_children = node_info[tag].num_children;
 
-	ep = new(Node);
+	/* children array is allocated together with the node */
+	ep = (Node *)arena_alloc(sizeof(Node) + num_children * sizeof(Node *));
 	ep->next = 0;
 	ep->last = ep;
 	ep->tag = tag;
         ep->token = tok;
-	ep->children = newArray(Node *, num_children);
+	ep->children = (Node **)(ep + 1);
 	/* allocate extra data */
 	switch (tag)
 	{
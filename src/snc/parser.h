@@ -14,13 +14,19 @@ in the file LICENSE that is included with this distribution.
 
 #include "types.h"
 
+/* Parse a program; return 0 if the parser gave up */
 Node *parse_program(FILE *in, const char *src_file);
 
+typedef struct parse_result {
+	Node	*prog;		/* the syntax tree */
+	int	failed;		/* the parser gave up */
+} ParseResult;
+
 void snlParser(
 	void    *yyp,		/* the parser */
 	int     yymajor,	/* the major token code number */
 	Token   yyminor,	/* the value for the token */
-	Node    **presult	/* extra argument */
+	ParseResult *presult	/* extra argument */
 );
 
 void *snlParserAlloc(void *(*mallocProc)(size_t));
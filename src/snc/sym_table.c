@@ -7,62 +7,129 @@ in the file LICENSE that is included with this distribution.
 /*************************************************************************\
                                 Symbol table
 \*************************************************************************/
-#include <stdio.h>	/* gpHash.h mentions FILE but does not include stdio */
+#include <stdlib.h>
 #include <assert.h>
 
-#include "gpHash.h"
-
 #include "types.h"
+#include "main.h"
 #include "sym_table.h"
 
 /* Invariant: all values stored in the table are non-zero. */
 
+/* Open addressing hash table; the size is a power of 2 and at most half
+   of the entries are used. Since names are interned, keys are compared
+   and hashed by pointer. */
+typedef struct {
+	const char	*name;
+	void		*type;
+	void		*value;
+} SymEntry;
+
+struct sym_table_pvt {
+	SymEntry	*entries;
+	size_t		size;
+	size_t		count;
+};
+
+static size_t hash_key(const SymTable st, const char *name, void *type)
+{
+	size_t h = ((size_t)name >> 3) * 31 + ((size_t)type >> 3);
+
+	h ^= h >> 15;
+	h *= 2654435761u;
+	return (h ^ (h >> 13)) & (st.table->size - 1);
+}
+
+static SymEntry *find_entry(const SymTable st, const char *name, void *type)
+{
+	size_t		i = hash_key(st, name, type);
+	SymEntry	*entry;
+
+	for (entry = st.table->entries + i; entry->value;
+		i = (i + 1) & (st.table->size - 1), entry = st.table->entries + i)
+	{
+		if (entry->name == name && entry->type == type)
+			break;
+	}
+	return entry;
+}
+
+static void grow_table(SymTable st)
+{
+	SymEntry	*old_entries = st.table->entries;
+	size_t		old_size = st.table->size;
+	size_t		i;
+
+	st.table->size = old_size ? 2 * old_size : 256;
+	st.table->entries = (SymEntry *)calloc(st.table->size, sizeof(SymEntry));
+	if (!st.table->entries)
+	{
+		report("out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < old_size; i++)
+	{
+		SymEntry *old = old_entries + i;
+
+		if (old->value)
+			*find_entry(st, old->name, old->type) = *old;
+	}
+	free(old_entries);
+}
+
 SymTable sym_table_create(void)
 {
 	SymTable st;
-	gphInitPvt(&st.table, 256);
+
+	st.table = new(struct sym_table_pvt);
+	st.table->size = 256;
+	st.table->entries = (SymEntry *)calloc(st.table->size, sizeof(SymEntry));
+	if (!st.table->entries)
+	{
+		report("out of memory\n");
+		exit(EXIT_FAILURE);
+	}
 	return st;
 }
 
 void *sym_table_lookup(const SymTable st, const char *name, void *type)
 {
-	GPHENTRY *pentry;
-
 	assert(st.table);
-	pentry = gphFind(st.table, name, type);
-	if (pentry)
-	{
-		assert(pentry->userPvt);	/* invariant! */
-		return pentry->userPvt;
-	}
-	else
-	{
+	if (!st.table->size)	/* destroyed */
 		return 0;
-	}
+	return find_entry(st, name, type)->value;
 }
 
 void *sym_table_insert(SymTable st, const char *name, void *type, void *value)
 {
-	GPHENTRY *pentry;
+	SymEntry *entry;
 
 	assert(st.table);
 	if (!value)
 	{
 		return 0;
 	}
-	pentry = gphAdd(st.table, name, type);
-	if (pentry)	/* success, value was inserted */
+	if (2 * (st.table->count + 1) > st.table->size)
 	{
-		pentry->userPvt = value;	/* maintain invariant */
-		return pentry->userPvt;
+		grow_table(st);
 	}
-	else		/* failed, there is already such a key */
+	entry = find_entry(st, name, type);
+	if (entry->value)	/* failed, there is already such a key */
 	{
 		return 0;
 	}
+	entry->name = name;
+	entry->type = type;
+	entry->value = value;	/* maintain invariant */
+	st.table->count++;
+	return value;
 }
 
 void sym_table_destroy(SymTable st)
 {
-	gphFreeMem(st.table);
+	free(st.table->entries);
+	/* leave an empty table behind, not one with dangling entries */
+	st.table->entries = 0;
+	st.table->size = 0;
+	st.table->count = 0;
 }
@@ -16,11 +16,11 @@ in the file LICENSE that is included with this distribution.
    keys are (name,type) pairs with types (char*,void*), and values are
    just pointers (void*).
 
-   Implementation uses EPICS gpHash module (see libCom)
-   
-   NOTE: In contrast to the gpHash API, we make no difference between a
-   zero value and no value at all. Thus, inserting something with value
-   zero is a no-op. */
+   Names must be interned (see arena.h); they are compared by pointer.
+   Identifiers from the lexer are always interned.
+
+   NOTE: We make no difference between a zero value and no value at all.
+   Thus, inserting something with value zero is a no-op. */
 
 /* Create a new symbol table. If this fails, return 0. */
 SymTable sym_table_create(void);
@@ -37,7 +37,8 @@ void *sym_table_lookup(const SymTable st, const char *name, void *type);
    Return the value if successfully inserted, otherwise return zero. */
 void *sym_table_insert(SymTable st, const char *name, void *type, void *value);
 
-/* Free all memory associated with a table. */
+/* Free the entries of a table. Afterwards the table is empty: lookups
+   return 0, and inserting allocates new entries. */
 void sym_table_destroy(SymTable st);
 
 #endif /*INCLsymtableh*/
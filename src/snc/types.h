@@ -14,9 +14,9 @@ in the file LICENSE that is included with this distribution.
 
 #include <stdlib.h>
 
-#include "epicsVersion.h"
-
 #include "seq_static_assert.h"
+#include "seq_mask.h"
+#include "arena.h"
 
 #ifndef	TRUE
 #define	TRUE 1
@@ -50,11 +50,7 @@ typedef unsigned int		uint;
 
 struct sym_table
 {
-#if (EPICS_VERSION == 3) && (EPICS_REVISION<14 || (EPICS_REVISION==14 && EPICS_MODIFICATION <= 10))
-	void *table;
-#else
-	struct gphPvt *table;
-#endif
+	struct sym_table_pvt *table;
 };
 
 struct options
@@ -71,18 +67,22 @@ struct options
 	uint	line:1;			/* generate line markers */
 	uint	warn:1;			/* compiler warnings */
 	uint	xwarn:1;		/* extra compiler warnings */
+	uint	perf:1;			/* performance warnings */
+	uint	split:1;		/* one output file per state set */
+	uint	depend:1;		/* write a make dependency file */
 };
 
-#define DEFAULT_OPTIONS {0,1,0,0,0,1,0,1,1,0}
+#define DEFAULT_OPTIONS {0,1,0,0,0,1,0,1,1,0,0,0,0}
 
 struct state_options			/* run-time state options */
 {
 	uint	do_reset_timers:1;	/* reset timers on state entry from self */
 	uint	no_entry_from_self:1;	/* don't do entry actions if entering from same state */
 	uint	no_exit_to_self:1;	/* don't do exit actions if exiting to same state */
+	uint	no_wait:1;		/* first condition is always true (set by snc) */
 };
 
-#define DEFAULT_STATE_OPTIONS {1,1,1}
+#define DEFAULT_STATE_OPTIONS {1,1,1,0}
 
 struct token				/* for the lexer and parser */
 {
@@ -109,6 +109,8 @@ struct state_set			/* extra data for state set clauses */
 {
 	uint		num_states;	/* number of states */
 	VarList		*var_list;	/* list of 'local' variables */
+	seqMask		*chan_mask;	/* channels used by this state set
+					   (0 if it may use any of them) */
 };
 
 /* Expression types */
@@ -210,6 +212,10 @@ struct variable				/* variable definition */
 		EvFlag	*evflag;	/* event flag data if this is an event flag */
 	} chan;
 	uint	index;			/* index (base) in seqChan array */
+	/* writers, see analyse_writers */
+	Node	*writer;		/* the state set that writes it (if any) */
+	uint	shared:1;		/* written by more than one state set or
+					   by a function */
 };
 /* Laws (Invariants):
 L1a:	monitor	== M_MULTI	=> assign == M_MULTI
@@ -276,8 +282,8 @@ struct program
 	uint		num_event_flags;/* number of event flags */
 };
 
-/* Allocation */
-#define newArray(type,count)	(type *)calloc(count, sizeof(type))
+/* Allocation (from the arena, see arena.h) */
+#define newArray(type,count)	(type *)arena_alloc((count)*sizeof(type))
 #define new(type)		newArray(type,1)
 
 /* Generic iteration on lists */
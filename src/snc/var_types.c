@@ -30,7 +30,7 @@ static Node *add_implicit_parameters(Node *fun_decl, Node *param_decls)
 
     /* implicit parameter: "SS_ID " NM_ENV */
     t.symbol = TOK_NAME;
-    t.str = NM_ENV;
+    t.str = intern(NM_ENV, strlen(NM_ENV));
     t.line = fun_decl->token.line;
     t.file = fun_decl->token.file;
     p1 = mk_decl(node(E_VAR, t), mk_foreign_type(F_TYPENAME, "SS_ID"));
@@ -7,6 +7,13 @@ use Test::More;
 my $tests = {
   cast                    => { warnings => 0, errors => 0  },
   change                  => { warnings => 0, errors => 2  },
+  connMask                => { warnings => 0, errors => 0,
+                               code => [qr/seqg_mask_test_0_waitConn\[\] = \{\s*0x00000001,/,
+                                        qr/seqg_mask_test_0_waitValue\[\] = \{\s*0x00000002,/,
+                                        qr/seqg_mask_test_0_waitDelay\[\] = \{\s*0x00000000,/] },
+  deadTransition          => { warnings => 2, errors => 0,
+                               code => [qr/if \(c > -1u\)/, qr/seq_delay\(/],
+                               nocode => [qr/\bc >= 0/, qr/\bx < 0/] },
   delay_in_action         => { warnings => 0, errors => 1  },
   efArray                 => { warnings => 0, errors => 1  },
   efGlobal                => { warnings => 0, errors => 3  },
@@ -20,6 +27,7 @@ my $tests = {
   misplacedExit           => { warnings => 0, errors => 1  },
   namingConflict          => { warnings => 0, errors => 0  },
   nesting_depth           => { warnings => 0, errors => 0  },
+  perfLint                => { warnings => 4, errors => 0  },
   pvArray                 => { warnings => 0, errors => 21 },
   pvNotAssigned           => { warnings => 0, errors => 20 },
   reservedId              => { warnings => 0, errors => 2  },
@@ -33,7 +41,23 @@ my $tests = {
 
 my @progs = sort(keys(%$tests));
 
-plan tests => 5 * (@progs + 0);
+# patterns the generated code must (code) or must not (nocode) match
+sub code_checks {
+  my ($prog) = @_;
+  my $code = $tests->{$prog}->{code} || [];
+  my $nocode = $tests->{$prog}->{nocode} || [];
+  return @$code + @$nocode;
+}
+
+my $ncode = 0;
+$ncode += code_checks($_) foreach @progs;
+
+# tests of split output, time stamps, and dependency files (see split_tests)
+my $nsplit = 20;
+# tests of compiling several files in one run (see batch_tests)
+my $nbatch = 11;
+
+plan tests => 5 * (@progs + 0) + $ncode + $nsplit + $nbatch;
 
 sub snc_diag {
   diag "snc said this:";
@@ -46,18 +70,20 @@ if ("$host_arch" =~ /win32/ || "$host_arch" =~ /windows/) {
   $dirsep = '\\';
 }
 
+my $snc = "..${dirsep}..${dirsep}..${dirsep}bin${dirsep}${host_arch}${dirsep}snc";
+
 foreach my $prog (@progs) {
   # prepare source by passing it through CPP
   `make -s -B $prog.i`;
   my $failed = 0;
   # execute the snc and capture the output
-  my $output = `..${dirsep}..${dirsep}..${dirsep}bin${dirsep}${host_arch}${dirsep}snc $prog.i -o $prog.c 2>&1`;
+  my $output = `$snc $prog.i -o $prog.c 2>&1`;
   # test whether it terminated normally
   my $exitsig = $? & 127;
   is ($exitsig, 0, "$prog: snc terminates normally") or $failed = 1;
   SKIP: {
     # skip all other tests if snc crashed
-    skip("snc died with signal $exitsig", 4) if $exitsig;
+    skip("snc died with signal $exitsig", 4 + code_checks($prog)) if $exitsig;
     my $exitcode = $? >> 8;
     my $errors_are_expected = $tests->{$prog}->{errors} > 0;
     ok(($exitcode != 0) == $errors_are_expected, "$prog: correct exitcode");
@@ -68,6 +94,121 @@ foreach my $prog (@progs) {
     my $ne = 0;
     $ne++ while ($output =~ /error/g);
     is($ne, $tests->{$prog}->{errors}, "$prog: number of errors") or $failed = 1;
+    my $generated = '';
+    if (open(my $fh, '<', "$prog.c")) {
+      local $/;
+      $generated = <$fh>;
+      close($fh);
+    }
+    foreach my $re (@{$tests->{$prog}->{code} || []}) {
+      like($generated, $re, "$prog: generated code matches $re") or $failed = 1;
+    }
+    foreach my $re (@{$tests->{$prog}->{nocode} || []}) {
+      unlike($generated, $re, "$prog: generated code does not match $re") or $failed = 1;
+    }
   }
   snc_diag($output) if $failed;
 }
+
+# run snc with the given arguments, return exit code and output
+sub run_snc {
+  my $output = `$snc @_ 2>&1`;
+  return ($? >> 8, $output);
+}
+
+sub slurp {
+  my ($file) = @_;
+  open(my $fh, '<', $file) or return undef;
+  local $/;
+  my $content = <$fh>;
+  close($fh);
+  return $content;
+}
+
+sub mtime {
+  return (stat($_[0]))[9];
+}
+
+# +S: one file per state set; +M: dependency file. Unchanged state set
+# files, the header, and the dependency file keep their time stamps,
+# the main output file is always replaced.
+sub split_tests {
+  my @side = qw(splitOutput_seqg.h splitOutput_seqg_x.c splitOutput_seqg_x_y.c
+                splitOutput.c.d);
+  unlink('splitOutput.c', @side);
+  # includes ../namingConflict.st
+  `make -s -B namingConflictSplit.i`;
+  my ($exitcode, $output) = run_snc('+S', '+r', '+M', 'namingConflictSplit.i',
+    '-o', 'splitOutput.c');
+  is($exitcode, 0, "split: snc succeeds");
+  is($output, '', "split: no warnings") or snc_diag($output);
+  ok(-e $_, "split: creates $_") foreach @side[0..2];
+  like(slurp('splitOutput_seqg_x.c') || '',
+    qr/seqg_event_namingConflictTest_x_0_y_z\(/,
+    "split: state function names include the program name");
+  my $dep = slurp('splitOutput.c.d') || '';
+  like($dep, qr/^splitOutput\.c splitOutput_seqg\.h splitOutput_seqg_x\.c splitOutput_seqg_x_y\.c: namingConflictSplit\.i /,
+    "depend: all output files depend on the input file");
+  like($dep, qr/\\\n\s+\S*namingConflict\.st\b/,
+    "depend: output files depend on the included file");
+  like($dep, qr/^\S*namingConflict\.st:$/m,
+    "depend: empty rule for the included file");
+
+  # compile again, unchanged
+  my $old = time() - 3600;
+  utime($old, $old, 'splitOutput.c', @side);
+  ($exitcode, $output) = run_snc('+S', '+r', '+M', 'namingConflictSplit.i',
+    '-o', 'splitOutput.c');
+  is($exitcode, 0, "split: snc succeeds again");
+  is(mtime($_), $old, "split: $_ keeps its time stamp") foreach @side;
+  isnt(mtime('splitOutput.c'), $old, "split: splitOutput.c is replaced");
+
+  # refused for non-reentrant programs and programs with functions
+  unlink('refused.c', 'refused_seqg_x.c');
+  ($exitcode, $output) = run_snc('+S', 'namingConflict.i', '-o', 'refused.c');
+  like($output, qr/warning: cannot split output: it requires option \+r/,
+    "split: refused without +r");
+  ok(-e 'refused.c', "split: refused, generates a single file");
+  ok(!-e 'refused_seqg_x.c', "split: refused, no state set file");
+  `make -s -B funcdef.i`;
+  unlink('refusedFunc.c', 'refusedFunc_seqg_simple.c');
+  ($exitcode, $output) = run_snc('+S', '+r', 'funcdef.i', '-o', 'refusedFunc.c');
+  like($output, qr/warning: cannot split output: the program defines functions/,
+    "split: refused for programs with functions");
+  ok(!-e 'refusedFunc_seqg_simple.c', "split: refused, no state set file");
+}
+
+split_tests();
+
+# Several input files in one run: a bad file (here one where the parser
+# gives up) must not keep the others from being compiled, with or
+# without -j, and a response file names inputs and outputs.
+sub batch_tests {
+  my @inputs = qw(cast.i type_not_allowed.i connMask.i);
+  my @good = qw(cast.c connMask.c);
+  # the .i files were made above
+  unlink(@good, 'type_not_allowed.c');
+  my ($exitcode, $output) = run_snc(@inputs);
+  isnt($exitcode, 0, "batch: fails if one of the files fails") or snc_diag($output);
+  ok(-e $_, "batch: creates $_") foreach @good;
+  ok(!-e 'type_not_allowed.c', "batch: no output for the bad file");
+  my %expected = map { $_ => slurp($_) } @good;
+
+  unlink(@good);
+  ($exitcode, $output) = run_snc('-j', '2', @inputs);
+  isnt($exitcode, 0, "batch -j2: fails if one of the files fails") or snc_diag($output);
+  is(slurp($_), $expected{$_}, "batch -j2: same $_") foreach @good;
+  ok(!-e 'type_not_allowed.c', "batch -j2: no output for the bad file");
+
+  unlink('batchCast.c', 'batchConnMask.c');
+  open(my $fh, '>', 'batch.rsp') or die "cannot write batch.rsp: $!";
+  print $fh "# input and output file names\ncast.i batchCast.c\n\nconnMask.i batchConnMask.c\n";
+  close($fh);
+  ($exitcode, $output) = run_snc('@batch.rsp');
+  is($exitcode, 0, "response file: snc succeeds") or snc_diag($output);
+  is(slurp('batchCast.c'), $expected{'cast.c'}, "response file: creates batchCast.c");
+  is(slurp('batchConnMask.c'), $expected{'connMask.c'},
+    "response file: creates batchConnMask.c");
+}
+
+batch_tests();
@@ -0,0 +1,240 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Test the database access provider of the pv library (src/pv/pvDb.c)
+ * against records in a test IOC.
+ */
+#include <string.h>
+
+#include "epicsEvent.h"
+#include "epicsThread.h"
+#include "dbAccess.h"
+#include "dbUnitTest.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#include "pv.h"
+
+void pvDbTest_registerRecordDeviceDriver(struct dbBase *pdbbase);
+
+#define TIMEOUT 5.0
+
+struct client {
+    epicsEventId    conn;           /* signalled on connection events */
+    epicsEventId    done;           /* signalled on get/put/monitor events */
+    int             connected;
+    int             nGet;
+    int             nPut;
+    int             nMonitor;
+    pvStat          status;         /* of the last event */
+    double          value;          /* of the last get or monitor event */
+    pvInt64         ivalue;         /* same for 64 bit integers */
+};
+
+static void connHandler(int connected, void *arg)
+{
+    struct client *c = (struct client *)arg;
+
+    c->connected = connected;
+    epicsEventSignal(c->conn);
+}
+
+static void eventHandler(pvEventType evt, void *arg, pvType type,
+    unsigned count, pvValue *value, pvStat status)
+{
+    struct client *c = (struct client *)arg;
+
+    c->status = status;
+    switch (evt) {
+    case pvEventGet:
+        c->nGet++;
+        break;
+    case pvEventPut:
+        c->nPut++;
+        break;
+    case pvEventMonitor:
+        c->nMonitor++;
+        break;
+    }
+    if (value && type == pvTypeTIME_DOUBLE && count == 1)
+        c->value = *(pvDouble *)pv_value_ptr(value, type);
+    if (value && type == pvTypeTIME_INT64 && count == 1)
+        c->ivalue = *(pvInt64 *)pv_value_ptr(value, type);
+    epicsEventSignal(c->done);
+}
+
+static int waitFor(epicsEventId ev)
+{
+    return epicsEventWaitWithTimeout(ev, TIMEOUT) == epicsEventWaitOK;
+}
+
+static void createVar(pvSystem sys, const char *name, struct client *c, pvVar *var)
+{
+    memset(c, 0, sizeof(*c));
+    c->conn = epicsEventMustCreate(epicsEventEmpty);
+    c->done = epicsEventMustCreate(epicsEventEmpty);
+    testOk(pvVarCreate(sys, name, connHandler, eventHandler, c, var) == pvStatOK,
+        "pvVarCreate(%s)", name);
+    testOk(pvVarIsLocal(*var), "%s is served by the database", name);
+    testOk(waitFor(c->conn) && c->connected, "%s connected", name);
+}
+
+static void destroyVar(pvVar *var)
+{
+    testOk1(pvVarDestroy(var) == pvStatOK);
+    testOk1(!pvVarIsDefined(*var));
+}
+
+static void freeClient(struct client *c)
+{
+    epicsEventDestroy(c->conn);
+    epicsEventDestroy(c->done);
+}
+
+static void testGetPut(pvSystem sys)
+{
+    struct client c;
+    pvVar var = nullPvVar;
+    pvDouble val = 2.5;
+
+    testDiag("get and put with completion");
+    createVar(sys, "pvDbTest:ao", &c, &var);
+
+    testOk1(pvVarGetCount(&var) == 1);
+    testOk1(pvVarGetCallback(&var, pvTypeTIME_DOUBLE, 1, &c) == pvStatOK);
+    testOk(waitFor(c.done) && c.nGet == 1, "get completed");
+    testOk(c.status == pvStatOK && c.value == 1.5, "got %g", c.value);
+
+    testOk1(pvVarPutCallback(&var, pvTypeDOUBLE, 1, &val, &c) == pvStatOK);
+    testOk(waitFor(c.done) && c.nPut == 1, "put completed");
+    testOk1(c.status == pvStatOK);
+    testdbGetFieldEqual("pvDbTest:ao", DBR_DOUBLE, 2.5);
+
+    destroyVar(&var);
+    freeClient(&c);
+}
+
+static void testMonitor(pvSystem sys)
+{
+    struct client c;
+    pvVar var = nullPvVar;
+
+    testDiag("monitor");
+    createVar(sys, "pvDbTest:ao", &c, &var);
+
+    testOk1(pvVarMonitorOn(&var, pvTypeTIME_DOUBLE, 1, &c) == pvStatOK);
+    testOk1(pvMonIsDefined(var));
+    testOk(waitFor(c.done) && c.nMonitor == 1, "initial monitor event");
+    testOk(c.status == pvStatOK && c.value == 2.5, "got %g", c.value);
+
+    testdbPutFieldOk("pvDbTest:ao", DBR_DOUBLE, 3.5);
+    testOk(waitFor(c.done) && c.nMonitor == 2, "monitor event after put");
+    testOk(c.value == 3.5, "got %g", c.value);
+
+    testOk1(pvVarMonitorOff(&var) == pvStatOK);
+    testOk1(!pvMonIsDefined(var));
+    testdbPutFieldOk("pvDbTest:ao", DBR_DOUBLE, 4.5);
+    epicsThreadSleep(0.5);
+    testOk(c.nMonitor == 2, "no monitor event after pvVarMonitorOff");
+
+    destroyVar(&var);
+    freeClient(&c);
+}
+
+static void testDestroyPendingPut(pvSystem sys)
+{
+    struct client c;
+    pvVar var = nullPvVar;
+    pvLong val = 1;
+
+    testDiag("destroy channel with a put pending");
+    createVar(sys, "pvDbTest:slow", &c, &var);
+
+    testOk1(pvVarPutCallback(&var, pvTypeLONG, 1, &val, &c) == pvStatOK);
+    testOk(c.nPut == 0, "put is pending");
+    destroyVar(&var);
+    /* the record completes after one second */
+    epicsThreadSleep(1.5);
+    testOk(c.nPut == 0, "no put callback after pvVarDestroy");
+    testdbGetFieldEqual("pvDbTest:out", DBR_LONG, 2);
+    freeClient(&c);
+}
+
+#ifdef DBR_INT64
+#define NINT64TESTS 11
+
+static void testInt64(pvSystem sys)
+{
+    struct client c;
+    pvVar var = nullPvVar;
+    /* needs more than 32 bits */
+    pvInt64 val = -0x123456789aLL;
+
+    testDiag("64 bit integers");
+    createVar(sys, "pvDbTest:i64", &c, &var);
+
+    testOk1(pvVarPutCallback(&var, pvTypeINT64, 1, &val, &c) == pvStatOK);
+    testOk(waitFor(c.done) && c.nPut == 1, "put completed");
+    testOk1(c.status == pvStatOK);
+
+    testOk1(pvVarGetCallback(&var, pvTypeTIME_INT64, 1, &c) == pvStatOK);
+    testOk(waitFor(c.done) && c.nGet == 1, "get completed");
+    testOk(c.status == pvStatOK && c.ivalue == val, "got %lld", (long long)c.ivalue);
+
+    destroyVar(&var);
+    freeClient(&c);
+}
+#else
+#define NINT64TESTS 0
+#endif
+
+static void testInt64OverCA(pvSystem sys)
+{
+    struct client c;
+    pvVar var = nullPvVar;
+    pvInt64 val = 1;
+
+    testDiag("64 bit integers are rejected for CA channels");
+    memset(&c, 0, sizeof(c));
+    testOk1(pvVarCreate(sys, PV_PREFIX_CA "pvDbTest:ao", connHandler,
+        eventHandler, &c, &var) == pvStatOK);
+    testOk1(!pvVarIsLocal(var));
+    testOk1(pvVarGetCallback(&var, pvTypeTIME_INT64, 1, &c) == pvStatERROR);
+    testOk1(pvVarPutCallback(&var, pvTypeINT64, 1, &val, &c) == pvStatERROR);
+    destroyVar(&var);
+}
+
+MAIN(pvDbTest)
+{
+    pvSystem sys = nullPvSys;
+
+    testPlan(50 + NINT64TESTS);
+
+    testdbPrepare();
+    testdbReadDatabase("pvDbTest.dbd", NULL, NULL);
+    pvDbTest_registerRecordDeviceDriver(pdbbase);
+    testdbReadDatabase("pvDbTest.db", NULL, NULL);
+#ifdef DBR_INT64
+    testdbReadDatabase("pvDbTestInt64.db", NULL, NULL);
+#endif
+    testIocInitOk();
+
+    testOk1(pvSysCreate(&sys) == pvStatOK);
+    testOk1(pvSysIsDefined(sys));
+
+    testGetPut(sys);
+    testMonitor(sys);
+    testDestroyPendingPut(sys);
+#ifdef DBR_INT64
+    testInt64(sys);
+#endif
+    testInt64OverCA(sys);
+
+    testOk1(pvSysDestroy(&sys) == pvStatOK);
+    testOk1(!pvSysIsDefined(sys));
+
+    testIocShutdownOk();
+    testdbCleanup();
+    return testDone();
+}
@@ -33,6 +33,177 @@ static void check(QUEUE q, size_t expectedFree)
     testOk(isFull == expectedFull, "Full: %d == %d", isFull, expectedFull);
 }
 
+static size_t gotSize;
+
+static void *getSized(void *dest, const void *src, size_t elemSize)
+{
+    gotSize = elemSize;
+    return memcpy(dest, src, elemSize);
+}
+
+static size_t maxPutSize;
+
+static void *putSized(void *dest, const void *src, size_t elemSize)
+{
+    if (elemSize > maxPutSize)
+        maxPutSize = elemSize;
+    return memcpy(dest, src, elemSize);
+}
+
+static void shortPutTest(void)
+{
+    /* shorter than an element, like a monitor of a pv with fewer
+       elements than the variable it is assigned to */
+    static const char put[] = "abc";
+    char get[64];
+    int policy;
+
+    testDiag("queueTest with short elements in fixed size queues");
+
+    for (policy = seqQueueCoalesce; policy <= seqQueueDropOldest; policy++) {
+        QUEUE q = seqQueueCreate(2, sizeof(get));
+        int i;
+
+        if (!q) {
+            testAbort("seqQueueCreate failed");
+        }
+        seqQueueSetPolicy(q, policy);
+        maxPutSize = 0;
+        /* the third put overflows */
+        for (i = 0; i < 3; i++) {
+            seqQueuePutSizeF(q, sizeof(put), putSized, put);
+        }
+        testOk(maxPutSize == sizeof(put), "%s: put size %lu",
+            seqQueuePolicyName(policy), (unsigned long)maxPutSize);
+        testOk(!seqQueueGet(q, get) && strcmp(get, put) == 0, "%s: q get %s",
+            seqQueuePolicyName(policy), put);
+        seqQueueDestroy(q);
+    }
+}
+
+static void varSizeTest(void)
+{
+    static const char *strs[] = {"a", "bb", "ccc", "dddd", "e"};
+    char put[64], get[64];
+    QUEUE q;
+    int i;
+
+    testDiag("queueTest with variable size elements");
+
+    testOk1(seqQueueCreateVar(3, 100, 64)==0);
+
+    /* limited by number of elements */
+    q = seqQueueCreateVar(4, sizeof(get), 1024);
+    if (!q) {
+        testAbort("seqQueueCreateVar failed");
+    }
+    for (i = 0; i < 5; i++) {
+        int full = seqQueuePutSizeF(q, strlen(strs[i]) + 1, memcpy, strs[i]);
+        testOk(full==(i>=4), "q put %s", strs[i]);
+    }
+    check(q, 0);
+    for (i = 0; i < 4; i++) {
+        const char *expected = strs[i < 3 ? i : 4];
+        int empty = seqQueueGetF(q, getSized, get);
+        testOk(!empty && strcmp(get, expected)==0, "q get %s", expected);
+        testOk(gotSize==strlen(expected)+1, "size %lu", (unsigned long)gotSize);
+    }
+    testOk1(seqQueueGetF(q, getSized, get));
+    seqQueueDestroy(q);
+
+    /* limited by number of bytes: only three elements fit */
+    q = seqQueueCreateVar(100, sizeof(put), 256);
+    if (!q) {
+        testAbort("seqQueueCreateVar failed");
+    }
+    for (i = 0; i < 4; i++) {
+        int full;
+        memset(put, 'a' + i, sizeof(put));
+        full = seqQueuePutSizeF(q, sizeof(put), memcpy, put);
+        testOk(full==(i>=3), "q put %c", 'a' + i);
+    }
+    testOk1(seqQueueUsed(q)==3);
+
+    /* wrap around: after one get there is room at the start */
+    testOk1(!seqQueueGetF(q, getSized, get) && get[0]=='a');
+    memset(put, 'e', sizeof(put));
+    testOk1(!seqQueuePutSizeF(q, sizeof(put), memcpy, put));
+    for (i = 0; i < 3; i++) {
+        const char expected = "bde"[i];
+        int empty = seqQueueGetF(q, getSized, get);
+        testOk(!empty && get[0]==expected && get[sizeof(get)-1]==expected,
+            "q get %c", expected);
+    }
+    testOk1(seqQueueIsEmpty(q));
+    seqQueueDestroy(q);
+}
+
+static void policyTest(void)
+{
+    static const char *strs[] = {"a", "bb", "ccc", "dddd", "e"};
+    /* expected contents after putting 1..5 into a queue of 3 */
+    static const ELEM expected[][3] = {{1,2,5}, {1,2,3}, {3,4,5}};
+    /* expected contents after putting strs into a queue of 4 */
+    static const int expectedVar[][4] = {{0,1,2,4}, {0,1,2,3}, {1,2,3,4}};
+    int policy;
+
+    testDiag("queueTest with overflow policies");
+
+    for (policy = seqQueueCoalesce; policy <= seqQueueDropOldest; policy++) {
+        QUEUE q = seqQueueCreate(3, sizeof(ELEM));
+        seqQueueCounters c;
+        ELEM i, x;
+
+        if (!q) {
+            testAbort("seqQueueCreate failed");
+        }
+        seqQueueSetPolicy(q, policy);
+        for (i = 1; i <= 5; i++) {
+            int full = seqQueuePut(q, &i);
+            testOk(full==(i>3), "%s: q put %d", seqQueuePolicyName(policy), (int)i);
+        }
+        for (i = 0; i < 3; i++) {
+            int empty = seqQueueGet(q, &x);
+            testOk(!empty && x==expected[policy][i], "%s: q get %d",
+                seqQueuePolicyName(policy), (int)expected[policy][i]);
+        }
+        testOk1(seqQueueGet(q, &x));
+        seqQueueGetCounters(q, &c);
+        testOk(c.puts==(policy==seqQueueDropNewest?3u:5u) && c.gets==3
+            && c.drops==2 && c.overflows==2 && c.highWater==3,
+            "%s: puts=%u gets=%u drops=%u overflows=%u highWater=%u",
+            seqQueuePolicyName(policy),
+            c.puts, c.gets, c.drops, c.overflows, c.highWater);
+        seqQueueDestroy(q);
+    }
+
+    for (policy = seqQueueCoalesce; policy <= seqQueueDropOldest; policy++) {
+        QUEUE q = seqQueueCreateVar(4, 64, 1024);
+        seqQueueCounters c;
+        char get[64];
+        int i;
+
+        if (!q) {
+            testAbort("seqQueueCreateVar failed");
+        }
+        seqQueueSetPolicy(q, policy);
+        for (i = 0; i < 5; i++) {
+            seqQueuePutSizeF(q, strlen(strs[i]) + 1, memcpy, strs[i]);
+        }
+        for (i = 0; i < 4; i++) {
+            const char *exp = strs[expectedVar[policy][i]];
+            int empty = seqQueueGetF(q, getSized, get);
+            testOk(!empty && strcmp(get, exp)==0, "%s: q get %s",
+                seqQueuePolicyName(policy), exp);
+        }
+        seqQueueGetCounters(q, &c);
+        testOk(c.gets==4 && c.drops==1 && c.highWater==4,
+            "%s: gets=%u drops=%u highWater=%u", seqQueuePolicyName(policy),
+            c.gets, c.drops, c.highWater);
+        seqQueueDestroy(q);
+    }
+}
+
 static epicsEventId wdone, rdone, ready;
 
 static const int threadTestIterations = 1000000;
@@ -88,7 +259,7 @@ MAIN(queueTest)
 
     errlogSetSevToLog(errlogFatal+1);
 
-    testPlan(212 + 2*threadTestMaxNumElems);
+    testPlan(212 + 2*threadTestMaxNumElems + 30 + 45 + 6);
 
     testOk1(seqQueueCreate(1,0)==0);
     testOk1(seqQueueCreate(0,1)==0);
@@ -168,5 +339,9 @@ MAIN(queueTest)
     epicsEventDestroy(rdone);
     epicsEventDestroy(ready);
 
+    varSizeTest();
+    policyTest();
+    shortPutTest();
+
     return testDone();
 }
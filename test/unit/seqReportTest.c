@@ -0,0 +1,128 @@
+/*************************************************************************\
+This file is distributed subject to a Software License Agreement found
+in file LICENSE that is included with this distribution.
+\*************************************************************************/
+/* Test the rate-limited error reporting (src/seq/seq_report.c) */
+#include "seq.h"
+#include "seq_debug.h"
+#include "epicsThread.h"
+#include "epicsEvent.h"
+#include "epicsUnitTest.h"
+#include "testMain.h"
+
+#define NREPORTS    1000
+#define NTHREADS    4
+
+static PROG *createProg(void)
+{
+    PROG *sp = (PROG *)calloc(1, sizeof(PROG));
+
+    sp->progName = "seqReportTest";
+    return sp;
+}
+
+/* Report n events at a site, return how many should be reported in full */
+static int reportMany(PROG *sp, int site, const char *name, int n)
+{
+    int i, full = 0;
+
+    for (i = 0; i < n; i++)
+        if (seq_report(sp, site, name))
+            full++;
+    return full;
+}
+
+static void testCounts(void)
+{
+    PROG *sp = createProg();
+    REPORT *r = sp->report + REPORT_QUEUE_OVERFLOW;
+
+    testDiag("rate-limited reports");
+    seqReportInterval = 10.0;
+    testOk1(seq_report(sp, REPORT_QUEUE_OVERFLOW, "x"));
+    testOk(reportMany(sp, REPORT_QUEUE_OVERFLOW, "y", NREPORTS - 1) == 0,
+        "only the first one is reported in full");
+    testOk(r->count == NREPORTS, "count %d == %d", r->count, NREPORTS);
+    testOk(r->total == NREPORTS, "total %d == %d", r->total, NREPORTS);
+    testOk1(strcmp((const char *)r->last, "y") == 0);
+    testOk1(sp->report[REPORT_CONNECT_TWICE].total == 0);
+
+    seq_report_flush(sp);
+    errlogFlush();
+    testOk(r->count == 0, "count %d == 0 after flush", r->count);
+    testOk(r->total == NREPORTS, "total %d == %d after flush", r->total, NREPORTS);
+    testOk(seq_report(sp, REPORT_QUEUE_OVERFLOW, "x"),
+        "first one after flush is reported in full");
+    testOk1(r->total == NREPORTS + 1);
+    free(sp);
+}
+
+static void testUnlimited(void)
+{
+    PROG *sp = createProg();
+    REPORT *r = sp->report + REPORT_PENDING_TIMEOUT;
+
+    testDiag("interval 0: report every event");
+    seqReportInterval = 0.0;
+    testOk(reportMany(sp, REPORT_PENDING_TIMEOUT, "x", NREPORTS) == NREPORTS,
+        "all are reported in full");
+    testOk(r->count == 0, "count %d == 0", r->count);
+    testOk(r->total == NREPORTS, "total %d == %d", r->total, NREPORTS);
+    seqReportInterval = 10.0;
+    free(sp);
+}
+
+struct reporter {
+    PROG            *sp;
+    epicsEventId    done;
+    int             full;
+};
+
+static void reporterThread(void *arg)
+{
+    struct reporter *rp = (struct reporter *)arg;
+
+    rp->full = reportMany(rp->sp, REPORT_ALREADY_PENDING, "x", NREPORTS);
+    epicsEventSignal(rp->done);
+}
+
+static void testThreads(void)
+{
+    PROG *sp = createProg();
+    REPORT *r = sp->report + REPORT_ALREADY_PENDING;
+    struct reporter rps[NTHREADS];
+    int i, full = 0;
+
+    testDiag("%d threads reporting concurrently", NTHREADS);
+    seqReportInterval = 10.0;
+    for (i = 0; i < NTHREADS; i++) {
+        rps[i].sp = sp;
+        rps[i].done = epicsEventMustCreate(epicsEventEmpty);
+        rps[i].full = 0;
+        epicsThreadCreate("reporter", epicsThreadPriorityMedium,
+            epicsThreadGetStackSize(epicsThreadStackSmall), reporterThread, rps + i);
+    }
+    for (i = 0; i < NTHREADS; i++) {
+        epicsEventMustWait(rps[i].done);
+        epicsEventDestroy(rps[i].done);
+        full += rps[i].full;
+    }
+    testOk(full == 1, "%d reported in full", full);
+    testOk(r->count == NTHREADS * NREPORTS, "count %d == %d",
+        r->count, NTHREADS * NREPORTS);
+    testOk(r->total == NTHREADS * NREPORTS, "total %d == %d",
+        r->total, NTHREADS * NREPORTS);
+    seq_report_flush(sp);
+    errlogFlush();
+    testOk1(r->count == 0);
+    free(sp);
+}
+
+MAIN(seqReportTest)
+{
+    testPlan(17);
+    testCounts();
+    testUnlimited();
+    testThreads();
+    return testDone();
+}
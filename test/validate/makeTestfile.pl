@@ -57,6 +57,8 @@ print $OUT <<EOF;
 \$ENV{TOP} = '$top';
 \$ENV{PATH} = '$top/bin/$host_arch$pathsep$path';
 \$ENV{EPICS_CA_SERVER_PORT} = 10000 + \$\$ % 30000;
+\$ENV{EPICS_PVA_SERVER_PORT} = 40000 + \$\$ % 20000;
+\$ENV{EPICS_PVA_BROADCAST_PORT} = \$ENV{EPICS_PVA_SERVER_PORT} + 1;
 #only for debugging:
 #print STDERR "port=\$ENV{EPICS_CA_SERVER_PORT}\\n";
 EOF